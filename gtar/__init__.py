@@ -3,5 +3,7 @@ from . import _gtar
 from .version import __version__
 from ._gtar import *
 
-__all__ = ['OpenMode', 'CompressMode', 'Behavior', 'Format', 'Resolution',
-           'Record', 'GTAR', '__version__']
+__all__ = ['OpenMode', 'CompressMode', 'CodecId', 'DeltaMode', 'ShuffleMode',
+           'Behavior', 'Format', 'Resolution', 'Record', 'GTAR',
+           'TrajectoryArray', 'startTracing', 'stopTracing', 'tracingEnabled',
+           'writeTrace', 'removeSharedCache', '__version__']
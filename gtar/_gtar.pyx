@@ -1,12 +1,15 @@
 # distutils: language = c++
 # cython: embedsignature=True
 
+from libcpp.map cimport map
 from libcpp.string cimport string
 from libcpp.vector cimport vector
+from libc.stddef cimport ptrdiff_t
 from cython.operator cimport dereference as deref
+import threading
 import numpy as np
 cimport numpy as np
-from cpython cimport PyObject, Py_INCREF
+from cpython.buffer cimport PyBuffer_FillInfo
 
 cimport cpp
 from cpp cimport GTAR as GTAR_
@@ -38,6 +41,48 @@ cdef class CompressMode:
     MediumCompress = cpp.MediumCompress
     SlowCompress = cpp.SlowCompress
 
+cdef class CodecId:
+    """
+    Enum for the compression methods which can be selected with
+    :py:meth:`GTAR.setCodec`
+
+       .. data:: NoCodec
+       .. data:: LZ4Codec
+       .. data:: DeflateCodec
+       .. data:: ZstdCodec
+       .. data:: ZstdLongCodec"""
+    NoCodec = cpp.NoCodec
+    LZ4Codec = cpp.LZ4Codec
+    DeflateCodec = cpp.DeflateCodec
+    ZstdCodec = cpp.ZstdCodec
+    ZstdLongCodec = cpp.ZstdLongCodec
+
+cdef class DeltaMode:
+    """
+    Enum for ways in which consecutive frames of a record can be stored
+    relative to each other
+
+       .. data:: NoDelta
+       .. data:: XorDelta
+       .. data:: DiffDelta
+       .. data:: DictDelta"""
+    NoDelta = cpp.NoDelta
+    XorDelta = cpp.XorDelta
+    DiffDelta = cpp.DiffDelta
+    DictDelta = cpp.DictDelta
+
+cdef class ShuffleMode:
+    """
+    Enum for ways in which the bytes of multi-byte elements can be
+    rearranged before they are compressed
+
+       .. data:: NoShuffle
+       .. data:: ByteShuffle
+       .. data:: BitShuffle"""
+    NoShuffle = cpp.NoShuffle
+    ByteShuffle = cpp.ByteShuffle
+    BitShuffle = cpp.BitShuffle
+
 cdef class Behavior:
     """
     Enum for how properties can behave over time
@@ -95,8 +140,22 @@ widths = {'position': 3,
           'virial': 6,
           'center_of_mass': 3}
 
+# buffer given for empty arrays, which have no pointer of their own
+cdef char emptyBuffer[1]
+
+# numpy types of the binary record formats
+formatDtypes = {cpp.Float32: np.dtype('<f4'),
+                cpp.Float64: np.dtype('<f8'),
+                cpp.Int32: np.dtype('<i4'),
+                cpp.Int64: np.dtype('<i8'),
+                cpp.UInt32: np.dtype('<u4'),
+                cpp.UInt64: np.dtype('<u8'),
+                cpp.UInt8: np.dtype('c')}
+
 cdef class SharedArray:
-    """Wrapper for the c++ SharedArray<char> class"""
+    """Wrapper for the c++ SharedArray<char> class. Exposes its
+    contents through the buffer protocol as read-only bytes, which
+    numpy arrays and memoryviews can refer to without copying."""
     cdef cpp.SharedArray[char] *thisptr
 
     def __cinit__(self):
@@ -124,13 +183,26 @@ cdef class SharedArray:
         else:
             raise IndexError('Index out of range')
 
-    def __array__(self):
-        """Interface to create a numpy array from this object"""
-        cdef np.npy_intp shape[1]
-        shape[0] = <np.npy_intp> self.thisptr.size()
-        result = np.PyArray_SimpleNewFromData(1, shape,
-                                            np.NPY_UINT8, self.thisptr.get())
-        self._setBase(result)
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        """Expose the contents of this object as a read-only buffer"""
+        cdef char *data = self.thisptr.get()
+        if data == NULL:
+            data = emptyBuffer
+        PyBuffer_FillInfo(buffer, self, data, self.thisptr.size(), 1, flags)
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+    def __array__(self, dtype=None, copy=None):
+        """Interface to create a numpy array from this object. Unless
+        a copy is requested, the array is a read-only view of the
+        contents of this object."""
+        result = np.frombuffer(self, dtype=np.uint8)
+
+        if copy:
+            result = result.copy()
+        if dtype is not None:
+            result = result.astype(dtype, copy=False)
 
         return result
 
@@ -138,30 +210,17 @@ cdef class SharedArray:
         return <bytes> self.thisptr.get()[:self.thisptr.size()]
 
     def __str__(self):
-        return unpy3str(self.__bytes__())
-
-    def _setBase(self, arr):
-        """Sets the base of arr to be this object and increases the
-        reference count"""
-        cpp.PyArray_SetBaseObject(arr, self)
-        Py_INCREF(self)
+        if not self.thisptr.size():
+            return ''
+        return self.thisptr.get()[:self.thisptr.size()].decode('utf8')
 
     def _arrayRecord(self, rec):
         """Create a numpy array from this object given some metadata in a Record
         object. Uses the widths dictionary in the gtar namespace to
         reshape the array into an Nxwidths[prop] array if the property's
-        name is present there."""
-        buf = np.asarray(self)
-
-        formats = {cpp.Float32: '<f4',
-                   cpp.Float64: '<f8',
-                   cpp.Int32: '<i4',
-                   cpp.Int64: '<i8',
-                   cpp.UInt32: '<u4',
-                   cpp.UInt64: '<u8',
-                   cpp.UInt8: 'c'}
-
-        result = np.frombuffer(buf, dtype=formats[rec.getFormat()])
+        name is present there. The result is a read-only view of the
+        contents of this object."""
+        result = np.frombuffer(self, dtype=formatDtypes[rec.getFormat()])
 
         name = rec.getName()
         if name in widths:
@@ -280,12 +339,21 @@ cdef class BulkWriter:
 
     """
     cdef GTAR_.BulkWriter *thisptr
+    cdef GTAR _arch
 
     def __cinit__(self, GTAR arch):
-        self.thisptr = new GTAR_.BulkWriter(deref(arch.thisptr))
+        self._arch = arch
+        with arch._lock:
+            with nogil:
+                self.thisptr = new GTAR_.BulkWriter(deref(arch.thisptr))
 
     cdef _dealloc(self):
-        del self.thisptr
+        # pending writes are finished when the writer is destroyed
+        if self.thisptr == NULL:
+            return
+        with self._arch._lock:
+            with nogil:
+                del self.thisptr
         self.thisptr = <GTAR_.BulkWriter*> 0
 
     def __dealloc__(self):
@@ -305,7 +373,12 @@ cdef class BulkWriter:
         :param contents: Bytestring to write
         :param mode: Optional compression mode (defaults to fast compression)
         """
-        self.thisptr.writeString(py3str(path), contents, mode)
+        cdef string cpath = py3str(path)
+        cdef string ccontents = contents
+        cdef cpp.CompressMode cmode = mode
+        with self._arch._lock:
+            with nogil:
+                self.thisptr.writeString(cpath, ccontents, cmode)
 
     def writeStr(self, path, contents, mode=cpp.FastCompress):
         """Write the given string to the given path, optionally
@@ -336,7 +409,11 @@ cdef class BulkWriter:
         """Write the given numpy array to the location within the
         archive, using the given compression mode. This serializes the
         data into the given binary data type or the same binary format
-        that the numpy array is using.
+        that the numpy array is using. Arrays (or other objects
+        supporting the buffer protocol) which are C-contiguous and
+        already have the given type are written without being
+        copied, and other strided arrays are copied only once, into
+        the buffer which is compressed.
 
         :param path: Path within the archive to write
         :param arr: Array-like object
@@ -347,12 +424,24 @@ cdef class BulkWriter:
 
             writer.writeArray('diameter.f32.ind', numpy.ones((N,)))
         """
-        arr = np.ascontiguousarray(np.asarray(arr).flat, dtype=dtype)
-        cdef np.ndarray[char, ndim=1, mode="c"] carr = np.frombuffer(arr, dtype=np.uint8)
-        if carr.nbytes:
-            self.thisptr.writePtr(py3str(path), &carr[0], carr.nbytes, mode)
-        else:
-            self.thisptr.writePtr(py3str(path), <void*> 0, carr.nbytes, mode)
+        # arrays (or other buffers) which already have the right
+        # type are written in place; strided views are gathered
+        # without the GIL rather than copied here
+        arr = np.asarray(arr, dtype=dtype)
+        cdef string cpath = py3str(path)
+        cdef const void *contents = np.PyArray_DATA(<np.ndarray> arr) if arr.nbytes else NULL
+        cdef size_t byteLength = arr.nbytes
+        cdef size_t itemsize = arr.itemsize
+        cdef bint contiguous = arr.flags.c_contiguous
+        cdef vector[size_t] shape = arr.shape
+        cdef vector[ptrdiff_t] strides = arr.strides
+        cdef cpp.CompressMode cmode = mode
+        with self._arch._lock:
+            with nogil:
+                if contiguous or not byteLength:
+                    self.thisptr.writePtr(cpath, contents, byteLength, cmode)
+                else:
+                    self.thisptr.writeStrided(cpath, contents, itemsize, shape, strides, cmode)
 
     def writeRecord(self, Record rec, contents, mode=cpp.FastCompress):
         """Writes the given contents to the path specified by the given record.
@@ -398,23 +487,47 @@ cdef class GTAR:
     - write: A new file will be opened for writing, potentially overwriting an existing file of the same name
     - append: A file will be opened for writing, adding to the end of a file if it already exists with the same name
 
+    An index exported by :py:meth:`exportIndex` may be given when
+    opening an archive for reading, in which case its files and
+    records are taken from the index instead of being found by reading
+    the archive, as long as the archive's size and modification time
+    haven't changed since; otherwise the index is ignored. Copies of
+    archives opened for reading made by pickling carry their index, so
+    that sending them to many worker processes doesn't read the
+    archive again in each of them.
+
     :param path: Path to the file to open
     :param mode: Open mode: one of 'r', 'w', 'a'
+    :param index: Optional index of the archive, as returned by :py:meth:`exportIndex`
     """
     cdef cpp.GTAR *thisptr
     cdef _path
     cdef _mode
+    # (size, name) given to setSharedCache, if any, so that copies
+    # made by pickling share the cache too
+    cdef _sharedCache
+    # The GIL is released while the c++ object reads, writes, and
+    # compresses, so this serializes its use by multiple threads
+    cdef object _lock
 
     openModes = {'r': cpp.Read,
                  'w': cpp.Write,
                  'a': cpp.Append}
 
-    def __cinit__(self, path, mode):
+    def __cinit__(self, path, mode, index=None):
         """Initialize a `GTAR` object given an archive path and open mode"""
+        cdef string cpath = py3str(path)
+        cdef string cindex = index or b''
+        cdef cpp.OpenMode cmode
         self._path = path
         self._mode = mode
+        self._sharedCache = None
+        self._lock = threading.Lock()
         try:
-            self.thisptr = new cpp.GTAR(py3str(path), self.openModes[self._mode])
+            cmode = self.openModes[self._mode]
+            # opening builds the index of the archive
+            with nogil:
+                self.thisptr = new cpp.GTAR(cpath, cmode, cindex)
         except KeyError:
             raise RuntimeError('Unknown open mode: {}'.format(self._mode))
         except RuntimeError as e:
@@ -422,7 +535,8 @@ cdef class GTAR:
 
     def __dealloc__(self):
         """Destroy the held `GTAR` object"""
-        del self.thisptr
+        with nogil:
+            del self.thisptr
 
     def __enter__(self):
         """Enter a context with this object"""
@@ -433,7 +547,17 @@ cdef class GTAR:
         self.close()
 
     def __reduce__(self):
-        return (self.__class__, (self._path, self._mode))
+        state = None
+        if self._sharedCache is not None:
+            state = dict(sharedCache=self._sharedCache)
+        args = (self._path, self._mode)
+        if self._mode == 'r':
+            args += (self.exportIndex(),)
+        return (self.__class__, args, state)
+
+    def __setstate__(self, state):
+        if state and state.get('sharedCache') is not None:
+            self.setSharedCache(*state['sharedCache'])
 
     def _sortFrameKey(self, v):
         """Key function for sorting frame indices"""
@@ -443,7 +567,22 @@ cdef class GTAR:
         """Close the file this object is writing to. It is safe to
         close a file multiple times, but impossible to read from or
         write to it after closing."""
-        self.thisptr.close()
+        with self._lock:
+            with nogil:
+                self.thisptr.close()
+
+    cdef SharedArray _read(self, const string &path):
+        """Read the contents of the given location within the archive
+        into a new :py:class:`SharedArray`, releasing the GIL while
+        reading and decompressing"""
+        cdef cpp.SharedArray[char] contents
+        with self._lock:
+            with nogil:
+                contents = self.thisptr.readBytes(path)
+
+        result = SharedArray()
+        result.copy(contents)
+        return result
 
     def readBytes(self, path):
         """Read the contents of the given location within the archive,
@@ -451,8 +590,7 @@ cdef class GTAR:
 
         :param path: Path within the archive to write
         """
-        result = SharedArray()
-        result.copy(self.thisptr.readBytes(py3str(path)))
+        result = self._read(py3str(path))
 
         return (bytes(result) if len(result) else None)
 
@@ -464,7 +602,12 @@ cdef class GTAR:
         :param contents: Bytestring to write
         :param mode: Optional compression mode (defaults to fast compression)
         """
-        self.thisptr.writeString(py3str(path), contents, mode)
+        cdef string cpath = py3str(path)
+        cdef string ccontents = contents
+        cdef cpp.CompressMode cmode = mode
+        with self._lock:
+            with nogil:
+                self.thisptr.writeString(cpath, ccontents, cmode)
 
     def readStr(self, path):
         """Read the contents of the given path as a string or return
@@ -472,11 +615,9 @@ cdef class GTAR:
 
         :param path: Path within the archive to write
         """
-        result = self.readBytes(path)
-        if result is not None:
-            return result.decode('utf8')
-        else:
-            return result
+        result = self._read(py3str(path))
+
+        return (str(result) if len(result) else None)
 
     def writeStr(self, path, contents, mode=cpp.FastCompress):
         """Write the given string to the given path, optionally
@@ -517,7 +658,11 @@ cdef class GTAR:
         """Write the given numpy array to the location within the
         archive, using the given compression mode. This serializes the
         data into the given binary data type or the same binary format
-        that the numpy array is using.
+        that the numpy array is using. Arrays (or other objects
+        supporting the buffer protocol) which are C-contiguous and
+        already have the given type are written without being
+        copied, and other strided arrays are copied only once, into
+        the buffer which is compressed.
 
         :param path: Path within the archive to write
         :param arr: Array-like object
@@ -528,23 +673,36 @@ cdef class GTAR:
 
             gtar.writeArray('diameter.f32.ind', numpy.ones((N,)))
         """
-        arr = np.ascontiguousarray(np.asarray(arr).flat, dtype=dtype)
-        cdef np.ndarray[char, ndim=1, mode="c"] carr = np.frombuffer(arr, dtype=np.uint8)
-        if carr.nbytes:
-            self.thisptr.writePtr(py3str(path), &carr[0], carr.nbytes, mode)
-        else:
-            self.thisptr.writePtr(py3str(path), <void*> 0, carr.nbytes, mode)
+        # arrays (or other buffers) which already have the right
+        # type are written in place; strided views are gathered
+        # without the GIL rather than copied here
+        arr = np.asarray(arr, dtype=dtype)
+        cdef string cpath = py3str(path)
+        cdef const void *contents = np.PyArray_DATA(<np.ndarray> arr) if arr.nbytes else NULL
+        cdef size_t byteLength = arr.nbytes
+        cdef size_t itemsize = arr.itemsize
+        cdef bint contiguous = arr.flags.c_contiguous
+        cdef vector[size_t] shape = arr.shape
+        cdef vector[ptrdiff_t] strides = arr.strides
+        cdef cpp.CompressMode cmode = mode
+        with self._lock:
+            with nogil:
+                if contiguous or not byteLength:
+                    self.thisptr.writePtr(cpath, contents, byteLength, cmode)
+                else:
+                    self.thisptr.writeStrided(cpath, contents, itemsize, shape, strides, cmode)
 
     def getBulkWriter(self):
         """Get a :py:class:`gtar.BulkWriter` context object. These allow for more
         efficient writes when writing many records at once."""
         return BulkWriter(self)
 
-    def getRecord(self, Record query, index=""):
+    def getRecord(self, Record query, index="", out=None):
         """Returns the contents of the given base record and index.
 
         :param query: Prototypical :py:class:`gtar.Record` object describing the record to fetch
         :param index: Index used to fetch the record (defaults to index embedded in :code:`query`)
+        :param out: Optional array to read a binary record into and return, rather than allocating a new one. It must be C-contiguous, writable, of the record's type, and exactly the record's size.
         :type query: :py:class:`gtar.Record`
         :type index: string
 
@@ -559,10 +717,11 @@ cdef class GTAR:
         if index != "":
             rec.setIndex(index)
 
-        cdef cpp.SharedArray[char] inter
-        inter = self.thisptr.readBytes(rec.thisptr.getPath())
-        result = SharedArray()
-        result.copy(inter)
+        if out is not None:
+            self._readInto(rec, [rec.getIndex()], out)
+            return out
+
+        result = self._read(rec.thisptr.getPath())
 
         if rec.thisptr.getResolution() != cpp.Text:
             return result._arrayRecord(rec)
@@ -572,6 +731,131 @@ cdef class GTAR:
             except UnicodeDecodeError:
                 return bytes(result)
 
+    cdef _readInto(self, Record rec, frames, np.ndarray out):
+        """Read the given frames of a binary record, one after another,
+        into out, releasing the GIL while reading"""
+        cdef cpp.Record crec = deref(rec.thisptr)
+        cdef vector[string] cframes
+        cdef void *target = np.PyArray_DATA(out)
+        cdef size_t frameLength = out.nbytes//max(len(frames), 1)
+
+        if rec.getResolution() == cpp.Text:
+            raise ValueError('Can\'t read text record {} into an array'.format(rec.getPath()))
+        elif out.dtype != formatDtypes[rec.getFormat()]:
+            raise ValueError('Can\'t read record {} into an array of type {}'.format(
+                rec.getPath(), out.dtype))
+        elif not (out.flags.c_contiguous and out.flags.writeable):
+            raise ValueError('Arrays to read into must be C-contiguous and writable')
+        elif frameLength*len(frames) != out.nbytes:
+            raise ValueError('Array to read into does not divide evenly into {} frames'.format(
+                len(frames)))
+
+        for frame in frames:
+            cframes.push_back(py3str(frame))
+
+        with self._lock:
+            with nogil:
+                self.thisptr.readFrames(crec, cframes, target, frameLength)
+
+    def readFrames(self, Record record, frames, out=None):
+        """Read a binary record at each of the given frames into a
+        single array, which has the shape :py:meth:`getRecord` gives
+        for one frame with an extra leading dimension for the
+        frames. All of the frames must be the same size. The frames
+        are read by a single call into the c++ library.
+
+        :param record: Prototypical :py:class:`gtar.Record` object (the index of which is unused)
+        :param frames: Iterable of frame indices to read
+        :param out: Optional array to read into and return, rather than allocating a new one. It must be C-contiguous, writable, of the record's type, and exactly large enough for all of the frames.
+
+        Example::
+
+            (record, frames) = traj.framesWithRecordsNamed('position')
+            # shape (len(frames), N, 3)
+            positions = traj.readFrames(record, frames)
+        """
+        frames = list(frames)
+
+        if out is not None:
+            self._readInto(record, frames, out)
+            return out
+        elif record.getResolution() == cpp.Text:
+            raise ValueError('Can\'t read text record {} into an array'.format(record.getName()))
+        elif not frames:
+            return np.empty((0,), dtype=formatDtypes[record.getFormat()])
+
+        # the first frame determines the shape of the others
+        first = self.getRecord(record, frames[0])
+        result = np.empty((len(frames),) + first.shape, dtype=first.dtype)
+        result[0] = first
+        self._readInto(record, frames[1:], result[1:])
+
+        return result
+
+    def copyRecords(self, GTAR source, paths=None, mode=cpp.FastCompress):
+        """Copy records from another archive into this one exactly as
+        they are stored there. Compressed records which this archive
+        can store as they are (for example, deflated records from one
+        zip file to another) are copied without being decompressed
+        and compressed again; the rest are written with the given
+        compression mode.
+
+        Frames stored relative to other frames (see
+        :py:func:`GTAR.setDelta`) refer to them by path, so all frames
+        of such records should be copied together.
+
+        :param source: :py:class:`gtar.GTAR` object to copy from
+        :param paths: Iterable of paths to copy (defaults to every record in source)
+        :param mode: Optional compression mode for records which are decompressed (defaults to fast compression)
+
+        Example::
+
+            with gtar.GTAR('old.zip', 'r') as old, gtar.GTAR('new.zip', 'w') as new:
+                new.copyRecords(old)
+        """
+        if source is self:
+            raise ValueError('Can\'t copy records from an archive into itself')
+
+        if paths is None:
+            paths = []
+            for rec in source.getRecordTypes():
+                for frame in source.queryFrames(rec):
+                    rec.setIndex(frame)
+                    paths.append(rec.getPath())
+
+        cdef vector[string] cpaths = [py3str(path) for path in paths]
+        cdef cpp.CompressMode cmode = mode
+        # take the locks in a consistent order
+        (first, second) = sorted([self._lock, source._lock], key=id)
+        with first:
+            with second:
+                with nogil:
+                    self.thisptr.copyRecords(deref(source.thisptr), cpaths, cmode)
+
+    def mergeArchives(self, inputs, mode=cpp.FastCompress, numThreads=0):
+        """Copy every record of the archives with the given file names
+        into this one. Where several inputs have a record at the same
+        path, the record from the last of them is kept. Records are
+        read, compressed again if necessary, and written on several
+        threads, and are copied without being decompressed when they
+        can be (see :py:func:`GTAR.copyRecords`).
+
+        :param inputs: List of file names of archives to read
+        :param mode: Optional compression mode for records which are decompressed (defaults to fast compression)
+        :param numThreads: Number of threads to read and compress records with (defaults to one per processor)
+
+        Example::
+
+            with gtar.GTAR('merged.sqlite', 'w') as merged:
+                merged.mergeArchives(['run1.zip', 'run2.zip'])
+        """
+        cdef vector[string] cinputs = [py3str(input) for input in inputs]
+        cdef cpp.CompressMode cmode = mode
+        cdef unsigned int cthreads = numThreads
+        with self._lock:
+            with nogil:
+                self.thisptr.mergeArchives(cinputs, cmode, cthreads)
+
     def writeRecord(self, Record rec, contents, mode=cpp.FastCompress):
         """Writes the given contents to the path specified by the given record.
 
@@ -598,6 +882,278 @@ cdef class GTAR:
             self.writeArray(rec.getPath(), contents, mode,
                             dtype=dtypes[rec.getFormat()])
 
+    def setDelta(self, name, mode=cpp.XorDelta, keyframeInterval=16):
+        """Store frames of individual records with the given name
+        relative to the previously-written frame of the same
+        record. Every `keyframeInterval`-th frame is stored in full,
+        so reading any frame touches at most `keyframeInterval`
+        stored frames. Frames are decoded transparently when read.
+
+        :param name: Record name to encode (for example, 'position'); an empty string applies to all records
+        :param mode: :py:class:`gtar.DeltaMode` to encode frames with (defaults to XOR encoding)
+        :param keyframeInterval: Number of frames between full keyframes
+
+        Example::
+
+            traj.setDelta('position', gtar.DeltaMode.XorDelta, 32)
+        """
+        with self._lock:
+            self.thisptr.setDelta(py3str(name), mode, keyframeInterval)
+
+    def setShuffle(self, name, mode=cpp.ByteShuffle):
+        """Rearrange the bytes (or bits) of the elements of individual
+        records with the given name before they are stored, so that
+        the first byte of every element is stored first, then the
+        second, and so on. This usually makes floating-point data much
+        more compressible. Records are unshuffled transparently when
+        read.
+
+        :param name: Record name to shuffle (for example, 'position'); an empty string applies to all records
+        :param mode: :py:class:`gtar.ShuffleMode` to use (defaults to byte shuffling)
+
+        Example::
+
+            traj.setShuffle('', gtar.ShuffleMode.ByteShuffle)
+        """
+        with self._lock:
+            self.thisptr.setShuffle(py3str(name), mode)
+
+    def setQuantization(self, name, tolerance):
+        """Store float32 and float64 individual records with the given
+        name lossily, rounded so that each value read back is within
+        the absolute `tolerance` of the value written. Quantized
+        values are stored as 32-bit integers, which combine well with
+        :py:meth:`setDelta` and :py:meth:`setShuffle`. Frames with
+        values which can't be quantized (infinities, NaN, or values
+        too large for the tolerance) are stored losslessly. Records
+        are dequantized transparently when read.
+
+        :param name: Record name to quantize (for example, 'position'); an empty string applies to all records
+        :param tolerance: Maximum absolute error of each value; 0 disables quantization
+
+        Example::
+
+            traj.setQuantization('position', 1e-4)
+        """
+        with self._lock:
+            self.thisptr.setQuantization(py3str(name), tolerance)
+
+    def setCodec(self, name, codec, level=-1):
+        """Compress records with the given name using the given codec
+        instead of the default for the archive format. Archive formats
+        which can't store the codec natively (for example, LZ4 in zip
+        files) store the compressed data with a small header
+        instead. Records written with
+        :py:data:`gtar.CompressMode.NoCompress` are never
+        compressed. Records are decompressed transparently when read.
+
+        :param name: Record name to compress (for example, 'position'); an empty string applies to all records
+        :param codec: :py:class:`gtar.CodecId` to compress with
+        :param level: Codec-specific compression level; if negative, the level is chosen by the :py:class:`gtar.CompressMode` of each write
+
+        Example::
+
+            traj.setCodec('', gtar.CodecId.LZ4Codec)
+        """
+        with self._lock:
+            self.thisptr.setCodec(py3str(name), codec, level)
+
+    def setVerifyChecksums(self, verify):
+        """Enable or disable verification of the CRC-32 checksums
+        stored with each record of zip archives as they are
+        read. Verification is enabled by default; disabling it speeds
+        up reading trusted archives, especially uncompressed records.
+
+        :param verify: Whether to verify checksums
+
+        Example::
+
+            traj.setVerifyChecksums(False)
+        """
+        with self._lock:
+            self.thisptr.setVerifyChecksums(verify)
+
+    def setNumThreads(self, numThreads):
+        """Set the number of threads used to compress large records in
+        zip archives. Such records are split into pieces which are
+        compressed in parallel and joined into a single deflate
+        stream. Parallel compression is off by default (1 thread);
+        0 uses one thread per processor.
+
+        :param numThreads: Number of threads to use
+
+        Example::
+
+            traj.setNumThreads(4)
+        """
+        with self._lock:
+            self.thisptr.setNumThreads(numThreads)
+
+    def setMapFiles(self, mapFiles):
+        """Map large uncompressed records of tar, zip, and directory
+        archives opened for reading into memory rather than reading
+        them. Mapping is off by default: arrays read this way point
+        into the file, so their contents change if another process
+        rewrites it, and reading them crashes the interpreter if it
+        is truncated. Only enable it for archives which won't be
+        written to while the arrays read from them are in use.
+
+        :param mapFiles: Whether to map large records
+
+        Example::
+
+            traj.setMapFiles(True)
+        """
+        with self._lock:
+            self.thisptr.setMapFiles(mapFiles)
+
+    def setCacheSize(self, size):
+        """Keep up to the given number of bytes of the most recently
+        read records in memory after decoding them, so that reading
+        them again doesn't touch the archive. This helps when the
+        same records are read many times, such as constant records
+        found by :py:meth:`staticRecordNamed` for each frame or
+        frames revisited by an interactive viewer. Records larger
+        than the whole cache are never kept. The default of 0
+        disables the cache. Hits and misses are counted by
+        :py:meth:`stats`.
+
+        :param size: Maximum number of bytes of records to keep
+
+        Example::
+
+            traj.setCacheSize(256*1024*1024)
+        """
+        with self._lock:
+            self.thisptr.setCacheSize(size)
+
+    def setSharedCache(self, size, name=''):
+        """Share decoded records with other processes reading the same
+        archive (such as multiprocessing workers) through a cache in
+        POSIX shared memory of about the given number of bytes. The
+        first process to attach creates the cache; the rest find
+        records it (or any of them) has already decoded there. Copies
+        of this object made by pickling attach to the same cache. The
+        cache is named after the archive's absolute path, size, and
+        modification time unless a name is given, and outlives the
+        processes using it until :py:func:`gtar.removeSharedCache` is
+        called with :py:meth:`sharedCacheName`. Only archives opened
+        for reading may share a cache; a size of 0 detaches from it.
+        Hits and misses are counted by :py:meth:`stats`. Records
+        rewritten after they were cached are decoded again once
+        :py:meth:`refresh` finds them.
+
+        :param size: Size of the cache in bytes, if it is created
+        :param name: Optional name of the shared memory segment
+
+        Example::
+
+            traj = gtar.GTAR('dump.zip', 'r')
+            traj.setSharedCache(1024*1024*1024)
+            with multiprocessing.Pool(64) as pool:
+                pool.map(analyze, [(traj, frame) for frame in frames])
+            gtar.removeSharedCache(traj.sharedCacheName())
+        """
+        cdef size_t csize = size
+        cdef string cname = py3str(name)
+        with self._lock:
+            with nogil:
+                self.thisptr.setSharedCache(csize, cname)
+        self._sharedCache = (size, self.sharedCacheName()) if size else None
+
+    def sharedCacheName(self):
+        """Returns the name of the shared cache this archive is attached
+        to (see :py:meth:`setSharedCache`), or an empty string."""
+        return unpy3str(self.thisptr.sharedCacheName())
+
+    def exportIndex(self):
+        """Returns the files and records found when this archive was
+        opened (along with the archive's size and modification time)
+        as a compact bytes object, which can be given as the `index`
+        argument of :py:class:`GTAR` to open the same archive again
+        without reading it to find them. Only archives opened for
+        reading can be exported.
+
+        Example::
+
+            index = gtar.GTAR('dump.tar', 'r').exportIndex()
+            traj = gtar.GTAR('dump.tar', 'r', index=index)
+        """
+        cdef string result
+        with self._lock:
+            with nogil:
+                result = self.thisptr.exportIndex()
+        return result
+
+    def refresh(self):
+        """Finds the records added to an archive opened for reading since
+        it was opened or last refreshed, such as by a simulation which
+        is still writing to it, without reading the rest of the
+        archive again. Returns the number of files found. Tar, sqlite,
+        and directory archives are followed as they are written; zip
+        archives can only be followed up to the last time their writer
+        closed them, which is when their central directory is written.
+
+        Example::
+
+            with gtar.GTAR('dump.tar', 'r') as traj:
+                while True:
+                    if traj.refresh():
+                        update_plots(traj)
+                    time.sleep(5)
+        """
+        cdef unsigned int result
+        with self._lock:
+            with nogil:
+                result = self.thisptr.refresh()
+        return result
+
+    def stats(self):
+        """Returns a dict of counters of the work this archive has done
+        since it was opened (or :py:meth:`resetStats` was called),
+        which remain available after it is closed:
+
+        - bytesRead, bytesWritten: Bytes of files read and written, as the archive stores them
+        - uncompressedBytesRead, uncompressedBytesWritten: Bytes of those files before compression
+        - reads, writes: Number of files read and written
+        - seeks: Number of times the position in the file was moved
+        - transactions: Number of database transactions committed
+        - cacheHits, cacheMisses: Number of reads served from and missing the cache of :py:meth:`setCacheSize`
+        - sharedCacheHits, sharedCacheMisses: The same for the cache of :py:meth:`setSharedCache`
+        - compressTime, decompressTime: Seconds spent (de)compressing, including filters and checksums
+        - ioTime: Seconds spent in system calls and the storage library
+        - indexTime: Seconds spent finding the files of the archive when opening it
+
+        Example::
+
+            stats = traj.stats()
+            print(stats['compressTime'], stats['ioTime'])
+        """
+        cdef cpp.ArchiveStats result
+        with self._lock:
+            result = self.thisptr.stats()
+        return result
+
+    def recordStats(self):
+        """Returns the counters of :py:meth:`stats` for each kind of
+        record read or written, as a dict keyed by path with any
+        index replaced by '*' (for example,
+        'frames/*/position.f32.ind').
+        """
+        cdef map[string, cpp.ArchiveStats] stats
+        with self._lock:
+            stats = self.thisptr.recordStats()
+        result = {}
+        for (key, value) in stats:
+            result[unpy3str(key)] = value
+        return result
+
+    def resetStats(self):
+        """Reset all of the counters of :py:meth:`stats` and
+        :py:meth:`recordStats` to 0."""
+        with self._lock:
+            self.thisptr.resetStats()
+
     def getRecordTypes(self, group=None, group_prefix=None):
         """Returns a python list of all the record types (without index
         information) available in this archive. Optionally filters
@@ -609,7 +1165,8 @@ cdef class GTAR:
 
         """
         result = []
-        types = self.thisptr.getRecordTypes()
+        with self._lock:
+            types = self.thisptr.getRecordTypes()
         if group is not None:
             for rec in types:
                 if unpy3str(rec.getGroup()) == group:
@@ -636,7 +1193,8 @@ cdef class GTAR:
         :param target: Prototypical :py:class:`gtar.Record` object (the index of which is unused)
         """
         result = []
-        frames = self.thisptr.queryFrames(deref(target.thisptr))
+        with self._lock:
+            frames = self.thisptr.queryFrames(deref(target.thisptr))
         for f in frames:
             result.append(unpy3str(f))
         return result
@@ -730,6 +1288,30 @@ cdef class GTAR:
             for frame in sorted(frames, key=self._sortFrameKey):
                 yield frame, self.getRecord(allRecords[names[0]], frame)
 
+    def array(self, name, group=None, group_prefix=None):
+        """Returns a :py:class:`gtar.TrajectoryArray`, a lazy view of
+        the record with the given name over every frame in which it is
+        found. Frames are only read when the view is sliced.
+
+        :param name: Name of the property to find
+        :param group: Exact group name to select (default: do not filter by group); overrules `group_prefix`
+        :param group_prefix: Prefix of group name to select (default: do not filter by group)
+
+        Example::
+
+            positions = traj.array('position')
+            # x coordinates of every 10th frame from 1000 to 2000
+            x = positions[1000:2000:10, :, 0]
+
+        """
+        (record, frames) = self.framesWithRecordsNamed(
+            name, group=group, group_prefix=group_prefix)
+
+        if record is None:
+            raise KeyError('Can\'t find a record named {}'.format(name))
+
+        return TrajectoryArray(self, record, frames)
+
     def staticRecordNamed(self, name, group=None, group_prefix=None):
         """Returns a static record with the given name. If the property is
         found in ``gtar.widths``, returns it as an Nxwidths[prop]
@@ -749,7 +1331,140 @@ cdef class GTAR:
         except IndexError:
             raise KeyError('Can\'t find a static record named {}'.format(name))
 
+class TrajectoryArray(object):
+    """Lazy, read-only array of a record over a set of frames, usually
+    created by :py:func:`GTAR.array`. Its first dimension indexes
+    frames and the rest index the contents of each frame (with the
+    shape :py:func:`GTAR.getRecord` gives). Slicing it with numpy
+    syntax reads only the frames which are selected. Whole frames are
+    read with :py:func:`GTAR.readFrames`; when only part of each frame
+    is selected, frames are read one at a time and just the selected
+    part is kept, so large uncompressed frames (which are mapped into
+    memory) are only partly read from disk.
+
+    Every frame must have the same shape. The `chunks` attribute
+    (one frame per chunk) lets tools like dask split the array along
+    frames, for example with ``dask.array.from_array(traj.array('position'))``.
+
+    :param traj: :py:class:`gtar.GTAR` archive to read from
+    :param record: Prototypical :py:class:`gtar.Record` object (the index of which is unused)
+    :param frames: Frame indices of the array
+    """
+
+    def __init__(self, traj, record, frames):
+        self.traj = traj
+        self.record = record
+        self.frames = list(frames)
+
+        if self.frames:
+            first = traj.getRecord(record, self.frames[0])
+            (frameShape, self.dtype) = (first.shape, first.dtype)
+        else:
+            (frameShape, self.dtype) = ((0,), formatDtypes[record.getFormat()])
+
+        self.shape = (len(self.frames),) + frameShape
+        self.chunks = (1,) + frameShape
+
+    @property
+    def ndim(self):
+        return len(self.shape)
+
+    @property
+    def size(self):
+        return int(np.prod(self.shape))
+
+    def __len__(self):
+        return self.shape[0]
+
+    def __repr__(self):
+        return 'TrajectoryArray({}, shape={}, dtype={})'.format(
+            self.record.getName(), self.shape, self.dtype)
+
+    def __array__(self, dtype=None, copy=None):
+        result = self[:]
+        if dtype is not None:
+            result = result.astype(dtype, copy=False)
+        return result
+
+    def __getitem__(self, key):
+        if not isinstance(key, tuple):
+            key = (key,)
+
+        if any(k is Ellipsis for k in key):
+            where = [k is Ellipsis for k in key].index(True)
+            missing = self.ndim - (len(key) - 1)
+            key = key[:where] + (slice(None),)*missing + key[where + 1:]
+
+        (frameKey, rest) = (key[0], key[1:]) if key else (slice(None), ())
+
+        if isinstance(frameKey, slice):
+            indices = range(len(self))[frameKey]
+        elif np.ndim(frameKey) == 0:
+            index = int(frameKey)
+            if not -len(self) <= index < len(self):
+                raise IndexError('Frame {} is out of range for {} frames'.format(
+                    index, len(self)))
+            return self._read([self.frames[index]], rest)[0]
+        else:
+            indices = np.arange(len(self))[np.asarray(frameKey)]
+
+        return self._read([self.frames[i] for i in indices], rest)
+
+    def _read(self, frames, rest):
+        """Read the given frames, keeping the part of each selected by
+        the index tuple rest"""
+        if all(isinstance(k, slice) and k == slice(None) for k in rest):
+            if frames:
+                return self.traj.readFrames(self.record, frames)
+            return np.empty((0,) + self.shape[1:], dtype=self.dtype)
+
+        # find the shape of the selection without reading anything
+        selected = np.broadcast_to(np.zeros((), dtype=self.dtype), self.shape[1:])[rest]
+        result = np.empty((len(frames),) + selected.shape, dtype=self.dtype)
+
+        for (i, frame) in enumerate(frames):
+            result[i] = self.traj.getRecord(self.record, frame)[rest]
+
+        return result
+
 def isZip64(filename):
     """Internal helper function. Returns ``True`` if a file located at the
     given path is in zip64 format."""
     return cpp.isZip64(py3str(filename))
+
+def removeSharedCache(name):
+    """Remove the shared cache of the given name (see
+    :py:meth:`GTAR.setSharedCache`). Its memory is freed once every
+    process has detached from it.
+
+    :param name: Name of the cache, as returned by :py:meth:`GTAR.sharedCacheName`
+    """
+    cpp.removeSharedCache(py3str(name))
+
+def startTracing(filename):
+    """Start recording spans of time spent opening, indexing, reading,
+    writing, compressing, and closing archives on every thread. The
+    spans are written to the given file as Chrome trace event JSON
+    (viewable with chrome://tracing or https://ui.perfetto.dev) each
+    time an archive is closed. Tracing can also be enabled by setting
+    the ``GETAR_TRACE`` environment variable to a file name before
+    the first archive is opened.
+
+    :param filename: Name of the file to write traces to
+    """
+    cpp.startTracing(py3str(filename))
+
+def stopTracing():
+    """Write any recorded spans to the trace file and stop recording them."""
+    with nogil:
+        cpp.stopTracing()
+
+def tracingEnabled():
+    """Returns ``True`` if spans of archive operations are being recorded."""
+    return cpp.tracingEnabled()
+
+def writeTrace():
+    """Write the spans recorded so far to the trace file, without
+    waiting for an archive to be closed."""
+    with nogil:
+        cpp.writeTrace()
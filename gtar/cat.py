@@ -5,7 +5,7 @@ input file take precedence.
 
 ::
 
-   usage: cat.py [-h] [-o OUTPUT] ...
+   usage: cat.py [-h] -o OUTPUT [-j THREADS] ...
 
    Command-line archive concatenation
 
@@ -16,10 +16,12 @@ input file take precedence.
      -h, --help            show this help message and exit
      -o OUTPUT, --output OUTPUT
                            File to write to
+     -j THREADS, --threads THREADS
+                           Number of threads to use (default: one per
+                           processor)
 """
 
 import argparse
-from collections import defaultdict
 import os
 
 import gtar
@@ -30,12 +32,15 @@ parser.add_argument('inputs', nargs=argparse.REMAINDER,
                     help='Input files to read')
 parser.add_argument('-o', '--output', required=True,
                     help='File to write to')
+parser.add_argument('-j', '--threads', type=int, default=0,
+                    help='Number of threads to use (default: one per processor)')
 
-def main(inputs, output):
+def main(inputs, output, threads=0):
     """Take all records from a set of getar-formatted files and output them to another.
 
     :param inputs: Input filenames to concatenate
     :param output: Output filename (can be the same as input)
+    :param threads: Number of threads to use (defaults to one per processor)
 
     """
     nameHalves = os.path.splitext(output)
@@ -45,28 +50,9 @@ def main(inputs, output):
         nameHalves = (nameHalves[0] + '_', nameHalves[1])
         tempName = nameHalves[0] + nameHalves[1]
 
-    recordFiles = {}
-    for input in inputs:
-        with gtar.GTAR(input, 'r') as inpFile:
-            recs = {rec: inpFile.queryFrames(rec) for rec in inpFile.getRecordTypes()}
-
-            for rec in recs:
-                frames = recs[rec]
-                for frame in frames:
-                    rec.setIndex(frame)
-                    recordFiles[rec.getPath()] = input
-
-    sourceRecords = defaultdict(list)
-    for path in recordFiles:
-        sourceRecords[recordFiles[path]].append(path)
-
     try:
         with gtar.GTAR(tempName, 'w') as out:
-            for source in sourceRecords:
-                allPaths = sorted(sourceRecords[source])
-                with gtar.GTAR(source, 'r') as inp:
-                    for path in allPaths:
-                        out.writePath(path, inp.readPath(path))
+            out.mergeArchives(inputs, numThreads=threads)
 
         if not os.path.samefile(tempName, output):
             os.rename(tempName, output)
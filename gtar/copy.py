@@ -3,7 +3,7 @@ Copy each record from one getar-formatted file to another.
 
 ::
 
-   usage: python -m gtar.copy [-h] input output
+   usage: python -m gtar.copy [-h] [-j THREADS] input output
 
    Command-line archive copier or translator
 
@@ -13,6 +13,8 @@ Copy each record from one getar-formatted file to another.
 
    optional arguments:
      -h, --help      show this help message and exit
+     -j THREADS, --threads THREADS
+                     Number of threads to use (default: one per processor)
 """
 
 import argparse
@@ -25,14 +27,17 @@ parser.add_argument('input',
                     help='Input file to read')
 parser.add_argument('output',
                     help='File to write to')
+parser.add_argument('-j', '--threads', type=int, default=0,
+                    help='Number of threads to use (default: one per processor)')
 
-def main(input, output):
+def main(input, output, threads=0):
     """Copy each record from one getar-formatted file to another.
 
     :param input: Input filename
     :param output: Output filename (can be the same as input)
+    :param threads: Number of threads to use (defaults to one per processor)
 
     """
-    cat.main(inputs=[input], output=output)
+    cat.main(inputs=[input], output=output, threads=threads)
 
 if __name__ == '__main__': main(**vars(parser.parse_args()))
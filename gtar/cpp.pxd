@@ -1,16 +1,18 @@
 # distutils: language = c++
 
+from libcpp.map cimport map
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from cython.operator cimport dereference as deref
 
 cimport numpy
 from libcpp cimport bool
+from libc.stddef cimport ptrdiff_t
 
 cdef extern from "numpy/arrayobject.h":
     cdef int PyArray_SetBaseObject(numpy.ndarray arr, obj)
 
-cdef extern from "../src/SharedArray.hpp" namespace "gtar_pymodule::gtar":
+cdef extern from "../src/SharedArray.hpp" namespace "gtar_pymodule::gtar" nogil:
     cdef cppclass SharedArray[T]:
         # ctypedef (T*) iterator
 
@@ -45,7 +47,45 @@ cdef extern from "../src/Archive.hpp" namespace "gtar_pymodule::gtar":
         MediumCompress
         SlowCompress
 
-cdef extern from "../src/Record.hpp" namespace "gtar_pymodule::gtar":
+    cdef struct ArchiveStats:
+        unsigned long long bytesRead
+        unsigned long long bytesWritten
+        unsigned long long uncompressedBytesRead
+        unsigned long long uncompressedBytesWritten
+        unsigned long long reads
+        unsigned long long writes
+        unsigned long long seeks
+        unsigned long long transactions
+        unsigned long long cacheHits
+        unsigned long long cacheMisses
+        unsigned long long sharedCacheHits
+        unsigned long long sharedCacheMisses
+        double compressTime
+        double decompressTime
+        double ioTime
+        double indexTime
+
+cdef extern from "../src/Codec.hpp" namespace "gtar_pymodule::gtar":
+    cdef enum CodecId:
+        NoCodec
+        LZ4Codec
+        DeflateCodec
+        ZstdCodec
+        ZstdLongCodec
+
+cdef extern from "../src/Filter.hpp" namespace "gtar_pymodule::gtar":
+    cdef enum DeltaMode:
+        NoDelta
+        XorDelta
+        DiffDelta
+        DictDelta
+
+    cdef enum ShuffleMode:
+        NoShuffle
+        ByteShuffle
+        BitShuffle
+
+cdef extern from "../src/Record.hpp" namespace "gtar_pymodule::gtar" nogil:
     cdef enum Behavior:
         Constant
         Discrete
@@ -87,7 +127,7 @@ cdef extern from "../src/Record.hpp" namespace "gtar_pymodule::gtar":
         Resolution getResolution() const
         void setIndex(const string&)
 
-cdef extern from "../src/GTAR.hpp" namespace "gtar_pymodule::gtar":
+cdef extern from "../src/GTAR.hpp" namespace "gtar_pymodule::gtar" nogil:
     cdef cppclass GTAR:
         cppclass BulkWriter:
             BulkWriter(GTAR&)
@@ -95,19 +135,55 @@ cdef extern from "../src/GTAR.hpp" namespace "gtar_pymodule::gtar":
             void writeString(const string&, const string&, CompressMode) except +
             void writeBytes(const string&, const vector[char]&, CompressMode) except +
             void writePtr(const string&, const void*, const size_t, CompressMode) except +
+            void writeStrided(const string&, const void*, size_t, const vector[size_t]&,
+                              const vector[ptrdiff_t]&, CompressMode) except +
 
         GTAR(const string&, OpenMode) except +
+        GTAR(const string&, OpenMode, const string&) except +
 
         void close()
         void writeString(const string&, const string&, CompressMode) except +
         void writeBytes(const string&, const vector[char]&, CompressMode) except +
         void writePtr(const string&, const void*, const size_t, CompressMode) except +
+        void writeStrided(const string&, const void*, size_t, const vector[size_t]&,
+                          const vector[ptrdiff_t]&, CompressMode) except +
 
         # SharedArray[T] readIndividual[T](const string&)
         SharedArray[char] readBytes(const string&) except +
+        void readBytesInto(const string&, void*, size_t) except +
+        void readFrames(const Record&, const vector[string]&, void*, size_t) except +
+        void copyRecords(GTAR&, const vector[string]&, CompressMode) except +
+        void mergeArchives(const vector[string]&, CompressMode, unsigned int) except +
+
+        void setDelta(const string&, DeltaMode, unsigned int)
+        void setShuffle(const string&, ShuffleMode)
+        void setQuantization(const string&, double) except +
+        void setCodec(const string&, unsigned int, int) except +
+        void setVerifyChecksums(bool) except +
+        void setNumThreads(unsigned int) except +
+        void setMapFiles(bool) except +
+        void setCacheSize(size_t)
+        void setSharedCache(size_t, const string&) except +
+        string sharedCacheName() const
+        string exportIndex() except +
+        unsigned int refresh() except +
+
+        ArchiveStats stats() const
+        map[string, ArchiveStats] recordStats() const
+        void resetStats()
 
         vector[Record] getRecordTypes() const
         vector[string] queryFrames(const Record&) const
 
-cdef extern from "../src/ZipArchive.hpp" namespace "gtar_pymodule::gtar":
+cdef extern from "../src/Trace.hpp" namespace "gtar_pymodule::gtar" nogil:
+    void startTracing(const string&)
+    void stopTracing() except +
+    bool tracingEnabled()
+    void writeTrace() except +
+
+cdef extern from "../src/SharedCache.hpp" namespace "gtar_pymodule::gtar" nogil:
+    string defaultSharedCacheName(const string&) except +
+    void removeSharedCache(const string&) except +
+
+cdef extern from "../src/ZipArchive.hpp" namespace "gtar_pymodule::gtar" nogil:
      bool isZip64(const string&) except +
@@ -25,6 +25,11 @@
  **************************************************************************/
 
 #include  "miniz.h"
+/* libgetar: when built with MINIZ_USE_GTAR_CRC32 defined, CRC-32s
+   are computed by libgetar's hardware-accelerated version */
+#ifdef MINIZ_USE_GTAR_CRC32
+#include "../src/Crc32.hpp"
+#endif
 
 typedef unsigned char mz_validate_uint16[sizeof(mz_uint16) == 2 ? 1 : -1];
 typedef unsigned char mz_validate_uint32[sizeof(mz_uint32) == 4 ? 1 : -1];
@@ -84,6 +89,12 @@ mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
         }
         return ~crcu32;
     }
+#elif defined(MINIZ_USE_GTAR_CRC32)
+/* libgetar: uses carry-less multiplication where available */
+mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    return gtar::updateCrc32((mz_uint32)crc, (const char *)ptr, buf_len);
+}
 #else
 /* Faster, but larger CPU cache footprint.
  */
@@ -6159,6 +6170,8 @@ mz_bool mz_zip_writer_add_mem_ex_v2(mz_zip_archive *pZip, const char *pArchive_n
     if (!store_data_uncompressed || (level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA))
     {
         method = MZ_DEFLATED;
+        if ((level_and_flags & MZ_ZIP_FLAG_COMPRESSED_DATA) && pZip->m_compressed_data_method)
+            method = pZip->m_compressed_data_method;
     }
 
     if (pState->m_zip64)
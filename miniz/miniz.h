@@ -1063,6 +1063,10 @@ typedef struct
 
     mz_zip_internal_state *m_pState;
 
+    /* libgetar: method to record for files added with
+       MZ_ZIP_FLAG_COMPRESSED_DATA, or 0 for deflate */
+    mz_uint16 m_compressed_data_method;
+
 } mz_zip_archive;
 
 typedef struct
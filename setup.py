@@ -33,19 +33,38 @@ with open('gtar/version.py') as version_file:
 
 macros = []
 extra_args = []
-include_dirs = [numpy.get_include(), 'lz4', 'miniz', 'sqlite3']
+include_dirs = [numpy.get_include(), 'lz4', 'miniz', 'sqlite3', 'zstd']
+
+libraries = []
+
+# large zip entries are compressed on multiple threads
+if sys.platform != 'win32':
+    extra_args.append('-pthread')
+
+# shared caches use shm_open, which is in librt on older systems
+if sys.platform.startswith('linux'):
+    libraries.append('rt')
 sources = [
     'src/Archive.cpp',
+    'src/Codec.cpp',
+    'src/Crc32.cpp',
+    'src/Deflate.cpp',
     'src/DirArchive.cpp',
+    'src/Filter.cpp',
     'src/GTAR.cpp',
+    'src/MappedFile.cpp',
+    'src/RecordCache.cpp',
+    'src/SharedCache.cpp',
     'src/Record.cpp',
     'src/SqliteArchive.cpp',
     'src/TarArchive.cpp',
+    'src/Trace.cpp',
     'src/ZipArchive.cpp',
     'lz4/lz4.c',
     'lz4/lz4hc.c',
     'miniz/miniz.cpp',
     'sqlite3/sqlite3.c',
+    'zstd/zstd.c',
 ]
 
 # prefix module to avoid collisions with builtin versions of libgetar
@@ -54,6 +73,9 @@ macros.append(('GTAR_NAMESPACE_PARENT', 'gtar_pymodule'))
 # set max length manually
 macros.append(('SQLITE_MAX_LENGTH', '1000000000'))
 
+# have miniz compute its CRC-32s with src/Crc32.cpp
+macros.append(('MINIZ_USE_GTAR_CRC32', None))
+
 if '--disable-read-check' in sys.argv:
     macros.append(('MINIZ_DISABLE_ZIP_READER_CRC32_CHECKS', None))
     sys.argv.remove('--disable-read-check')
@@ -74,6 +96,7 @@ if '--cython' in sys.argv:
             r.extra_compile_args.extend(extra_args)
             r.extra_link_args.extend(extra_args)
             r.sources.extend(sources)
+            r.libraries.extend(libraries)
 
         return result
 
@@ -82,7 +105,8 @@ else:
     sources.append('gtar/_gtar.cpp')
     modules = [Extension('gtar._gtar', sources=sources,
                          define_macros=macros, extra_compile_args=extra_args,
-                         extra_link_args=extra_args, include_dirs=include_dirs)]
+                         extra_link_args=extra_args, include_dirs=include_dirs,
+                         libraries=libraries)]
 
 setup(name='gtar',
       version=__version__,
@@ -1,7 +1,12 @@
 // Archive.cpp
 // by Matthew Spellings <mspells@umich.edu>
 
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
 #include "Archive.hpp"
+#include "Codec.hpp"
 
 #ifdef GTAR_NAMESPACE_PARENT
 namespace GTAR_NAMESPACE_PARENT{
@@ -9,9 +14,93 @@ namespace GTAR_NAMESPACE_PARENT{
 
 namespace gtar{
 
+    using std::runtime_error;
     using std::string;
+    using std::stringstream;
     using std::vector;
 
+    ArchiveStats &ArchiveStats::operator+=(const ArchiveStats &other)
+    {
+        bytesRead += other.bytesRead;
+        bytesWritten += other.bytesWritten;
+        uncompressedBytesRead += other.uncompressedBytesRead;
+        uncompressedBytesWritten += other.uncompressedBytesWritten;
+        reads += other.reads;
+        writes += other.writes;
+        seeks += other.seeks;
+        transactions += other.transactions;
+        cacheHits += other.cacheHits;
+        cacheMisses += other.cacheMisses;
+        sharedCacheHits += other.sharedCacheHits;
+        sharedCacheMisses += other.sharedCacheMisses;
+        compressTime += other.compressTime;
+        decompressTime += other.decompressTime;
+        ioTime += other.ioTime;
+        indexTime += other.indexTime;
+        return *this;
+    }
+
+    ArchiveStats &ArchiveStats::operator-=(const ArchiveStats &other)
+    {
+        bytesRead -= other.bytesRead;
+        bytesWritten -= other.bytesWritten;
+        uncompressedBytesRead -= other.uncompressedBytesRead;
+        uncompressedBytesWritten -= other.uncompressedBytesWritten;
+        reads -= other.reads;
+        writes -= other.writes;
+        seeks -= other.seeks;
+        transactions -= other.transactions;
+        cacheHits -= other.cacheHits;
+        cacheMisses -= other.cacheMisses;
+        sharedCacheHits -= other.sharedCacheHits;
+        sharedCacheMisses -= other.sharedCacheMisses;
+        compressTime -= other.compressTime;
+        decompressTime -= other.decompressTime;
+        ioTime -= other.ioTime;
+        indexTime -= other.indexTime;
+        return *this;
+    }
+
+    SharedArray<char> decodeRaw(const RawRecord &raw)
+    {
+        if(raw.codec == NoCodec && raw.pieces.size() == 1)
+            return raw.pieces[0];
+
+        SharedArray<char> result(new char[raw.byteLength], raw.byteLength);
+        size_t totalBytes(0);
+
+        for(size_t i(0); i < raw.pieces.size(); ++i)
+        {
+            SharedArray<char> piece(raw.pieces[i]);
+
+            if(raw.codec == NoCodec && totalBytes + piece.size() <= raw.byteLength)
+            {
+                memcpy(result.get() + totalBytes, piece.get(), piece.size());
+                totalBytes += piece.size();
+            }
+            else if(raw.codec != NoCodec)
+                totalBytes += getCodec(raw.codec).decompressBytes(
+                    piece.get(), piece.size(), result.get() + totalBytes,
+                    raw.byteLength - totalBytes);
+            else
+                break;
+        }
+
+        if(totalBytes != raw.byteLength)
+        {
+            stringstream message;
+            message << "Raw record decoded to " << totalBytes << " bytes, expected "
+                    << raw.byteLength;
+            throw runtime_error(message.str());
+        }
+
+        return result;
+    }
+
+    Archive::Archive():
+        m_stats(), m_mapFiles(false)
+    {}
+
     Archive::~Archive() {}
 
     void Archive::writeVec(const string &path, const vector<char> &contents,
@@ -19,6 +108,108 @@ namespace gtar{
     {
         writePtr(path, (void*) &contents[0], contents.size(), mode, immediate);
     }
+
+    bool Archive::storesCodec(unsigned int codec) const
+    {
+        return codec == NoCodec;
+    }
+
+    void Archive::writeCodec(const string &path, const void *contents,
+                             const size_t byteLength, unsigned int codec,
+                             int /*level*/, bool immediate)
+    {
+        if(codec != NoCodec)
+        {
+            stringstream message;
+            message << "Can't store records compressed with " << getCodec(codec).name()
+                    << " in this archive";
+            throw runtime_error(message.str());
+        }
+
+        writePtr(path, contents, byteLength, NoCompress, immediate);
+    }
+
+    RawRecord Archive::readRaw(const string &path)
+    {
+        RawRecord result;
+        result.pieces.push_back(read(path));
+        result.byteLength = result.pieces.back().size();
+        return result;
+    }
+
+    bool Archive::writeRaw(const string& /*path*/, const RawRecord& /*raw*/,
+                           bool /*immediate*/)
+    {
+        return false;
+    }
+
+    FileInfo Archive::getFileInfo(const string &path)
+    {
+        FileInfo result;
+        result.byteLength = result.storedLength = read(path).size();
+        return result;
+    }
+
+    bool Archive::storesRaw(const RawRecord& /*raw*/) const
+    {
+        return false;
+    }
+
+    RawRecord Archive::encodeRaw(const SharedArray<char> &contents,
+                                 CompressMode /*mode*/) const
+    {
+        RawRecord result;
+        result.pieces.push_back(contents);
+        result.byteLength = contents.size();
+        return result;
+    }
+
+    uint64_t modificationTime(const struct stat &fileStat)
+    {
+        uint64_t result((uint64_t) fileStat.st_mtime*1000000000ULL);
+#if defined(__APPLE__)
+        result += fileStat.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+        result += fileStat.st_mtim.tv_nsec;
+#endif
+        return result;
+    }
+
+    ArchiveIndex Archive::getIndex()
+    {
+        ArchiveIndex result;
+        const unsigned int count(size());
+        for(unsigned int i(0); i < count; ++i)
+            result.names.push_back(getItemName(i));
+        return result;
+    }
+
+    void Archive::refresh()
+    {
+    }
+
+    vector<string> Archive::rewrittenFiles() const
+    {
+        return vector<string>();
+    }
+
+    void Archive::setVerifyChecksums(bool /*verify*/)
+    {
+    }
+
+    void Archive::setNumThreads(unsigned int /*numThreads*/)
+    {
+    }
+
+    void Archive::setMapFiles(bool mapFiles)
+    {
+        m_mapFiles = mapFiles;
+    }
+
+    ArchiveStats &Archive::stats()
+    {
+        return m_stats;
+    }
 }
 
 #ifdef GTAR_NAMESPACE_PARENT
@@ -2,11 +2,14 @@
 // by Matthew Spellings <mspells@umich.edu>
 
 #include <memory>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <vector>
 #include <string>
 #include <utility>
 
 #include "SharedArray.hpp"
+#include "Trace.hpp"
 
 #ifndef __ARCHIVE_HPP_
 #define __ARCHIVE_HPP_
@@ -23,11 +26,155 @@ namespace gtar{
     // Varying degrees to which files can be compressed
     enum CompressMode {NoCompress, FastCompress, MediumCompress, SlowCompress};
 
+    // The contents of a file as an archive stores them, before
+    // decompression, as read by Archive::readRaw()
+    struct RawRecord
+    {
+        RawRecord():
+            pieces(), codec(0), byteLength(0), crc(0), hasCrc(false)
+        {}
+
+        // Compressed pieces, each decompressed separately and
+        // concatenated (or a single uncompressed piece)
+        std::vector<SharedArray<char> > pieces;
+        // Codec the pieces are compressed with (see Codec.hpp), 0 if
+        // they are not compressed
+        unsigned int codec;
+        // Size of the contents after decompression
+        uint64_t byteLength;
+        // CRC-32 of the decompressed contents, if hasCrc
+        uint32_t crc;
+        bool hasCrc;
+    };
+
+    // Sizes and compression of a file stored in an archive
+    struct FileInfo
+    {
+        FileInfo():
+            storedLength(0), byteLength(0), codec(0), version(0)
+        {}
+
+        // Number of bytes the contents take up in the archive
+        uint64_t storedLength;
+        // Number of bytes in the file after decompression
+        uint64_t byteLength;
+        // Codec the archive compresses the file with (see Codec.hpp),
+        // 0 if it is not compressed
+        unsigned int codec;
+        // Number which changes when the file is rewritten (such as
+        // where it is stored in the archive), or 0 if unknown
+        uint64_t version;
+    };
+
+    // Table of the files of an archive found when it was opened, as
+    // saved by GTAR::exportIndex(), which some formats can be given
+    // to open the same file again without finding them
+    struct ArchiveIndex
+    {
+        ArchiveIndex():
+            names(), offsets(), lengths()
+        {}
+
+        // Names of the files, in the order they were stored
+        std::vector<std::string> names;
+        // Position of the contents of each file within the
+        // underlying file and the number of bytes they take up
+        // there, for formats which need them (otherwise empty)
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> lengths;
+    };
+
+    // Counters of the work done by an archive, as reported by
+    // GTAR::stats()
+    struct ArchiveStats
+    {
+        ArchiveStats():
+            bytesRead(0), bytesWritten(0), uncompressedBytesRead(0),
+            uncompressedBytesWritten(0), reads(0), writes(0), seeks(0),
+            transactions(0), cacheHits(0), cacheMisses(0), sharedCacheHits(0),
+            sharedCacheMisses(0), compressTime(0), decompressTime(0), ioTime(0),
+            indexTime(0)
+        {}
+
+        ArchiveStats &operator+=(const ArchiveStats &other);
+        ArchiveStats &operator-=(const ArchiveStats &other);
+
+        // Number of bytes of file contents read from and written to
+        // the archive as it stores them
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+        // Number of bytes of those files after decompression (and
+        // before compression)
+        uint64_t uncompressedBytesRead;
+        uint64_t uncompressedBytesWritten;
+        // Number of files read and written
+        uint64_t reads;
+        uint64_t writes;
+        // Number of times the position in the underlying file was
+        // moved to read or write somewhere else
+        uint64_t seeks;
+        // Number of database transactions committed
+        uint64_t transactions;
+        // Number of reads served from and missing the cache of
+        // decoded records (see GTAR::setCacheSize())
+        uint64_t cacheHits;
+        uint64_t cacheMisses;
+        // Number of reads served from and missing the cache shared
+        // with other processes (see GTAR::setSharedCache())
+        uint64_t sharedCacheHits;
+        uint64_t sharedCacheMisses;
+        // Seconds spent compressing and decompressing (including
+        // filters and checksums), in system calls and the storage
+        // library, and finding the files in the archive when opening
+        // it
+        double compressTime;
+        double decompressTime;
+        double ioTime;
+        double indexTime;
+    };
+
+    // Adds the number of seconds it exists for to a counter, and
+    // records it as a span with the given name and detail (see
+    // recordSpan()) if tracing is enabled
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(double &target, const char *name=NULL,
+                    const std::string *detail=NULL):
+            m_target(target), m_name(name), m_detail(detail),
+            m_start(monotonicSeconds())
+        {}
+
+        ~ScopedTimer()
+        {
+            const double end(monotonicSeconds());
+            m_target += end - m_start;
+
+            if(m_name && tracingEnabled())
+                recordSpan(m_name, m_detail, m_start, end);
+        }
+
+    private:
+        double &m_target;
+        const char *m_name;
+        const std::string *m_detail;
+        const double m_start;
+    };
+
+    // Decompress the contents of a raw record
+    SharedArray<char> decodeRaw(const RawRecord &raw);
+
+    // Modification time of a file in nanoseconds, where the system
+    // reports it that precisely, so that a file rewritten within a
+    // second of being examined is still noticed
+    uint64_t modificationTime(const struct stat &fileStat);
+
     // Archive abstraction layer. Pure virtual interface for archive
     // (i.e., a handle to a file) functionality
     class Archive
     {
     public:
+        Archive();
         // Destructor: Clean up memory used
         virtual ~Archive() = 0;
 
@@ -45,16 +192,97 @@ namespace gtar{
                               const size_t byteLength, CompressMode mode,
                               bool immediate=false) = 0;
 
+        // Returns true if this archive can store records compressed
+        // with the codec of the given id (see Codec.hpp) by itself
+        virtual bool storesCodec(unsigned int codec) const;
+
+        // Write the contents of a pointer to the given path within
+        // the archive, compressed with the given codec and
+        // level. Only valid for codecs for which storesCodec() is
+        // true.
+        virtual void writeCodec(const std::string &path, const void *contents,
+                                const size_t byteLength, unsigned int codec,
+                                int level, bool immediate=false);
+
+        // Enable or disable verification of the checksums some
+        // formats store with each file when it is read. Does nothing
+        // for formats without checksums.
+        virtual void setVerifyChecksums(bool verify);
+
+        // Set the number of threads some formats may use to compress
+        // large files, or 0 to use one per processor
+        virtual void setNumThreads(unsigned int numThreads);
+
         virtual void beginBulkWrites() = 0;
         virtual void endBulkWrites() = 0;
 
         // Read the contents of the given location within the archive
         virtual SharedArray<char> read(const std::string &path) = 0;
 
+        // Read the contents of the given location as they are stored,
+        // without decompressing them. By default, reads them with
+        // read() as a single uncompressed piece.
+        virtual RawRecord readRaw(const std::string &path);
+
+        // Write the contents of a record read by readRaw() (from any
+        // kind of archive) to the given path without recompressing
+        // it. Returns false, writing nothing, if this archive can't
+        // store the raw record as it is (see storesRaw()).
+        virtual bool writeRaw(const std::string &path, const RawRecord &raw,
+                              bool immediate=false);
+
+        // Returns true if writeRaw() can store the given compressed
+        // raw record as it is, which is never the case by default
+        virtual bool storesRaw(const RawRecord &raw) const;
+
+        // Compress contents into a raw record which writeRaw() can
+        // store, as writePtr() would with the given mode. This may be
+        // called from several threads at once. By default, returns
+        // the contents as a single uncompressed piece.
+        virtual RawRecord encodeRaw(const SharedArray<char> &contents,
+                                    CompressMode mode) const;
+
+        // Return the sizes and compression of the file at the given
+        // location without reading it, if possible. By default, reads
+        // it and reports it as uncompressed.
+        virtual FileInfo getFileInfo(const std::string &path);
+
         // Return the number of files stored in the archive
         virtual unsigned int size() = 0;
         // Return the name of the file with the given numerical index
         virtual std::string getItemName(unsigned int index) = 0;
+
+        // Return the table of files in the archive which the formats
+        // that accept one can be opened with instead of finding
+        // them. By default, holds only the names of the files.
+        virtual ArchiveIndex getIndex();
+
+        // Find the files added to the archive (by another process
+        // writing to it) since it was opened or last refreshed,
+        // appending them to the files listed by size() and
+        // getItemName(). Only archives opened for reading can be
+        // refreshed; files which are still being written are found
+        // by a later refresh. By default, finds nothing.
+        virtual void refresh();
+        // Return the paths of files listed before the last refresh()
+        // which it found had been rewritten, for backends which
+        // don't list them again. By default, returns none.
+        virtual std::vector<std::string> rewrittenFiles() const;
+
+        // Counters of the work done by this archive since it was
+        // opened, which each backend updates as it works
+        ArchiveStats &stats();
+
+        // Set whether backends which can may map large files of
+        // archives opened for reading into memory instead of reading
+        // them. Off by default, since the mapped records change (or
+        // crash their readers) if the file is rewritten.
+        void setMapFiles(bool mapFiles);
+
+    protected:
+        ArchiveStats m_stats;
+        // Whether to map large files rather than reading them
+        bool m_mapFiles;
     };
 
 }
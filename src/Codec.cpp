@@ -0,0 +1,537 @@
+// Codec.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "lz4.h"
+#include "lz4hc.h"
+#include "miniz.h"
+#include "zstd.h"
+#include "Codec.hpp"
+#include "Deflate.hpp"
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::map;
+    using std::max;
+    using std::min;
+    using std::runtime_error;
+    using std::string;
+    using std::stringstream;
+
+    // LZ4 can only refer back 64kB, so frames compressed against a
+    // dictionary are split into blocks which each use the same
+    // range of the dictionary
+    static const size_t LZ4_DICT_BLOCK_SIZE = 32*1024;
+
+    Codec::~Codec()
+    {}
+
+    bool Codec::usesDictionary() const
+    {
+        return false;
+    }
+
+    size_t Codec::compressWithDictionary(const char *source, size_t byteLength,
+                                         char *target, size_t targetLength, int level,
+                                         const char* /*dictionary*/, size_t /*dictionaryLength*/) const
+    {
+        return compressBytes(source, byteLength, target, targetLength, level);
+    }
+
+    size_t Codec::decompressWithDictionary(const char *source, size_t byteLength,
+                                           char *target, size_t targetLength,
+                                           const char* /*dictionary*/, size_t /*dictionaryLength*/) const
+    {
+        return decompressBytes(source, byteLength, target, targetLength);
+    }
+
+    // Stores records as-is
+    class StoreCodec: public Codec
+    {
+    public:
+        virtual unsigned int id() const
+        {
+            return NoCodec;
+        }
+
+        virtual string name() const
+        {
+            return "none";
+        }
+
+        virtual int defaultLevel(CompressMode /*mode*/) const
+        {
+            return 0;
+        }
+
+        virtual size_t compressedBound(size_t byteLength) const
+        {
+            return byteLength;
+        }
+
+        virtual size_t compressBytes(const char *source, size_t byteLength,
+                                     char *target, size_t targetLength, int /*level*/) const
+        {
+            if(byteLength > targetLength)
+                throw runtime_error("Not enough room to store uncompressed data");
+
+            memcpy(target, source, byteLength);
+            return byteLength;
+        }
+
+        virtual size_t decompressBytes(const char *source, size_t byteLength,
+                                       char *target, size_t targetLength) const
+        {
+            return compressBytes(source, byteLength, target, targetLength, 0);
+        }
+    };
+
+    // LZ4 block format; levels above 0 use LZ4HC
+    class LZ4BlockCodec: public Codec
+    {
+    public:
+        virtual unsigned int id() const
+        {
+            return LZ4Codec;
+        }
+
+        virtual string name() const
+        {
+            return "lz4";
+        }
+
+        virtual int defaultLevel(CompressMode mode) const
+        {
+            return mode == SlowCompress? LZ4HC_CLEVEL_OPT_MIN: 0;
+        }
+
+        virtual size_t compressedBound(size_t byteLength) const
+        {
+            // leave room for the block sizes of compressWithDictionary()
+            return byteLength > LZ4_MAX_INPUT_SIZE? 0: LZ4_compressBound(byteLength) +
+                4*(byteLength/LZ4_DICT_BLOCK_SIZE + 1);
+        }
+
+        virtual size_t compressBytes(const char *source, size_t byteLength,
+                                     char *target, size_t targetLength, int level) const
+        {
+            if(byteLength > LZ4_MAX_INPUT_SIZE)
+            {
+                stringstream message;
+                message << "Can't compress " << byteLength << " bytes at once with LZ4";
+                throw runtime_error(message.str());
+            }
+
+            const int maxSize(targetLength > (size_t) LZ4_compressBound(byteLength)?
+                              LZ4_compressBound(byteLength): targetLength);
+            const int result(level > 0?
+                             LZ4_compress_HC(source, target, byteLength, maxSize, level):
+                             LZ4_compress_default(source, target, byteLength, maxSize));
+
+            if(result <= 0 && byteLength)
+                throw runtime_error("LZ4 compression error");
+
+            return result;
+        }
+
+        virtual size_t decompressBytes(const char *source, size_t byteLength,
+                                       char *target, size_t targetLength) const
+        {
+            const int maxSize(targetLength > LZ4_MAX_INPUT_SIZE? LZ4_MAX_INPUT_SIZE: targetLength);
+            const int result(LZ4_decompress_safe(source, target, byteLength, maxSize));
+
+            if(result < 0)
+                throw runtime_error("LZ4 decompression error");
+
+            return result;
+        }
+
+        virtual bool usesDictionary() const
+        {
+            return true;
+        }
+
+        // Each block is stored as a 32-bit little-endian compressed
+        // size followed by the compressed data
+        virtual size_t compressWithDictionary(const char *source, size_t byteLength,
+                                              char *target, size_t targetLength, int level,
+                                              const char *dictionary, size_t dictionaryLength) const
+        {
+            LZ4_stream_t *stream(level > 0? NULL: LZ4_createStream());
+            LZ4_streamHC_t *streamHC(level > 0? LZ4_createStreamHC(): NULL);
+            size_t result(0);
+
+            for(size_t offset(0); offset < byteLength; offset += LZ4_DICT_BLOCK_SIZE)
+            {
+                const int blockLength(min(LZ4_DICT_BLOCK_SIZE, byteLength - offset));
+                const int dictLength(offset < dictionaryLength?
+                                     min(LZ4_DICT_BLOCK_SIZE, dictionaryLength - offset): 0);
+                const int room(targetLength > result + 4? min(
+                                   targetLength - result - 4, (size_t) LZ4_MAX_INPUT_SIZE): 0);
+                int written(0);
+
+                if(streamHC)
+                {
+                    // the optimal parser of these LZ4 sources reads
+                    // past the end of a loaded dictionary, so
+                    // dictionary compression stays below its levels
+                    LZ4_resetStreamHC(streamHC, min(level, LZ4HC_CLEVEL_OPT_MIN - 1));
+                    LZ4_loadDictHC(streamHC, dictionary + offset, dictLength);
+                    written = LZ4_compress_HC_continue(streamHC, source + offset,
+                                                       target + result + 4, blockLength, room);
+                }
+                else
+                {
+                    LZ4_loadDict(stream, dictionary + offset, dictLength);
+                    written = LZ4_compress_fast_continue(stream, source + offset,
+                                                         target + result + 4, blockLength,
+                                                         room, 1);
+                }
+
+                if(written <= 0)
+                {
+                    LZ4_freeStream(stream);
+                    LZ4_freeStreamHC(streamHC);
+                    throw runtime_error("LZ4 compression error");
+                }
+
+                for(size_t i(0); i < 4; ++i)
+                    target[result + i] = (written >> (8*i)) & 0xFF;
+                result += 4 + written;
+            }
+
+            LZ4_freeStream(stream);
+            LZ4_freeStreamHC(streamHC);
+
+            return result;
+        }
+
+        virtual size_t decompressWithDictionary(const char *source, size_t byteLength,
+                                                char *target, size_t targetLength,
+                                                const char *dictionary, size_t dictionaryLength) const
+        {
+            size_t result(0);
+
+            for(size_t position(0); position < byteLength;)
+            {
+                if(position + 4 > byteLength)
+                    throw runtime_error("LZ4 decompression error: truncated block");
+
+                const unsigned char *sizeBytes((const unsigned char*) source + position);
+                const size_t blockSize(sizeBytes[0] | (sizeBytes[1] << 8) |
+                                       (sizeBytes[2] << 16) | ((size_t) sizeBytes[3] << 24));
+                position += 4;
+
+                const int dictLength(result < dictionaryLength?
+                                     min(LZ4_DICT_BLOCK_SIZE, dictionaryLength - result): 0);
+                const int room(min(LZ4_DICT_BLOCK_SIZE, targetLength - result));
+
+                if(blockSize > byteLength - position)
+                    throw runtime_error("LZ4 decompression error: truncated block");
+
+                const int written(LZ4_decompress_safe_usingDict(
+                                      source + position, target + result, blockSize, room,
+                                      dictionary + result, dictLength));
+
+                if(written < 0)
+                    throw runtime_error("LZ4 decompression error");
+
+                position += blockSize;
+                result += written;
+            }
+
+            return result;
+        }
+    };
+
+    // Raw deflate streams (as stored in zip files). The fastest level
+    // uses our own single-pass encoder, other levels miniz; all
+    // streams are decoded by fastInflate().
+    class DeflateRawCodec: public Codec
+    {
+    public:
+        virtual unsigned int id() const
+        {
+            return DeflateCodec;
+        }
+
+        virtual string name() const
+        {
+            return "deflate";
+        }
+
+        virtual int defaultLevel(CompressMode mode) const
+        {
+            switch(mode)
+            {
+            case FastCompress:
+                return MZ_BEST_SPEED;
+            case MediumCompress:
+                return MZ_DEFAULT_LEVEL;
+            case SlowCompress:
+                return MZ_BEST_COMPRESSION;
+            case NoCompress:
+            default:
+                return MZ_NO_COMPRESSION;
+            }
+        }
+
+        virtual size_t compressedBound(size_t byteLength) const
+        {
+            return max((size_t) mz_compressBound(byteLength), fastDeflateBound(byteLength));
+        }
+
+        virtual size_t compressBytes(const char *source, size_t byteLength,
+                                     char *target, size_t targetLength, int level) const
+        {
+            if(level == MZ_BEST_SPEED)
+                return fastDeflate(source, byteLength, target, targetLength);
+
+            const int flags(tdefl_create_comp_flags_from_zip_params(
+                                level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY));
+            const size_t result(tdefl_compress_mem_to_mem(target, targetLength,
+                                                          source, byteLength, flags));
+
+            if(!result)
+                throw runtime_error("Deflate compression error");
+
+            return result;
+        }
+
+        virtual size_t decompressBytes(const char *source, size_t byteLength,
+                                       char *target, size_t targetLength) const
+        {
+            return fastInflate(source, byteLength, target, targetLength);
+        }
+    };
+
+    // Zstandard frames. The long-distance variant also looks for
+    // matches far back in large records, which are decompressed the
+    // same way.
+    class ZstdFrameCodec: public Codec
+    {
+    public:
+        ZstdFrameCodec(bool longDistance):
+            m_longDistance(longDistance)
+        {}
+
+        virtual unsigned int id() const
+        {
+            return m_longDistance? ZstdLongCodec: ZstdCodec;
+        }
+
+        virtual string name() const
+        {
+            return m_longDistance? "zstd-long": "zstd";
+        }
+
+        virtual int defaultLevel(CompressMode mode) const
+        {
+            switch(mode)
+            {
+            case MediumCompress:
+                return ZSTD_CLEVEL_DEFAULT;
+            case SlowCompress:
+                return 19;
+            case FastCompress:
+            case NoCompress:
+            default:
+                return 1;
+            }
+        }
+
+        virtual size_t compressedBound(size_t byteLength) const
+        {
+            return ZSTD_compressBound(byteLength);
+        }
+
+        virtual size_t compressBytes(const char *source, size_t byteLength,
+                                     char *target, size_t targetLength, int level) const
+        {
+            return finishCompression(createContext(level), source, byteLength,
+                                     target, targetLength);
+        }
+
+
+        virtual size_t decompressBytes(const char *source, size_t byteLength,
+                                       char *target, size_t targetLength) const
+        {
+            const size_t result(ZSTD_decompress(target, targetLength, source, byteLength));
+
+            if(ZSTD_isError(result))
+            {
+                stringstream message;
+                message << "Zstandard decompression error: " << ZSTD_getErrorName(result);
+                throw runtime_error(message.str());
+            }
+
+            return result;
+        }
+
+        virtual bool usesDictionary() const
+        {
+            return true;
+        }
+
+        virtual size_t compressWithDictionary(const char *source, size_t byteLength,
+                                              char *target, size_t targetLength, int level,
+                                              const char *dictionary, size_t dictionaryLength) const
+        {
+            ZSTD_CCtx *context(createContext(level));
+
+            // the window has to reach back from each part of the frame
+            // to the same part of the dictionary
+            unsigned int windowLog(10);
+            while(windowLog < 27 && ((size_t) 1 << windowLog) < dictionaryLength + byteLength)
+                ++windowLog;
+            if(!m_longDistance)
+                ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, windowLog);
+
+            ZSTD_CCtx_refPrefix(context, dictionary, dictionaryLength);
+
+            return finishCompression(context, source, byteLength, target, targetLength);
+        }
+
+        virtual size_t decompressWithDictionary(const char *source, size_t byteLength,
+                                                char *target, size_t targetLength,
+                                                const char *dictionary, size_t dictionaryLength) const
+        {
+            ZSTD_DCtx *context(ZSTD_createDCtx());
+
+            if(!context)
+                throw runtime_error("Can't allocate a Zstandard decompression context");
+
+            ZSTD_DCtx_refPrefix(context, dictionary, dictionaryLength);
+            const size_t result(ZSTD_decompressDCtx(context, target, targetLength,
+                                                    source, byteLength));
+            ZSTD_freeDCtx(context);
+
+            if(ZSTD_isError(result))
+            {
+                stringstream message;
+                message << "Zstandard decompression error: " << ZSTD_getErrorName(result);
+                throw runtime_error(message.str());
+            }
+
+            return result;
+        }
+
+    private:
+        // Create a compression context with the parameters for the
+        // given level
+        ZSTD_CCtx *createContext(int level) const
+        {
+            ZSTD_CCtx *context(ZSTD_createCCtx());
+
+            if(!context)
+                throw runtime_error("Can't allocate a Zstandard compression context");
+
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+
+            if(m_longDistance)
+            {
+                ZSTD_CCtx_setParameter(context, ZSTD_c_enableLongDistanceMatching, 1);
+                // the largest window decoders accept without being
+                // told to expect more
+                ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, 27);
+            }
+
+            return context;
+        }
+
+        // Compress with the given context, then free it
+        size_t finishCompression(ZSTD_CCtx *context, const char *source, size_t byteLength,
+                                 char *target, size_t targetLength) const
+        {
+            const size_t result(ZSTD_compress2(context, target, targetLength,
+                                               source, byteLength));
+            ZSTD_freeCCtx(context);
+
+            if(ZSTD_isError(result))
+            {
+                stringstream message;
+                message << "Zstandard compression error: " << ZSTD_getErrorName(result);
+                throw runtime_error(message.str());
+            }
+
+            return result;
+        }
+
+        // True if long-distance matching should be used
+        bool m_longDistance;
+    };
+
+    // Registered codecs by id, starting with the built-in ones
+    static map<unsigned int, const Codec*> makeRegistry()
+    {
+        static StoreCodec store;
+        static LZ4BlockCodec lz4;
+        static DeflateRawCodec deflate;
+        static ZstdFrameCodec zstd(false);
+        static ZstdFrameCodec zstdLong(true);
+        map<unsigned int, const Codec*> registry;
+
+        registry[store.id()] = &store;
+        registry[lz4.id()] = &lz4;
+        registry[deflate.id()] = &deflate;
+        registry[zstd.id()] = &zstd;
+        registry[zstdLong.id()] = &zstdLong;
+
+        return registry;
+    }
+
+    static map<unsigned int, const Codec*> &codecRegistry()
+    {
+        // built entirely by the initializer so that concurrent
+        // lookups never see a partially filled registry
+        static map<unsigned int, const Codec*> registry(makeRegistry());
+
+        return registry;
+    }
+
+    const Codec &getCodec(unsigned int id)
+    {
+        const map<unsigned int, const Codec*> &registry(codecRegistry());
+        map<unsigned int, const Codec*>::const_iterator iter(registry.find(id));
+
+        if(iter == registry.end())
+        {
+            stringstream message;
+            message << "Unknown codec " << id;
+            throw runtime_error(message.str());
+        }
+
+        return *iter->second;
+    }
+
+    const Codec *findCodec(const string &name)
+    {
+        const map<unsigned int, const Codec*> &registry(codecRegistry());
+
+        for(map<unsigned int, const Codec*>::const_iterator iter(registry.begin());
+            iter != registry.end(); ++iter)
+            if(iter->second->name() == name)
+                return iter->second;
+
+        return NULL;
+    }
+
+    void registerCodec(const Codec *codec)
+    {
+        codecRegistry()[codec->id()] = codec;
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
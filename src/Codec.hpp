@@ -0,0 +1,94 @@
+// Codec.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <string>
+
+#include "Archive.hpp"
+
+#ifndef __CODEC_HPP_
+#define __CODEC_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Identifiers of the built-in codecs. These are stored with
+    /// records (for example, in the compress_level column of sqlite
+    /// archives), so existing values must never change.
+    enum CodecId {NoCodec = 0, LZ4Codec = 1, DeflateCodec = 2,
+                  ZstdCodec = 3, ZstdLongCodec = 4};
+
+    /// Interface for compression methods which can be used by any
+    /// archive backend. Codecs are stateless; the same object may be
+    /// used for any number of records.
+    class Codec
+    {
+    public:
+        virtual ~Codec();
+
+        /// Identifier of this codec, stored along with the records it
+        /// compresses
+        virtual unsigned int id() const = 0;
+        /// Short human-readable name of this codec
+        virtual std::string name() const = 0;
+
+        /// Compression level to use for the given CompressMode
+        virtual int defaultLevel(CompressMode mode) const = 0;
+
+        /// Maximum number of bytes compressBytes() or
+        /// compressWithDictionary() may produce for byteLength bytes
+        /// of input
+        virtual size_t compressedBound(size_t byteLength) const = 0;
+        /// Compress byteLength bytes of source into target, which has
+        /// room for targetLength bytes, returning the number of bytes
+        /// written. Throws if target is too small.
+        virtual size_t compressBytes(const char *source, size_t byteLength,
+                                     char *target, size_t targetLength,
+                                     int level) const = 0;
+        /// Decompress byteLength bytes of source into target, which
+        /// has room for targetLength bytes, returning the number of
+        /// bytes written. Throws on corrupt input.
+        virtual size_t decompressBytes(const char *source, size_t byteLength,
+                                       char *target, size_t targetLength) const = 0;
+
+        /// Returns true if compressWithDictionary() makes use of its
+        /// dictionary
+        virtual bool usesDictionary() const;
+        /// Like compressBytes(), but compress relative to a
+        /// dictionary of similar data (such as the previous frame of
+        /// the same record), which must be given to
+        /// decompressWithDictionary() as well. By default, the
+        /// dictionary is ignored.
+        virtual size_t compressWithDictionary(const char *source, size_t byteLength,
+                                              char *target, size_t targetLength, int level,
+                                              const char *dictionary,
+                                              size_t dictionaryLength) const;
+        /// Undo compressWithDictionary(), given the same dictionary
+        virtual size_t decompressWithDictionary(const char *source, size_t byteLength,
+                                                char *target, size_t targetLength,
+                                                const char *dictionary,
+                                                size_t dictionaryLength) const;
+    };
+
+    /// Return the codec with the given id, throwing if no such codec
+    /// has been registered
+    const Codec &getCodec(unsigned int id);
+    /// Return the codec with the given name, or NULL if no such codec
+    /// has been registered
+    const Codec *findCodec(const std::string &name);
+    /// Make an additional codec available to all archives. The codec
+    /// must outlive every archive which uses it; registering a codec
+    /// with the id of an existing codec replaces it. Registration
+    /// is not synchronized with lookups, so codecs should be
+    /// registered before archives are used from multiple threads.
+    void registerCodec(const Codec *codec);
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+// Crc32.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include "Crc32.hpp"
+
+// The carry-less multiplication version is compiled for its own
+// target and only called if the CPU supports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GTAR_USE_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    // Tables for computing the reflected CRC-32 (polynomial
+    // 0xEDB88320) eight bytes at a time
+    class Crc32Tables
+    {
+    public:
+        Crc32Tables()
+        {
+            for(uint32_t i(0); i < 256; ++i)
+            {
+                uint32_t crc(i);
+                for(unsigned int bit(0); bit < 8; ++bit)
+                    crc = (crc >> 1) ^ (0xEDB88320u & (0 - (crc & 1)));
+                m_tables[0][i] = crc;
+            }
+
+            for(unsigned int k(1); k < 8; ++k)
+                for(unsigned int i(0); i < 256; ++i)
+                    m_tables[k][i] = (m_tables[k - 1][i] >> 8) ^
+                        m_tables[0][m_tables[k - 1][i] & 0xFF];
+        }
+
+        uint32_t m_tables[8][256];
+    };
+
+    static const Crc32Tables &crc32Tables()
+    {
+        static const Crc32Tables tables;
+        return tables;
+    }
+
+    // Slicing-by-8 software CRC of the (uninverted) crc state
+    static uint32_t crc32Software(uint32_t crc, const unsigned char *bytes, size_t byteLength)
+    {
+        const uint32_t (*tables)[256](crc32Tables().m_tables);
+
+        for(; byteLength >= 8; byteLength -= 8, bytes += 8)
+        {
+            crc ^= (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) |
+                ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+            const uint32_t high((uint32_t) bytes[4] | ((uint32_t) bytes[5] << 8) |
+                                ((uint32_t) bytes[6] << 16) | ((uint32_t) bytes[7] << 24));
+
+            crc = tables[7][crc & 0xFF] ^ tables[6][(crc >> 8) & 0xFF] ^
+                tables[5][(crc >> 16) & 0xFF] ^ tables[4][crc >> 24] ^
+                tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^
+                tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+        }
+
+        for(; byteLength; --byteLength, ++bytes)
+            crc = (crc >> 8) ^ tables[0][(crc ^ *bytes) & 0xFF];
+
+        return crc;
+    }
+
+#ifdef GTAR_USE_PCLMUL
+    // CRC of the (uninverted) crc state over a multiple of 16 bytes,
+    // at least 64, by folding with carry-less multiplication, as
+    // described in "Fast CRC Computation for Generic Polynomials
+    // Using PCLMULQDQ Instruction" (Gopal et al., Intel, 2009). The
+    // constants are those of the paper for the reflected polynomial.
+    __attribute__((target("pclmul,sse4.1")))
+    static uint32_t crc32Pclmul(uint32_t crc, const unsigned char *bytes, size_t byteLength)
+    {
+        const __m128i k1k2(_mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL));
+        const __m128i k3k4(_mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL));
+        const __m128i k5k0(_mm_set_epi64x(0, 0x0163cd6124LL));
+        const __m128i poly(_mm_set_epi64x(0x01f7011641LL, 0x01db710641LL));
+        const __m128i low32(_mm_setr_epi32(~0, 0, ~0, 0));
+
+        __m128i x1(_mm_loadu_si128((const __m128i*) (bytes + 0x00)));
+        __m128i x2(_mm_loadu_si128((const __m128i*) (bytes + 0x10)));
+        __m128i x3(_mm_loadu_si128((const __m128i*) (bytes + 0x20)));
+        __m128i x4(_mm_loadu_si128((const __m128i*) (bytes + 0x30)));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+        bytes += 64;
+        byteLength -= 64;
+
+        // fold four blocks in parallel
+        for(; byteLength >= 64; byteLength -= 64, bytes += 64)
+        {
+            const __m128i x5(_mm_clmulepi64_si128(x1, k1k2, 0x00));
+            const __m128i x6(_mm_clmulepi64_si128(x2, k1k2, 0x00));
+            const __m128i x7(_mm_clmulepi64_si128(x3, k1k2, 0x00));
+            const __m128i x8(_mm_clmulepi64_si128(x4, k1k2, 0x00));
+
+            x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                               _mm_loadu_si128((const __m128i*) (bytes + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                               _mm_loadu_si128((const __m128i*) (bytes + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                               _mm_loadu_si128((const __m128i*) (bytes + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                               _mm_loadu_si128((const __m128i*) (bytes + 0x30)));
+        }
+
+        // fold the four blocks into one, then any remaining blocks
+        // into that
+        const __m128i rest[3] = {x2, x3, x4};
+        for(unsigned int i(0); i < 3; ++i)
+        {
+            const __m128i x5(_mm_clmulepi64_si128(x1, k3k4, 0x00));
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, rest[i]), x5);
+        }
+
+        for(; byteLength >= 16; byteLength -= 16, bytes += 16)
+        {
+            const __m128i x5(_mm_clmulepi64_si128(x1, k3k4, 0x00));
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*) bytes)), x5);
+        }
+
+        // fold 128 bits to 64
+        __m128i x5(_mm_clmulepi64_si128(x1, k3k4, 0x10));
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x5);
+
+        x5 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, low32);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x5);
+
+        // Barrett reduction to 32 bits
+        x5 = _mm_and_si128(x1, low32);
+        x5 = _mm_clmulepi64_si128(x5, poly, 0x10);
+        x5 = _mm_and_si128(x5, low32);
+        x5 = _mm_clmulepi64_si128(x5, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x5);
+
+        return _mm_extract_epi32(x1, 1);
+    }
+#endif
+
+    bool haveFastCrc32()
+    {
+#ifdef GTAR_USE_PCLMUL
+        static const bool result(__builtin_cpu_supports("pclmul") &&
+                                 __builtin_cpu_supports("sse4.1"));
+        return result;
+#else
+        return false;
+#endif
+    }
+
+    uint32_t updateCrc32(uint32_t crc, const char *bytes, size_t byteLength)
+    {
+        const unsigned char *source((const unsigned char*) bytes);
+        crc = ~crc;
+
+#ifdef GTAR_USE_PCLMUL
+        if(byteLength >= 64 && haveFastCrc32())
+        {
+            const size_t blockLength(byteLength & ~(size_t) 15);
+            crc = crc32Pclmul(crc, source, blockLength);
+            source += blockLength;
+            byteLength -= blockLength;
+        }
+#endif
+
+        return ~crc32Software(crc, source, byteLength);
+    }
+
+    // Product of two polynomials modulo the CRC polynomial, in the
+    // reflected bit order (x^0 is the highest bit)
+    static uint32_t multiplyModPoly(uint32_t left, uint32_t right)
+    {
+        uint32_t result(0);
+        for(uint32_t bit(1u << 31); bit; bit >>= 1)
+        {
+            if(left & bit)
+                result ^= right;
+            right = (right >> 1) ^ (0xEDB88320u & (0 - (right & 1)));
+        }
+        return result;
+    }
+
+    uint32_t combineCrc32(uint32_t first, uint32_t second, uint64_t secondLength)
+    {
+        // shift the first CRC past the second block by multiplying
+        // it by x^(8*secondLength), found by repeated squaring
+        uint32_t shift(1u << 31);
+        for(uint32_t square(1u << 23); secondLength; secondLength >>= 1)
+        {
+            if(secondLength & 1)
+                shift = multiplyModPoly(square, shift);
+            square = multiplyModPoly(square, square);
+        }
+
+        return multiplyModPoly(shift, first) ^ second;
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
@@ -0,0 +1,36 @@
+// Crc32.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstddef>
+#include <stdint.h>
+
+#ifndef __CRC32_HPP_
+#define __CRC32_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Update the CRC-32 (as used by zip files and zlib) of a stream
+    /// with byteLength more bytes. Start with a crc of 0. Uses
+    /// carry-less multiplication instructions when the CPU running
+    /// the program supports them.
+    uint32_t updateCrc32(uint32_t crc, const char *bytes, size_t byteLength);
+
+    /// Find the CRC-32 of two blocks of bytes, one after the other,
+    /// from the CRC-32 of each and the length of the second
+    uint32_t combineCrc32(uint32_t first, uint32_t second, uint64_t secondLength);
+
+    /// Returns true if updateCrc32() uses hardware acceleration on
+    /// this CPU
+    bool haveFastCrc32();
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
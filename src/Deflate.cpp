@@ -0,0 +1,1381 @@
+// Deflate.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Chunks of large inputs are compressed on separate threads if C++11
+// threads are available
+#if __cplusplus > 199711L
+#define GTAR_USE_THREADS
+#include <thread>
+#endif
+
+// this file has a compress() method, so skip the zlib-style macros
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz.h"
+#include "Crc32.hpp"
+#include "Deflate.hpp"
+#include "Trace.hpp"
+
+// SSE2 is always available on x86-64
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GTAR_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::min;
+    using std::runtime_error;
+    using std::sort;
+    using std::string;
+    using std::vector;
+
+    // Largest distance and length deflate can refer to
+    static const size_t WINDOW_SIZE = 32768;
+    static const size_t MAX_MATCH = 258;
+    // Matches are found by hashing this many bytes; deflate allows
+    // 3-byte matches, but they rarely pay for themselves
+    static const size_t MIN_MATCH = 4;
+    static const unsigned int HASH_BITS = 15;
+    // Number of literals and matches collected before a block is
+    // written with its own Huffman codes
+    static const size_t BLOCK_SYMBOLS = 1 << 15;
+    // Largest number of bytes in a stored block
+    static const size_t MAX_STORED = 65535;
+    static const unsigned int MAX_CODE_LENGTH = 15;
+    static const unsigned int MAX_CODE_LENGTH_CODE_LENGTH = 7;
+
+    static const unsigned int NUM_LITLEN_SYMBOLS = 288;
+    static const unsigned int NUM_DIST_SYMBOLS = 32;
+    static const unsigned int END_OF_BLOCK = 256;
+
+    static const uint16_t LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t DIST_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const uint8_t DIST_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    // Order in which code length code lengths are stored
+    static const uint8_t CODE_LENGTH_ORDER[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    // These compile to single (unaligned) loads and stores on
+    // little-endian machines
+    inline uint32_t load32(const unsigned char *bytes)
+    {
+        return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) |
+            ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+    }
+
+    inline uint64_t load64(const unsigned char *bytes)
+    {
+        return (uint64_t) load32(bytes) | ((uint64_t) load32(bytes + 4) << 32);
+    }
+
+    inline void store32(unsigned char *bytes, uint32_t value)
+    {
+        bytes[0] = value;
+        bytes[1] = value >> 8;
+        bytes[2] = value >> 16;
+        bytes[3] = value >> 24;
+    }
+
+    // Index of the highest set bit of a nonzero value
+    inline unsigned int highBit(uint32_t value)
+    {
+#if defined(__GNUC__)
+        return 31 - __builtin_clz(value);
+#else
+        unsigned int result(0);
+        while(value >>= 1)
+            ++result;
+        return result;
+#endif
+    }
+
+    // Number of trailing zero bits of a nonzero value
+    inline unsigned int lowBit(uint32_t value)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctz(value);
+#else
+        unsigned int result(0);
+        while(!(value & 1))
+        {
+            value >>= 1;
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    // Index into LENGTH_BASE of a match length (3-258)
+    inline unsigned int lengthSymbol(unsigned int length)
+    {
+        const unsigned int offset(length - 3);
+
+        if(length == MAX_MATCH)
+            return 28;
+        else if(offset < 8)
+            return offset;
+
+        const unsigned int bit(highBit(offset));
+        return 4*(bit - 1) + ((offset >> (bit - 2)) & 3);
+    }
+
+    // Index into DIST_BASE of a match distance (1-32768)
+    inline unsigned int distSymbol(unsigned int distance)
+    {
+        const unsigned int offset(distance - 1);
+
+        if(offset < 4)
+            return offset;
+
+        const unsigned int bit(highBit(offset));
+        return 2*bit + ((offset >> (bit - 1)) & 1);
+    }
+
+    // Reverse the lowest length bits of code; Huffman codes are
+    // packed starting from their most significant bit
+    inline unsigned int reverseBits(unsigned int code, unsigned int length)
+    {
+        unsigned int result(0);
+        for(unsigned int i(0); i < length; ++i, code >>= 1)
+            result = (result << 1) | (code & 1);
+        return result;
+    }
+
+    // Number of leading bytes which are equal in left and right,
+    // comparing at most maxLength bytes
+    static size_t matchLength(const unsigned char *left, const unsigned char *right,
+                              size_t maxLength)
+    {
+        size_t result(0);
+
+#ifdef GTAR_USE_SSE2
+        for(; result + 16 <= maxLength; result += 16)
+        {
+            const __m128i a(_mm_loadu_si128((const __m128i*) (left + result)));
+            const __m128i b(_mm_loadu_si128((const __m128i*) (right + result)));
+            const unsigned int mask(~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xFFFF);
+
+            if(mask)
+                return result + lowBit(mask);
+        }
+#endif
+
+        for(; result + 4 <= maxLength; result += 4)
+        {
+            const uint32_t difference(load32(left + result) ^ load32(right + result));
+
+            if(difference)
+                return result + lowBit(difference)/8;
+        }
+
+        while(result < maxLength && left[result] == right[result])
+            ++result;
+
+        return result;
+    }
+
+    // Compute lengths of a length-limited canonical Huffman code
+    // for the given symbol frequencies (zero frequencies get no
+    // code). Lengths are found with the in-place algorithm of
+    // Moffat and Katajainen, then limited to maxLength by
+    // rebalancing the Kraft sum as miniz does.
+    static void huffmanLengths(const unsigned int *frequencies, unsigned int count,
+                               unsigned int maxLength, uint8_t *lengths)
+    {
+        vector<uint32_t> order;
+        for(unsigned int i(0); i < count; ++i)
+        {
+            lengths[i] = 0;
+            if(frequencies[i])
+                order.push_back((frequencies[i] << 9) | i);
+        }
+
+        if(order.empty())
+            return;
+        else if(order.size() == 1)
+        {
+            lengths[order[0] & 0x1FF] = 1;
+            return;
+        }
+
+        // ascending frequency, ties broken by symbol
+        sort(order.begin(), order.end());
+        const int n(order.size());
+        vector<int> A(n);
+        for(int i(0); i < n; ++i)
+            A[i] = order[i] >> 9;
+
+        A[0] += A[1];
+        int root(0), leaf(2), next;
+        for(next = 1; next < n - 1; ++next)
+        {
+            if(leaf >= n || A[root] < A[leaf])
+            {
+                A[next] = A[root];
+                A[root++] = next;
+            }
+            else
+                A[next] = A[leaf++];
+
+            if(leaf >= n || (root < next && A[root] < A[leaf]))
+            {
+                A[next] += A[root];
+                A[root++] = next;
+            }
+            else
+                A[next] += A[leaf++];
+        }
+
+        A[n - 2] = 0;
+        for(next = n - 3; next >= 0; --next)
+            A[next] = A[A[next]] + 1;
+
+        int available(1), used(0), depth(0);
+        root = n - 2;
+        next = n - 1;
+        while(available > 0)
+        {
+            while(root >= 0 && A[root] == depth)
+            {
+                ++used;
+                --root;
+            }
+            while(available > used)
+            {
+                A[next--] = depth;
+                --available;
+            }
+            available = 2*used;
+            ++depth;
+            used = 0;
+        }
+
+        // A is now the (non-increasing) code length of each symbol
+        unsigned int numCodes[32] = {0};
+        for(int i(0); i < n; ++i)
+            ++numCodes[min((unsigned int) A[i], maxLength)];
+
+        uint32_t total(0);
+        for(unsigned int i(maxLength); i > 0; --i)
+            total += numCodes[i] << (maxLength - i);
+
+        while(total != (1u << maxLength))
+        {
+            --numCodes[maxLength];
+            for(unsigned int i(maxLength - 1); i > 0; --i)
+            {
+                if(numCodes[i])
+                {
+                    --numCodes[i];
+                    numCodes[i + 1] += 2;
+                    break;
+                }
+            }
+            --total;
+        }
+
+        // the least frequent symbols get the longest codes
+        int symbol(0);
+        for(unsigned int length(maxLength); length > 0; --length)
+            for(unsigned int i(0); i < numCodes[length]; ++i)
+                lengths[order[symbol++] & 0x1FF] = length;
+    }
+
+    // Assign canonical codes (bit-reversed for output) for the given
+    // code lengths
+    static void huffmanCodes(const uint8_t *lengths, unsigned int count, uint16_t *codes)
+    {
+        unsigned int lengthCounts[MAX_CODE_LENGTH + 1] = {0};
+        unsigned int nextCode[MAX_CODE_LENGTH + 1] = {0};
+
+        for(unsigned int i(0); i < count; ++i)
+            ++lengthCounts[lengths[i]];
+        lengthCounts[0] = 0;
+
+        for(unsigned int length(1); length <= MAX_CODE_LENGTH; ++length)
+            nextCode[length] = (nextCode[length - 1] + lengthCounts[length - 1]) << 1;
+
+        for(unsigned int i(0); i < count; ++i)
+            codes[i] = lengths[i]? reverseBits(nextCode[lengths[i]]++, lengths[i]): 0;
+    }
+
+    // Bit buffer over the output of the compressor. The space for
+    // each block is checked before it is written.
+    struct DeflateBits
+    {
+        unsigned char *out;
+        uint64_t bits;
+        unsigned int count;
+
+        // Append the lowest length bits of value; length <= 32
+        inline void put(uint32_t value, unsigned int length)
+        {
+            bits |= (uint64_t) value << count;
+            count += length;
+            if(count >= 32)
+            {
+                store32(out, bits);
+                out += 4;
+                bits >>= 32;
+                count -= 32;
+            }
+        }
+
+        // Write any pending bits, padding to a byte boundary
+        void flush()
+        {
+            while(count > 0)
+            {
+                *out++ = bits;
+                bits >>= 8;
+                count = count > 8? count - 8: 0;
+            }
+            bits = 0;
+        }
+    };
+
+    // Single-pass greedy LZ77 compressor emitting deflate blocks
+    class DeflateEncoder
+    {
+    public:
+        // Compress the bytes [start, sourceEnd) of source; matches
+        // may refer back to the bytes before start
+        DeflateEncoder(const unsigned char *source, size_t start, size_t sourceEnd,
+                       unsigned char *target, size_t targetLength):
+            m_source(source), m_sourceLength(sourceEnd), m_target(target),
+            m_end(target + targetLength), m_output(), m_symbols(), m_blockStart(start)
+        {
+            m_output.out = target;
+            m_output.bits = 0;
+            m_output.count = 0;
+            m_symbols.reserve(BLOCK_SYMBOLS);
+            resetFrequencies();
+        }
+
+        // Compress the input, ending the stream if final and
+        // otherwise ending with an empty stored block so that the
+        // output stops on a byte boundary
+        size_t compress(bool final)
+        {
+            vector<uint32_t> hashTable(1 << HASH_BITS, 0);
+            const unsigned char *source(m_source);
+            // positions which can be hashed and matched without
+            // reading past the end of the input
+            const size_t limit(m_sourceLength > MIN_MATCH? m_sourceLength - MIN_MATCH: 0);
+            size_t pos(m_blockStart), misses(0);
+
+            // fill the hash table from the preceding window
+            for(size_t i(pos > WINDOW_SIZE? pos - WINDOW_SIZE: 0); i < min(pos, limit); ++i)
+                hashTable[hashSequence(load32(source + i))] = i;
+
+            while(pos < limit)
+            {
+                if(m_symbols.size() >= BLOCK_SYMBOLS)
+                    writeBlock(pos, false);
+
+                const uint32_t sequence(load32(source + pos));
+                uint32_t &entry(hashTable[hashSequence(sequence)]);
+                const size_t candidate(entry);
+                entry = pos;
+
+                if(pos - candidate - 1 < WINDOW_SIZE && load32(source + candidate) == sequence)
+                {
+                    const size_t length(
+                        MIN_MATCH + matchLength(source + candidate + MIN_MATCH,
+                                                source + pos + MIN_MATCH,
+                                                min(MAX_MATCH, m_sourceLength - pos) - MIN_MATCH));
+                    addMatch(length, pos - candidate);
+
+                    // remember the end of the match too, which often
+                    // continues where this one left off
+                    const size_t last(pos + length - 2);
+                    if(last < limit)
+                        hashTable[hashSequence(load32(source + last))] = last;
+
+                    pos += length;
+                    misses = 0;
+                }
+                else
+                {
+                    // skip ahead faster through data which doesn't
+                    // seem to match anything
+                    const size_t step(min(1 + (misses >> 6), limit - pos));
+                    for(size_t i(0); i < step; ++i)
+                        addLiteral(source[pos + i]);
+                    pos += step;
+                    ++misses;
+                }
+            }
+
+            for(; pos < m_sourceLength; ++pos)
+            {
+                if(m_symbols.size() >= BLOCK_SYMBOLS)
+                    writeBlock(pos, false);
+                addLiteral(source[pos]);
+            }
+
+            writeBlock(m_sourceLength, final);
+            if(!final)
+            {
+                if(m_end - m_output.out < 16)
+                    throw runtime_error("Deflate compression error: output buffer is too small");
+                writeStored(0, false);
+            }
+            m_output.flush();
+
+            return m_output.out - m_target;
+        }
+
+    private:
+        static inline uint32_t hashSequence(uint32_t sequence)
+        {
+            return (sequence*2654435761u) >> (32 - HASH_BITS);
+        }
+
+        inline void addLiteral(unsigned char value)
+        {
+            m_symbols.push_back(value);
+            ++m_litFrequencies[value];
+        }
+
+        inline void addMatch(size_t length, size_t distance)
+        {
+            m_symbols.push_back((length << 16) | distance);
+            ++m_litFrequencies[257 + lengthSymbol(length)];
+            ++m_distFrequencies[distSymbol(distance)];
+        }
+
+        void resetFrequencies()
+        {
+            memset(m_litFrequencies, 0, sizeof(m_litFrequencies));
+            memset(m_distFrequencies, 0, sizeof(m_distFrequencies));
+        }
+
+        // Number of extra bits taken by the matches of this block
+        size_t extraBits() const
+        {
+            size_t result(0);
+            for(unsigned int i(0); i < 29; ++i)
+                result += m_litFrequencies[257 + i]*LENGTH_EXTRA[i];
+            for(unsigned int i(0); i < 30; ++i)
+                result += m_distFrequencies[i]*DIST_EXTRA[i];
+            return result;
+        }
+
+        // Write the symbols collected so far, which cover the input
+        // up to blockEnd, as the cheapest kind of block
+        void writeBlock(size_t blockEnd, bool final)
+        {
+            const size_t blockLength(blockEnd - m_blockStart);
+            m_litFrequencies[END_OF_BLOCK] = 1;
+
+            // huffman block costs, in bits
+            const size_t extra(extraBits());
+            size_t fixedCost(3 + extra);
+            for(unsigned int i(0); i < NUM_LITLEN_SYMBOLS; ++i)
+                fixedCost += m_litFrequencies[i]*(i < 144? 8: i < 256? 9: i < 280? 7: 8);
+            for(unsigned int i(0); i < 30; ++i)
+                fixedCost += m_distFrequencies[i]*5;
+
+            // zlib always sends at least two codes of each kind,
+            // which some inflaters depend on
+            unsigned int litFrequencies[NUM_LITLEN_SYMBOLS];
+            unsigned int distFrequencies[NUM_DIST_SYMBOLS];
+            memcpy(litFrequencies, m_litFrequencies, sizeof(litFrequencies));
+            memcpy(distFrequencies, m_distFrequencies, sizeof(distFrequencies));
+            ensureTwoCodes(litFrequencies, 286);
+            ensureTwoCodes(distFrequencies, 30);
+
+            uint8_t lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS] = {0};
+            uint8_t *litLengths(lengths), *distLengths(lengths + NUM_LITLEN_SYMBOLS);
+            huffmanLengths(litFrequencies, 286, MAX_CODE_LENGTH, litLengths);
+            huffmanLengths(distFrequencies, 30, MAX_CODE_LENGTH, distLengths);
+
+            unsigned int numLit(286), numDist(30);
+            while(numLit > 257 && !litLengths[numLit - 1])
+                --numLit;
+            while(numDist > 1 && !distLengths[numDist - 1])
+                --numDist;
+
+            // run-length encode the code lengths of both codes together
+            uint8_t allLengths[286 + 30];
+            memcpy(allLengths, litLengths, numLit);
+            memcpy(allLengths + numLit, distLengths, numDist);
+            vector<uint16_t> lengthSymbols;
+            unsigned int clFrequencies[19] = {0};
+            encodeLengths(allLengths, numLit + numDist, lengthSymbols, clFrequencies);
+
+            uint8_t clLengths[19];
+            uint16_t clCodes[19];
+            ensureTwoCodes(clFrequencies, 19);
+            huffmanLengths(clFrequencies, 19, MAX_CODE_LENGTH_CODE_LENGTH, clLengths);
+            huffmanCodes(clLengths, 19, clCodes);
+
+            unsigned int numCl(19);
+            while(numCl > 4 && !clLengths[CODE_LENGTH_ORDER[numCl - 1]])
+                --numCl;
+
+            size_t dynamicCost(3 + 14 + 3*numCl + extra);
+            for(unsigned int i(0); i < 19; ++i)
+                dynamicCost += clFrequencies[i]*clLengths[i];
+            dynamicCost += clFrequencies[16]*2 + clFrequencies[17]*3 + clFrequencies[18]*7;
+            for(unsigned int i(0); i < 286; ++i)
+                dynamicCost += m_litFrequencies[i]*litLengths[i];
+            for(unsigned int i(0); i < 30; ++i)
+                dynamicCost += m_distFrequencies[i]*distLengths[i];
+
+            const size_t storedChunks(blockLength/MAX_STORED + 1);
+            const size_t storedCost(storedChunks*(3 + 7 + 32) + 8*blockLength);
+
+            const size_t cost(min(min(fixedCost, dynamicCost), storedCost));
+            if((size_t) (m_end - m_output.out) < cost/8 + 16)
+                throw runtime_error("Deflate compression error: output buffer is too small");
+
+            if(storedCost == cost)
+                writeStored(blockLength, final);
+            else
+            {
+                uint16_t litCodes[NUM_LITLEN_SYMBOLS];
+                uint16_t distCodes[NUM_DIST_SYMBOLS];
+
+                if(fixedCost == cost)
+                {
+                    m_output.put(final | (1 << 1), 3);
+
+                    for(unsigned int i(0); i < NUM_LITLEN_SYMBOLS; ++i)
+                        litLengths[i] = i < 144? 8: i < 256? 9: i < 280? 7: 8;
+                    for(unsigned int i(0); i < NUM_DIST_SYMBOLS; ++i)
+                        distLengths[i] = 5;
+                }
+                else
+                {
+                    m_output.put(final | (2 << 1), 3);
+                    m_output.put(numLit - 257, 5);
+                    m_output.put(numDist - 1, 5);
+                    m_output.put(numCl - 4, 4);
+                    for(unsigned int i(0); i < numCl; ++i)
+                        m_output.put(clLengths[CODE_LENGTH_ORDER[i]], 3);
+
+                    for(size_t i(0); i < lengthSymbols.size(); ++i)
+                    {
+                        const unsigned int symbol(lengthSymbols[i] & 0x1F);
+                        m_output.put(clCodes[symbol], clLengths[symbol]);
+                        if(symbol >= 16)
+                            m_output.put(lengthSymbols[i] >> 5, symbol == 16? 2: symbol == 17? 3: 7);
+                    }
+                }
+
+                huffmanCodes(litLengths, NUM_LITLEN_SYMBOLS, litCodes);
+                huffmanCodes(distLengths, NUM_DIST_SYMBOLS, distCodes);
+                writeSymbols(litCodes, litLengths, distCodes, distLengths);
+            }
+
+            m_symbols.clear();
+            resetFrequencies();
+            m_blockStart = blockEnd;
+        }
+
+        static void ensureTwoCodes(unsigned int *frequencies, unsigned int count)
+        {
+            unsigned int used(0);
+            for(unsigned int i(0); i < count; ++i)
+                used += frequencies[i] != 0;
+            for(unsigned int i(0); used < 2; ++i)
+            {
+                if(!frequencies[i])
+                {
+                    frequencies[i] = 1;
+                    ++used;
+                }
+            }
+        }
+
+        // Run-length encode code lengths as symbols 0-18 of the code
+        // length code, with any repeat count in the upper bits
+        static void encodeLengths(const uint8_t *lengths, unsigned int count,
+                                  vector<uint16_t> &symbols, unsigned int *frequencies)
+        {
+            for(unsigned int i(0); i < count;)
+            {
+                const uint8_t length(lengths[i]);
+                unsigned int run(1);
+                while(i + run < count && lengths[i + run] == length)
+                    ++run;
+                i += run;
+
+                if(!length)
+                {
+                    while(run >= 11)
+                    {
+                        const unsigned int repeat(min(run, 138u));
+                        symbols.push_back(18 | ((repeat - 11) << 5));
+                        ++frequencies[18];
+                        run -= repeat;
+                    }
+                    if(run >= 3)
+                    {
+                        symbols.push_back(17 | ((run - 3) << 5));
+                        ++frequencies[17];
+                        run = 0;
+                    }
+                }
+                else
+                {
+                    symbols.push_back(length);
+                    ++frequencies[length];
+                    --run;
+                    while(run >= 3)
+                    {
+                        const unsigned int repeat(min(run, 6u));
+                        symbols.push_back(16 | ((repeat - 3) << 5));
+                        ++frequencies[16];
+                        run -= repeat;
+                    }
+                }
+
+                for(; run; --run)
+                {
+                    symbols.push_back(length);
+                    ++frequencies[length];
+                }
+            }
+        }
+
+        void writeSymbols(const uint16_t *litCodes, const uint8_t *litLengths,
+                          const uint16_t *distCodes, const uint8_t *distLengths)
+        {
+            DeflateBits output(m_output);
+
+            for(size_t i(0); i < m_symbols.size(); ++i)
+            {
+                const uint32_t symbol(m_symbols[i]);
+                const unsigned int length(symbol >> 16);
+
+                if(!length)
+                {
+                    output.put(litCodes[symbol], litLengths[symbol]);
+                    continue;
+                }
+
+                const unsigned int distance(symbol & 0xFFFF);
+                const unsigned int lengthIndex(lengthSymbol(length));
+                const unsigned int lengthCode(257 + lengthIndex);
+                output.put(litCodes[lengthCode] |
+                           ((length - LENGTH_BASE[lengthIndex]) << litLengths[lengthCode]),
+                           litLengths[lengthCode] + LENGTH_EXTRA[lengthIndex]);
+
+                const unsigned int distIndex(distSymbol(distance));
+                output.put(distCodes[distIndex] |
+                           ((distance - DIST_BASE[distIndex]) << distLengths[distIndex]),
+                           distLengths[distIndex] + DIST_EXTRA[distIndex]);
+            }
+
+            output.put(litCodes[END_OF_BLOCK], litLengths[END_OF_BLOCK]);
+            m_output = output;
+        }
+
+        void writeStored(size_t blockLength, bool final)
+        {
+            const unsigned char *source(m_source + m_blockStart);
+
+            do
+            {
+                const size_t length(min(blockLength, MAX_STORED));
+                blockLength -= length;
+
+                m_output.put(final && !blockLength, 3);
+                m_output.flush();
+                unsigned char *out(m_output.out);
+                out[0] = length;
+                out[1] = length >> 8;
+                out[2] = ~length;
+                out[3] = ~length >> 8;
+                memcpy(out + 4, source, length);
+                m_output.out = out + 4 + length;
+                source += length;
+            }
+            while(blockLength);
+        }
+
+        const unsigned char *m_source;
+        size_t m_sourceLength;
+        unsigned char *m_target;
+        unsigned char *m_end;
+        DeflateBits m_output;
+        // literals (< 256) or (length << 16) | distance of matches
+        vector<uint32_t> m_symbols;
+        size_t m_blockStart;
+        unsigned int m_litFrequencies[NUM_LITLEN_SYMBOLS];
+        unsigned int m_distFrequencies[NUM_DIST_SYMBOLS];
+    };
+
+    size_t fastDeflateBound(size_t byteLength)
+    {
+        // every block can fall back to being stored, and every block
+        // but the last covers at least BLOCK_SYMBOLS bytes
+        const size_t blocks(byteLength/BLOCK_SYMBOLS + 1);
+        return byteLength + 8*(byteLength/MAX_STORED + blocks) + 64;
+    }
+
+    size_t fastDeflate(const char *source, size_t byteLength,
+                       char *target, size_t targetLength)
+    {
+        DeflateEncoder encoder((const unsigned char*) source, 0, byteLength,
+                               (unsigned char*) target, targetLength);
+        return encoder.compress(true);
+    }
+
+    size_t fastDeflateRange(const char *source, size_t start, size_t end, bool final,
+                            char *target, size_t targetLength)
+    {
+        DeflateEncoder encoder((const unsigned char*) source, start, end,
+                               (unsigned char*) target, targetLength);
+        return encoder.compress(final);
+    }
+
+    // Compresses every stride'th chunk of a parallelDeflate() input,
+    // starting with the given one, and finds their CRCs
+    class DeflateChunkWorker
+    {
+    public:
+        DeflateChunkWorker(const char *source, size_t byteLength, int level,
+                           size_t chunkLength, size_t first, size_t stride,
+                           vector<vector<char> > *outputs, vector<uint32_t> *crcs):
+            m_source(source), m_byteLength(byteLength), m_level(level),
+            m_chunkLength(chunkLength), m_first(first), m_stride(stride),
+            m_outputs(outputs), m_crcs(crcs), m_error()
+        {}
+
+        void run()
+        {
+            // exceptions can't leave a thread, so keep the message
+            // to be thrown again once all of the threads are done
+            try
+            {
+                for(size_t i(m_first); i < m_outputs->size(); i += m_stride)
+                    compressChunk(i);
+            }
+            catch(std::exception &error)
+            {
+                m_error = error.what();
+                if(m_error.empty())
+                    m_error = "Deflate compression error";
+            }
+        }
+
+        const string &error() const
+        {
+            return m_error;
+        }
+
+    private:
+        void compressChunk(size_t index)
+        {
+            const size_t start(index*m_chunkLength);
+            const size_t end(min(start + m_chunkLength, m_byteLength));
+            const bool final(end == m_byteLength);
+            vector<char> &output((*m_outputs)[index]);
+            TraceSpan span("deflate chunk");
+
+            (*m_crcs)[index] = updateCrc32(0, m_source + start, end - start);
+
+            if(m_level == MZ_BEST_SPEED)
+            {
+                output.resize(fastDeflateBound(end - start));
+                output.resize(fastDeflateRange(m_source, start, end, final,
+                                               &output[0], output.size()));
+                return;
+            }
+
+            output.resize(mz_compressBound(end - start));
+            size_t inputLength(end - start), outputLength(output.size());
+            tdefl_compressor *compressor(new tdefl_compressor);
+            tdefl_init(compressor, NULL, NULL,
+                       tdefl_create_comp_flags_from_zip_params(m_level, -15, MZ_DEFAULT_STRATEGY));
+            const tdefl_status status(
+                tdefl_compress(compressor, m_source + start, &inputLength,
+                               &output[0], &outputLength, final? TDEFL_FINISH: TDEFL_SYNC_FLUSH));
+            const bool flushed(compressor->m_output_flush_remaining == 0);
+            delete compressor;
+
+            if(status != (final? TDEFL_STATUS_DONE: TDEFL_STATUS_OKAY) ||
+               inputLength != end - start || !flushed)
+                throw runtime_error("Deflate compression error: miniz failed to compress a chunk");
+            output.resize(outputLength);
+        }
+
+        const char *m_source;
+        size_t m_byteLength;
+        int m_level;
+        size_t m_chunkLength;
+        size_t m_first;
+        size_t m_stride;
+        vector<vector<char> > *m_outputs;
+        vector<uint32_t> *m_crcs;
+        string m_error;
+    };
+
+    unsigned int deflateThreads(unsigned int numThreads)
+    {
+#ifdef GTAR_USE_THREADS
+        if(!numThreads)
+            numThreads = std::thread::hardware_concurrency();
+        return numThreads? numThreads: 1;
+#else
+        return 1;
+#endif
+    }
+
+    uint32_t parallelDeflate(const char *source, size_t byteLength, int level,
+                             size_t chunkLength, unsigned int numThreads,
+                             vector<char> &target)
+    {
+        const size_t numChunks(byteLength? (byteLength + chunkLength - 1)/chunkLength: 1);
+        vector<vector<char> > outputs(numChunks);
+        vector<uint32_t> crcs(numChunks);
+        const size_t threads(min((size_t) deflateThreads(numThreads), numChunks));
+
+        vector<DeflateChunkWorker> workers;
+        for(size_t i(0); i < threads; ++i)
+            workers.push_back(DeflateChunkWorker(source, byteLength, level, chunkLength,
+                                                 i, threads, &outputs, &crcs));
+
+#ifdef GTAR_USE_THREADS
+        vector<std::thread> pool;
+        for(size_t i(1); i < threads; ++i)
+            pool.push_back(std::thread(&DeflateChunkWorker::run, &workers[i]));
+        workers[0].run();
+        for(size_t i(0); i < pool.size(); ++i)
+            pool[i].join();
+#else
+        for(size_t i(0); i < threads; ++i)
+            workers[i].run();
+#endif
+
+        for(size_t i(0); i < threads; ++i)
+            if(!workers[i].error().empty())
+                throw runtime_error(workers[i].error());
+
+        size_t totalLength(0);
+        for(size_t i(0); i < numChunks; ++i)
+            totalLength += outputs[i].size();
+
+        // join the chunks, freeing each as it is copied
+        target.clear();
+        target.reserve(totalLength);
+        uint32_t crc(crcs[0]);
+        for(size_t i(0); i < numChunks; ++i)
+        {
+            target.insert(target.end(), outputs[i].begin(), outputs[i].end());
+            vector<char>().swap(outputs[i]);
+
+            if(i)
+                crc = combineCrc32(crc, crcs[i],
+                                   min(chunkLength, byteLength - i*chunkLength));
+        }
+
+        return crc;
+    }
+
+    // Entry of a decoding table, found by indexing with the next
+    // bits of the input
+    struct InflateEntry
+    {
+        // literal value, length or distance base, or subtable offset
+        uint16_t base;
+        // number of bits of the code (within this table)
+        uint8_t bits;
+        // one of the INFLATE_* kinds, plus the extra bit count
+        uint8_t op;
+    };
+
+    static const uint8_t INFLATE_LITERAL = 0x00;
+    static const uint8_t INFLATE_BASE = 0x10;
+    static const uint8_t INFLATE_SUBTABLE = 0x20;
+    static const uint8_t INFLATE_END = 0x40;
+    static const uint8_t INFLATE_INVALID = 0x80;
+
+    static void corruptStream()
+    {
+        throw runtime_error("Deflate decompression error: corrupt stream");
+    }
+
+    // Two-level table for a canonical Huffman code: codes up to
+    // PrimaryBits long are found directly, longer ones through a
+    // subtable of 2^(15 - PrimaryBits) entries per prefix
+    template<unsigned int PrimaryBits>
+    class InflateTable
+    {
+    public:
+        InflateTable():
+            m_entries()
+        {}
+
+        // Build the table from the code lengths of count symbols.
+        // Symbols from firstBase on are lengths or distances given by
+        // bases and extras (invalid past numBases); earlier symbols
+        // are literals, except for END_OF_BLOCK if bases are given.
+        void build(const uint8_t *lengths, unsigned int count,
+                   unsigned int firstBase, const uint16_t *bases,
+                   const uint8_t *extras, unsigned int numBases)
+        {
+            const unsigned int subBits(MAX_CODE_LENGTH - PrimaryBits);
+            InflateEntry invalid = {0, 0, INFLATE_INVALID};
+            m_entries.assign(1 << PrimaryBits, invalid);
+
+            unsigned int lengthCounts[MAX_CODE_LENGTH + 1] = {0};
+            unsigned int nextCode[MAX_CODE_LENGTH + 1] = {0};
+            for(unsigned int i(0); i < count; ++i)
+                ++lengthCounts[lengths[i]];
+            lengthCounts[0] = 0;
+
+            // incomplete codes are allowed (any unused codes are
+            // invalid), but oversubscribed ones aren't
+            int left(1);
+            for(unsigned int length(1); length <= MAX_CODE_LENGTH; ++length)
+            {
+                left = 2*left - lengthCounts[length];
+                if(left < 0)
+                    corruptStream();
+                nextCode[length] = (nextCode[length - 1] + lengthCounts[length - 1]) << 1;
+            }
+
+            for(unsigned int symbol(0); symbol < count; ++symbol)
+            {
+                const unsigned int length(lengths[symbol]);
+                if(!length)
+                    continue;
+
+                InflateEntry entry = {(uint16_t) symbol, 0, INFLATE_LITERAL};
+                if(symbol >= firstBase)
+                {
+                    entry.base = 0;
+                    entry.op = INFLATE_INVALID;
+                    if(symbol - firstBase < numBases)
+                    {
+                        entry.base = bases[symbol - firstBase];
+                        entry.op = INFLATE_BASE | extras[symbol - firstBase];
+                    }
+                }
+                else if(bases && symbol == END_OF_BLOCK)
+                    entry.op = INFLATE_END;
+
+                const unsigned int code(reverseBits(nextCode[length]++, length));
+
+                if(length <= PrimaryBits)
+                {
+                    entry.bits = length;
+                    for(unsigned int i(code); i < (1u << PrimaryBits); i += 1 << length)
+                        m_entries[i] = entry;
+                    continue;
+                }
+
+                const unsigned int prefix(code & ((1 << PrimaryBits) - 1));
+                if(m_entries[prefix].op != INFLATE_SUBTABLE)
+                {
+                    InflateEntry link = {(uint16_t) m_entries.size(), (uint8_t) PrimaryBits,
+                                         INFLATE_SUBTABLE};
+                    m_entries[prefix] = link;
+                    m_entries.resize(m_entries.size() + (1 << subBits), invalid);
+                }
+
+                InflateEntry *subtable(&m_entries[m_entries[prefix].base]);
+                entry.bits = length - PrimaryBits;
+                for(unsigned int i(code >> PrimaryBits); i < (1u << subBits);
+                    i += 1 << entry.bits)
+                    subtable[i] = entry;
+            }
+        }
+
+        const InflateEntry *entries() const
+        {
+            return &m_entries[0];
+        }
+
+        // Entry for the code at the bottom of bits, which may link to
+        // a subtable
+        static inline const InflateEntry &primary(const InflateEntry *entries, uint64_t bits)
+        {
+            return entries[bits & ((1 << PrimaryBits) - 1)];
+        }
+
+        // Look up the entry for the code at the bottom of bits,
+        // consuming the primary bits of a long code
+        static inline const InflateEntry &lookup(const InflateEntry *entries, uint64_t &bits,
+                                                 unsigned int &bitCount)
+        {
+            const InflateEntry &entry(entries[bits & ((1 << PrimaryBits) - 1)]);
+            if(entry.op != INFLATE_SUBTABLE)
+                return entry;
+
+            bits >>= PrimaryBits;
+            bitCount -= PrimaryBits;
+            return entries[entry.base + (bits & ((1 << (MAX_CODE_LENGTH - PrimaryBits)) - 1))];
+        }
+
+    private:
+        std::vector<InflateEntry> m_entries;
+    };
+
+    // Bit buffer over the input of the inflater, refilled eight
+    // bytes at a time. Inner loops keep a copy in local variables,
+    // which the compiler can't do for members when writing output
+    // through char pointers.
+    struct InflateBits
+    {
+        const unsigned char *in;
+        const unsigned char *end;
+        uint64_t bits;
+        unsigned int count;
+        // number of zero bytes added to the bit buffer past the end
+        // of the input
+        size_t overrun;
+
+        // Ensure at least 56 bits are in the bit buffer
+        inline void refill()
+        {
+            if(end - in >= 8)
+            {
+                bits |= load64(in) << count;
+                in += (63 - count) >> 3;
+                count |= 56;
+            }
+            else
+            {
+                for(; count <= 56; count += 8)
+                {
+                    if(in < end)
+                        bits |= (uint64_t) *in++ << count;
+                    else if(++overrun > 16)
+                        throw runtime_error("Deflate decompression error: truncated stream");
+                }
+            }
+        }
+
+        inline unsigned int peek(unsigned int length) const
+        {
+            return bits & ((1u << length) - 1);
+        }
+
+        inline void consume(unsigned int length)
+        {
+            bits >>= length;
+            count -= length;
+        }
+    };
+
+    // Table-driven inflater. A refill always leaves enough bits for
+    // a whole length and distance pair (or two literals), and copies
+    // are done eight bytes at a time when the output has room.
+    class InflateDecoder
+    {
+    public:
+        InflateDecoder(const unsigned char *source, size_t byteLength,
+                       unsigned char *target, size_t targetLength):
+            m_input(), m_target(target), m_out(target), m_outEnd(target + targetLength),
+            m_litTable(), m_distTable(), m_lengthTable()
+        {
+            m_input.in = source;
+            m_input.end = source + byteLength;
+            m_input.bits = 0;
+            m_input.count = 0;
+            m_input.overrun = 0;
+        }
+
+        size_t decompress()
+        {
+            bool final(false);
+            bool haveFixed(false);
+
+            while(!final)
+            {
+                m_input.refill();
+                final = m_input.peek(1);
+                const unsigned int type(m_input.peek(3) >> 1);
+                m_input.consume(3);
+
+                if(type == 0)
+                {
+                    copyStored();
+                    continue;
+                }
+                else if(type == 1)
+                {
+                    if(!haveFixed)
+                    {
+                        uint8_t lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS];
+                        for(unsigned int i(0); i < NUM_LITLEN_SYMBOLS; ++i)
+                            lengths[i] = i < 144? 8: i < 256? 9: i < 280? 7: 8;
+                        for(unsigned int i(0); i < NUM_DIST_SYMBOLS; ++i)
+                            lengths[NUM_LITLEN_SYMBOLS + i] = 5;
+                        buildTables(lengths, NUM_LITLEN_SYMBOLS, NUM_DIST_SYMBOLS);
+                    }
+                }
+                else if(type == 2)
+                    readDynamicTables();
+                else
+                    corruptStream();
+
+                // dynamic tables replace the fixed ones
+                haveFixed = type == 1;
+                decodeSymbols();
+            }
+
+            // the stream ended within the zeros appended past the end
+            // of the input
+            if(8*m_input.overrun > m_input.count)
+                throw runtime_error("Deflate decompression error: truncated stream");
+
+            return m_out - m_target;
+        }
+
+    private:
+        void copyStored()
+        {
+            // return whole bytes in the bit buffer to the input
+            m_input.consume(m_input.count & 7);
+            const size_t buffered(m_input.count >> 3);
+            if(m_input.overrun > buffered)
+                throw runtime_error("Deflate decompression error: truncated stream");
+            const unsigned char *in(m_input.in - (buffered - m_input.overrun));
+            m_input.bits = 0;
+            m_input.count = 0;
+            m_input.overrun = 0;
+
+            if(m_input.end - in < 4)
+                throw runtime_error("Deflate decompression error: truncated stream");
+            const size_t length(in[0] | (in[1] << 8));
+            if(length != (size_t) ((~(in[2] | (in[3] << 8))) & 0xFFFF))
+                corruptStream();
+            in += 4;
+
+            if((size_t) (m_input.end - in) < length)
+                throw runtime_error("Deflate decompression error: truncated stream");
+            if((size_t) (m_outEnd - m_out) < length)
+                throw runtime_error("Deflate decompression error: output buffer is too small");
+
+            memcpy(m_out, in, length);
+            m_input.in = in + length;
+            m_out += length;
+        }
+
+        void buildTables(const uint8_t *lengths, unsigned int numLit, unsigned int numDist)
+        {
+            if(!lengths[END_OF_BLOCK])
+                corruptStream();
+            m_litTable.build(lengths, numLit, 257, LENGTH_BASE, LENGTH_EXTRA, 29);
+            m_distTable.build(lengths + numLit, numDist, 0, DIST_BASE, DIST_EXTRA, 30);
+        }
+
+        void readDynamicTables()
+        {
+            InflateBits &input(m_input);
+            input.refill();
+            const unsigned int numLit(input.peek(5) + 257);
+            input.consume(5);
+            const unsigned int numDist(input.peek(5) + 1);
+            input.consume(5);
+            const unsigned int numCl(input.peek(4) + 4);
+            input.consume(4);
+
+            if(numLit > 286 || numDist > 30)
+                corruptStream();
+
+            uint8_t clLengths[19] = {0};
+            for(unsigned int i(0); i < numCl; ++i)
+            {
+                input.refill();
+                clLengths[CODE_LENGTH_ORDER[i]] = input.peek(3);
+                input.consume(3);
+            }
+            m_lengthTable.build(clLengths, 19, 19, NULL, NULL, 0);
+
+            uint8_t lengths[286 + 30];
+            for(unsigned int i(0); i < numLit + numDist;)
+            {
+                input.refill();
+                const InflateEntry &entry(
+                    InflateTable<7>::lookup(m_lengthTable.entries(), input.bits, input.count));
+                if(entry.op != INFLATE_LITERAL)
+                    corruptStream();
+                input.consume(entry.bits);
+
+                if(entry.base < 16)
+                {
+                    lengths[i++] = entry.base;
+                    continue;
+                }
+
+                uint8_t value(0);
+                unsigned int repeat(0);
+                if(entry.base == 16)
+                {
+                    if(!i)
+                        corruptStream();
+                    value = lengths[i - 1];
+                    repeat = 3 + input.peek(2);
+                    input.consume(2);
+                }
+                else if(entry.base == 17)
+                {
+                    repeat = 3 + input.peek(3);
+                    input.consume(3);
+                }
+                else
+                {
+                    repeat = 11 + input.peek(7);
+                    input.consume(7);
+                }
+
+                if(i + repeat > numLit + numDist)
+                    corruptStream();
+                memset(lengths + i, value, repeat);
+                i += repeat;
+            }
+
+            // buildTables() expects the distance lengths right after
+            // the literal/length ones
+            buildTables(lengths, numLit, numDist);
+        }
+
+        void decodeSymbols()
+        {
+            InflateBits input(m_input);
+            unsigned char *out(m_out);
+            unsigned char *const outEnd(m_outEnd);
+            const InflateEntry *const litEntries(m_litTable.entries());
+            const InflateEntry *const distEntries(m_distTable.entries());
+
+            for(;;)
+            {
+                input.refill();
+                const InflateEntry &entry(
+                    InflateTable<10>::lookup(litEntries, input.bits, input.count));
+                input.consume(entry.bits);
+
+                if(entry.op == INFLATE_LITERAL)
+                {
+                    if(out == outEnd)
+                        throw runtime_error("Deflate decompression error: output buffer is too small");
+                    *out++ = entry.base;
+
+                    // the bits left over from the refill always hold
+                    // another short literal
+                    const InflateEntry &next(InflateTable<10>::primary(litEntries, input.bits));
+                    if(next.op == INFLATE_LITERAL && out < outEnd)
+                    {
+                        input.consume(next.bits);
+                        *out++ = next.base;
+                    }
+                    continue;
+                }
+                else if(entry.op == INFLATE_END)
+                    break;
+                else if(entry.op & INFLATE_INVALID)
+                    corruptStream();
+
+                const unsigned int lengthExtra(entry.op & 0xF);
+                const size_t length(entry.base + input.peek(lengthExtra));
+                input.consume(lengthExtra);
+
+                const InflateEntry &distEntry(
+                    InflateTable<8>::lookup(distEntries, input.bits, input.count));
+                if(distEntry.op & INFLATE_INVALID)
+                    corruptStream();
+                input.consume(distEntry.bits);
+                const unsigned int distExtra(distEntry.op & 0xF);
+                const size_t distance(distEntry.base + input.peek(distExtra));
+                input.consume(distExtra);
+
+                if(distance > (size_t) (out - m_target))
+                    corruptStream();
+                if(length > (size_t) (outEnd - out))
+                    throw runtime_error("Deflate decompression error: output buffer is too small");
+
+                copyMatch(out, outEnd, length, distance);
+            }
+
+            m_input = input;
+            m_out = out;
+        }
+
+        static inline void copyMatch(unsigned char *&out, unsigned char *outEnd,
+                                     size_t length, size_t distance)
+        {
+            const unsigned char *source(out - distance);
+            unsigned char *target(out);
+            out += length;
+
+            if(distance >= 8 && (size_t) (outEnd - target) >= length + 8)
+            {
+                // may write up to 7 bytes past the match, which are
+                // overwritten later
+                do
+                {
+                    memcpy(target, source, 8);
+                    target += 8;
+                    source += 8;
+                }
+                while(target < out);
+            }
+            else if(distance == 1)
+                memset(target, *source, length);
+            else if((size_t) (outEnd - target) >= length + 16)
+            {
+                // write the repeating pattern until it is at least 8
+                // bytes long, then copy whole repeats of it
+                const size_t step(distance*((7 + distance)/distance));
+                unsigned char *patternEnd(target + min(step, length));
+                for(; target < patternEnd; ++target, ++source)
+                    *target = *source;
+                for(source = target - step; target < out; target += 8, source += 8)
+                    memcpy(target, source, 8);
+            }
+            else
+                for(; target < out; ++target, ++source)
+                    *target = *source;
+        }
+
+        InflateBits m_input;
+        unsigned char *m_target;
+        unsigned char *m_out;
+        unsigned char *m_outEnd;
+        InflateTable<10> m_litTable;
+        InflateTable<8> m_distTable;
+        InflateTable<7> m_lengthTable;
+    };
+
+    size_t fastInflate(const char *source, size_t byteLength,
+                       char *target, size_t targetLength)
+    {
+        InflateDecoder decoder((const unsigned char*) source, byteLength,
+                               (unsigned char*) target, targetLength);
+        return decoder.decompress();
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
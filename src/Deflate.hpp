@@ -0,0 +1,69 @@
+// Deflate.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#ifndef __DEFLATE_HPP_
+#define __DEFLATE_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Maximum number of bytes fastDeflate() may produce for
+    /// byteLength bytes of input
+    size_t fastDeflateBound(size_t byteLength);
+
+    /// Compress byteLength bytes of source into target as a raw
+    /// deflate stream (RFC 1951), which any inflater can read. Trades
+    /// some compression ratio for speed, making a single greedy pass
+    /// over the input. Returns the number of bytes written; throws if
+    /// target (with room for targetLength bytes) is too small.
+    size_t fastDeflate(const char *source, size_t byteLength,
+                       char *target, size_t targetLength);
+
+    /// Compress the bytes [start, end) of source as one piece of a
+    /// raw deflate stream. Matches may refer to the (up to 32 KiB of)
+    /// bytes before start, so consecutive pieces of an input can be
+    /// compressed independently and their outputs concatenated. The
+    /// last piece should be final; the others end with an empty
+    /// stored block so that they stop on a byte boundary. Returns the
+    /// number of bytes written, which is at most
+    /// fastDeflateBound(end - start).
+    size_t fastDeflateRange(const char *source, size_t start, size_t end, bool final,
+                            char *target, size_t targetLength);
+
+    /// Number of threads parallelDeflate() will use when given
+    /// numThreads: all of the processors if numThreads is 0, and
+    /// only one if this library was built without thread support
+    unsigned int deflateThreads(unsigned int numThreads);
+
+    /// Compress byteLength bytes of source into target as a single
+    /// raw deflate stream, in the manner of pigz: the input is split
+    /// into chunks of chunkLength bytes which are compressed on up to
+    /// numThreads threads and joined. level is a miniz compression
+    /// level; MZ_BEST_SPEED uses fastDeflateRange() and the others
+    /// use miniz, without referring back to previous chunks. Returns
+    /// the CRC-32 of the input, which is found by the same threads.
+    uint32_t parallelDeflate(const char *source, size_t byteLength, int level,
+                             size_t chunkLength, unsigned int numThreads,
+                             std::vector<char> &target);
+
+    /// Decompress a raw deflate stream of byteLength bytes from
+    /// source into target, which has room for targetLength bytes,
+    /// returning the number of bytes written. Throws on corrupt or
+    /// truncated input or if target is too small.
+    size_t fastInflate(const char *source, size_t byteLength,
+                       char *target, size_t targetLength);
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
@@ -18,6 +18,7 @@
 #endif
 
 #include "DirArchive.hpp"
+#include "MappedFile.hpp"
 
 #ifdef GTAR_NAMESPACE_PARENT
 namespace GTAR_NAMESPACE_PARENT{
@@ -27,11 +28,14 @@ namespace gtar{
 
     using std::ios;
     using std::ios_base;
+    using std::make_pair;
     using std::map;
     using std::oct;
+    using std::pair;
     using std::right;
     using std::runtime_error;
     using std::fstream;
+    using std::set;
     using std::string;
     using std::stringstream;
     using std::vector;
@@ -72,6 +76,7 @@ namespace gtar{
         // directory always has at least one slash
         const size_t stripLength(m_filename.find_last_not_of('/') + 1);
         const string stripped(m_filename.substr(0, stripLength));
+        ScopedTimer timer(m_stats.indexTime, "index");
         searchDirectory(stripped);
     }
 
@@ -90,6 +95,8 @@ namespace gtar{
         if(m_mode == Read)
             throw runtime_error("Can't write to an archive opened for reading");
 
+        ScopedTimer timer(m_stats.ioTime, "store", &path);
+
         for(size_t i(path.find('/', 0)); i != string::npos; i = path.find('/', i + 1))
         {
             const string segment(path.substr(0, i));
@@ -112,6 +119,10 @@ namespace gtar{
         file.write((const char*) contents, byteLength);
         file.close();
 
+        ++m_stats.writes;
+        m_stats.bytesWritten += byteLength;
+        m_stats.uncompressedBytesWritten += byteLength;
+
         m_fileNames.push_back(path);
     }
 
@@ -125,6 +136,7 @@ namespace gtar{
 
     SharedArray<char> DirArchive::read(const std::string &path)
     {
+        ScopedTimer timer(m_stats.ioTime, "load", &path);
         fstream file((m_filename + path).c_str(), ios_base::in);
 
         if(!file.good())
@@ -136,7 +148,17 @@ namespace gtar{
         size = file.tellg() - size;
         file.seekg(0);
 
-        SharedArray<char> result(new char[size], size);
+        ++m_stats.reads;
+        m_stats.bytesRead += size;
+        m_stats.uncompressedBytesRead += size;
+
+        SharedArray<char> result;
+
+        // large files are mapped rather than copied if asked to
+        if(m_mode == Read && m_mapFiles && mapFile(m_filename + path, 0, size, result))
+            return result;
+
+        result = SharedArray<char>(new char[size], size);
 
         file.read(result.get(), size);
         file.close();
@@ -144,6 +166,20 @@ namespace gtar{
         return result;
     }
 
+    FileInfo DirArchive::getFileInfo(const string &path)
+    {
+        FileInfo result;
+        struct stat fileStat;
+
+        if(stat((m_filename + path).c_str(), &fileStat) == 0)
+        {
+            result.storedLength = result.byteLength = fileStat.st_size;
+            result.version = modificationTime(fileStat);
+        }
+
+        return result;
+    }
+
     unsigned int DirArchive::size()
     {
         return m_fileNames.size();
@@ -154,8 +190,73 @@ namespace gtar{
         return m_fileNames[index];
     }
 
-    void DirArchive::searchDirectory(const string &path)
+    void DirArchive::refresh()
     {
+        if(m_mode != Read)
+            return;
+
+        ScopedTimer timer(m_stats.indexTime, "index");
+        const size_t oldSize(m_fileNames.size());
+        m_rewrittenFiles.clear();
+
+        // a directory's modification time changes when files or
+        // directories are added directly inside it, so only those
+        // which changed need to be listed again
+        vector<string> directories;
+        for(map<string, uint64_t>::const_iterator iter(m_directoryTimes.begin());
+            iter != m_directoryTimes.end(); ++iter)
+            directories.push_back(iter->first);
+
+        set<string> known;
+        for(vector<string>::const_iterator iter(directories.begin());
+            iter != directories.end(); ++iter)
+        {
+            struct stat dirStat;
+            if(stat(iter->c_str(), &dirStat) != 0 ||
+               modificationTime(dirStat) == m_directoryTimes[*iter])
+                continue;
+
+            if(known.empty())
+                known.insert(m_fileNames.begin(), m_fileNames.end());
+
+            searchDirectory(*iter, &known);
+        }
+
+        // files rewritten in place don't change their directory, so
+        // each one already known is checked
+        const size_t prefixLength(m_filename.find_last_not_of('/') + 2);
+        for(size_t i(0); i < oldSize; ++i)
+        {
+            struct stat fileStat;
+            if(stat(m_fileNames[i].c_str(), &fileStat) != 0)
+                continue;
+
+            const pair<uint64_t, uint64_t> fileTime(modificationTime(fileStat),
+                                                    fileStat.st_size);
+            pair<uint64_t, uint64_t> &recorded(m_fileTimes[m_fileNames[i]]);
+            if(recorded != fileTime)
+            {
+                recorded = fileTime;
+                // listed names start with the directory itself, but
+                // files are read (and cached) by their path inside it
+                m_rewrittenFiles.push_back(m_fileNames[i].substr(prefixLength));
+            }
+        }
+    }
+
+    vector<string> DirArchive::rewrittenFiles() const
+    {
+        return m_rewrittenFiles;
+    }
+
+    void DirArchive::searchDirectory(const string &path, const set<string> *known)
+    {
+        // note the time before listing, so that files added while
+        // listing are found by the next refresh()
+        struct stat dirStat;
+        if(stat(path.c_str(), &dirStat) == 0)
+            m_directoryTimes[path] = modificationTime(dirStat);
+
         DIR *curDir(opendir(path.c_str()));
         if(curDir == NULL)
         {
@@ -175,13 +276,27 @@ namespace gtar{
                 stringstream fname;
                 fname << path << '/' << curEnt->d_name;
                 const string entName(fname.str());
-                stat(entName.c_str(), &curStat);
-                // is a directory
-                if(curStat.st_mode & S_IFDIR)
-                    searchDirectory(entName);
-                // only grab regular files
-                else if(curStat.st_mode & S_IFREG)
-                    m_fileNames.push_back(entName);
+
+                // directories which were already searched are
+                // checked for changes of their own by refresh()
+                const bool found(m_directoryTimes.find(entName) != m_directoryTimes.end() ||
+                                 (known && known->find(entName) != known->end()));
+
+                if(!found)
+                {
+                    stat(entName.c_str(), &curStat);
+                    // is a directory
+                    if(curStat.st_mode & S_IFDIR)
+                        searchDirectory(entName, known);
+                    // only grab regular files
+                    else if(curStat.st_mode & S_IFREG)
+                    {
+                        m_fileNames.push_back(entName);
+                        if(m_mode == Read)
+                            m_fileTimes[entName] = make_pair(
+                                modificationTime(curStat), (uint64_t) curStat.st_size);
+                    }
+                }
             }
             curEnt = readdir(curDir);
         }
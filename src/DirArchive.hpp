@@ -46,14 +46,26 @@ namespace gtar{
         // Read the contents of the given location within the archive
         virtual SharedArray<char> read(const std::string &path);
 
+        // Return the size of the file at the given location
+        virtual FileInfo getFileInfo(const std::string &path);
+
         // Return the number of files stored in the archive
         virtual unsigned int size();
         // Return the name of the file with the given numerical index
         virtual std::string getItemName(unsigned int index);
 
+        // Find the files added to directories which changed since the
+        // archive was opened or last refreshed, and the files which
+        // were rewritten
+        virtual void refresh();
+
+        virtual std::vector<std::string> rewrittenFiles() const;
+
     private:
-        // Helper function to recursively search through a directory
-        void searchDirectory(const std::string &path);
+        // Helper function to recursively search through a directory,
+        // skipping files which are known already
+        void searchDirectory(const std::string &path,
+                             const std::set<std::string> *known=NULL);
 
         // Name of the archive file we're accessing
         const std::string m_filename;
@@ -64,6 +76,15 @@ namespace gtar{
         std::set<std::string> m_createdDirectories;
         // All the file names we found in the file, in file order
         std::vector<std::string> m_fileNames;
+        // Modification time of each directory found when it was last
+        // searched
+        std::map<std::string, uint64_t> m_directoryTimes;
+        // Modification time and size of each file found, for archives
+        // opened for reading
+        std::map<std::string, std::pair<uint64_t, uint64_t> > m_fileTimes;
+        // Paths inside the archive of the files in m_fileNames found
+        // to have changed by the last refresh()
+        std::vector<std::string> m_rewrittenFiles;
     };
 }
 
@@ -0,0 +1,655 @@
+// Filter.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+#include "Filter.hpp"
+
+// SSE2 is always available on x86-64
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GTAR_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::map;
+    using std::runtime_error;
+    using std::string;
+    using std::stringstream;
+    using std::vector;
+
+    // PNG-style signature: the high byte and line endings make it
+    // very unlikely to appear at the start of unfiltered data
+    static const char FILTER_MAGIC[8] = {'\x89', 'G', 'T', 'F', '\r', '\n', '\x1a', '\n'};
+    // magic, followed by a 32-bit little-endian length of the fields
+    static const size_t FILTER_PREAMBLE_SIZE = sizeof(FILTER_MAGIC) + 4;
+
+    FilterHeader::FilterHeader():
+        m_fields()
+    {}
+
+    size_t FilterHeader::parse(const char *bytes, size_t byteLength)
+    {
+        if(byteLength < FILTER_PREAMBLE_SIZE || memcmp(bytes, FILTER_MAGIC, sizeof(FILTER_MAGIC)))
+            return 0;
+
+        const unsigned char *lengthBytes((const unsigned char*) bytes + sizeof(FILTER_MAGIC));
+        const size_t fieldLength(lengthBytes[0] | (lengthBytes[1] << 8) |
+                                 (lengthBytes[2] << 16) | ((size_t) lengthBytes[3] << 24));
+
+        if(FILTER_PREAMBLE_SIZE + fieldLength > byteLength)
+            return 0;
+
+        // fields are stored as key=value lines
+        map<string, string> fields;
+        const string text(bytes + FILTER_PREAMBLE_SIZE, fieldLength);
+        for(size_t pos(0), nextpos(text.find('\n', 0)); nextpos != string::npos;
+            pos = nextpos + 1, nextpos = text.find('\n', pos))
+        {
+            const string line(text.substr(pos, nextpos - pos));
+            const size_t split(line.find('='));
+
+            if(split == string::npos)
+                return 0;
+
+            fields[line.substr(0, split)] = line.substr(split + 1);
+        }
+
+        m_fields.swap(fields);
+        return FILTER_PREAMBLE_SIZE + fieldLength;
+    }
+
+    string FilterHeader::serialize() const
+    {
+        stringstream text;
+        for(map<string, string>::const_iterator iter(m_fields.begin());
+            iter != m_fields.end(); ++iter)
+            text << iter->first << '=' << iter->second << '\n';
+
+        const string fields(text.str());
+        const uint32_t fieldLength(fields.size());
+
+        string result(FILTER_MAGIC, sizeof(FILTER_MAGIC));
+        for(size_t i(0); i < 4; ++i)
+            result.push_back((char) ((fieldLength >> (8*i)) & 0xff));
+        result += fields;
+
+        return result;
+    }
+
+    bool FilterHeader::has(const string &key) const
+    {
+        return m_fields.find(key) != m_fields.end();
+    }
+
+    string FilterHeader::get(const string &key) const
+    {
+        map<string, string>::const_iterator iter(m_fields.find(key));
+
+        if(iter == m_fields.end())
+            return string();
+
+        return iter->second;
+    }
+
+    void FilterHeader::set(const string &key, const string &value)
+    {
+        m_fields[key] = value;
+    }
+
+    string deltaModeName(DeltaMode mode)
+    {
+        switch(mode)
+        {
+        case XorDelta:
+            return "xor";
+        case DiffDelta:
+            return "diff";
+        case DictDelta:
+            return "dict";
+        case NoDelta:
+        default:
+            return "none";
+        }
+    }
+
+    DeltaMode parseDeltaMode(const string &name)
+    {
+        if(name == "xor")
+            return XorDelta;
+        else if(name == "diff")
+            return DiffDelta;
+        else if(name == "dict")
+            return DictDelta;
+        else if(name == "none")
+            return NoDelta;
+
+        stringstream message;
+        message << "Unknown delta mode " << name;
+        throw runtime_error(message.str());
+    }
+
+    // Wrapping integer difference of each word; this is lossless for
+    // floating-point data as well, since the bit patterns (rather
+    // than the values) are subtracted
+    template<typename T>
+    void diffWords(char *target, const char *reference, size_t byteLength, bool encode)
+    {
+        for(size_t i(0); i + sizeof(T) <= byteLength; i += sizeof(T))
+        {
+            T word, refWord;
+            memcpy(&word, target + i, sizeof(T));
+            memcpy(&refWord, reference + i, sizeof(T));
+            word = encode? T(word - refWord): T(word + refWord);
+            memcpy(target + i, &word, sizeof(T));
+        }
+    }
+
+    void deltaTransform(DeltaMode mode, size_t width, char *target,
+                        const char *reference, size_t byteLength, bool encode)
+    {
+        switch(mode)
+        {
+        case XorDelta:
+            for(size_t i(0); i < byteLength; ++i)
+                target[i] ^= reference[i];
+            break;
+        case DiffDelta:
+            if(byteLength % width != 0)
+                throw runtime_error("Trying to delta-encode an incorrect number of bytes");
+
+            switch(width)
+            {
+            case 1:
+                diffWords<uint8_t>(target, reference, byteLength, encode);
+                break;
+            case 2:
+                diffWords<uint16_t>(target, reference, byteLength, encode);
+                break;
+            case 4:
+                diffWords<uint32_t>(target, reference, byteLength, encode);
+                break;
+            case 8:
+                diffWords<uint64_t>(target, reference, byteLength, encode);
+                break;
+            default:
+                stringstream message;
+                message << "Can't delta-encode words of width " << width;
+                throw runtime_error(message.str());
+            }
+            break;
+        case DictDelta:
+        case NoDelta:
+        default:
+            break;
+        }
+    }
+
+    void deltaEncode(DeltaMode mode, size_t width, char *target,
+                     const char *reference, size_t byteLength)
+    {
+        deltaTransform(mode, width, target, reference, byteLength, true);
+    }
+
+    void deltaDecode(DeltaMode mode, size_t width, char *target,
+                     const char *reference, size_t byteLength)
+    {
+        deltaTransform(mode, width, target, reference, byteLength, false);
+    }
+
+    string shuffleModeName(ShuffleMode mode)
+    {
+        switch(mode)
+        {
+        case ByteShuffle:
+            return "byte";
+        case BitShuffle:
+            return "bit";
+        case NoShuffle:
+        default:
+            return "none";
+        }
+    }
+
+    ShuffleMode parseShuffleMode(const string &name)
+    {
+        if(name == "byte")
+            return ByteShuffle;
+        else if(name == "bit")
+            return BitShuffle;
+        else if(name == "none")
+            return NoShuffle;
+
+        stringstream message;
+        message << "Unknown shuffle mode " << name;
+        throw runtime_error(message.str());
+    }
+
+#ifdef GTAR_USE_SSE2
+    // Interleave the bytes of a pair of registers; applied to the
+    // 32 bytes (a, b) this rotates the 5-bit index of each byte left
+    // by one bit
+    inline void unpackPair(__m128i &a, __m128i &b)
+    {
+        const __m128i lo(_mm_unpacklo_epi8(a, b));
+        const __m128i hi(_mm_unpackhi_epi8(a, b));
+        a = lo;
+        b = hi;
+    }
+
+    // Transpose a 4x4 matrix of 32-bit words held in four registers
+    inline void transpose32(__m128i &a, __m128i &b, __m128i &c, __m128i &d)
+    {
+        const __m128i t0(_mm_unpacklo_epi32(a, b));
+        const __m128i t1(_mm_unpacklo_epi32(c, d));
+        const __m128i t2(_mm_unpackhi_epi32(a, b));
+        const __m128i t3(_mm_unpackhi_epi32(c, d));
+        a = _mm_unpacklo_epi64(t0, t1);
+        b = _mm_unpackhi_epi64(t0, t1);
+        c = _mm_unpacklo_epi64(t2, t3);
+        d = _mm_unpackhi_epi64(t2, t3);
+    }
+
+    // Byte-shuffle blocks of 16 words; returns the number of words
+    // which were handled
+    size_t byteShuffleSSE2(size_t width, const char *source, char *target, size_t count)
+    {
+        const size_t blocks(count/16);
+
+        if(width == 4)
+        {
+            for(size_t block(0); block < blocks; ++block)
+            {
+                const __m128i *src((const __m128i*) (source + 64*block));
+                __m128i r[4];
+                for(size_t k(0); k < 4; ++k)
+                    r[k] = _mm_loadu_si128(src + k);
+
+                // each pair holds 8 words; three rounds move byte b
+                // of word e from position 4e + b to 8b + e
+                for(size_t round(0); round < 3; ++round)
+                {
+                    unpackPair(r[0], r[1]);
+                    unpackPair(r[2], r[3]);
+                }
+
+                for(size_t k(0); k < 2; ++k)
+                {
+                    _mm_storeu_si128((__m128i*) (target + (2*k)*count + 16*block),
+                                     _mm_unpacklo_epi64(r[k], r[k + 2]));
+                    _mm_storeu_si128((__m128i*) (target + (2*k + 1)*count + 16*block),
+                                     _mm_unpackhi_epi64(r[k], r[k + 2]));
+                }
+            }
+        }
+        else if(width == 8)
+        {
+            for(size_t block(0); block < blocks; ++block)
+            {
+                const __m128i *src((const __m128i*) (source + 128*block));
+                __m128i r[8];
+                for(size_t k(0); k < 8; ++k)
+                    r[k] = _mm_loadu_si128(src + k);
+
+                // each pair holds 4 words; two rounds move byte b
+                // of word e from position 8e + b to 4b + e
+                for(size_t round(0); round < 2; ++round)
+                    for(size_t k(0); k < 8; k += 2)
+                        unpackPair(r[k], r[k + 1]);
+
+                transpose32(r[0], r[2], r[4], r[6]);
+                transpose32(r[1], r[3], r[5], r[7]);
+
+                for(size_t k(0); k < 4; ++k)
+                {
+                    _mm_storeu_si128((__m128i*) (target + k*count + 16*block), r[2*k]);
+                    _mm_storeu_si128((__m128i*) (target + (k + 4)*count + 16*block), r[2*k + 1]);
+                }
+            }
+        }
+        else
+            return 0;
+
+        return 16*blocks;
+    }
+
+    // Inverse of byteShuffleSSE2
+    size_t byteUnshuffleSSE2(size_t width, const char *source, char *target, size_t count)
+    {
+        const size_t blocks(count/16);
+
+        if(width == 4)
+        {
+            for(size_t block(0); block < blocks; ++block)
+            {
+                __m128i o[4];
+                for(size_t k(0); k < 4; ++k)
+                    o[k] = _mm_loadu_si128((const __m128i*) (source + k*count + 16*block));
+
+                __m128i r[4];
+                r[0] = _mm_unpacklo_epi64(o[0], o[1]);
+                r[1] = _mm_unpacklo_epi64(o[2], o[3]);
+                r[2] = _mm_unpackhi_epi64(o[0], o[1]);
+                r[3] = _mm_unpackhi_epi64(o[2], o[3]);
+
+                // two more rounds complete the 5-bit rotation
+                for(size_t round(0); round < 2; ++round)
+                {
+                    unpackPair(r[0], r[1]);
+                    unpackPair(r[2], r[3]);
+                }
+
+                __m128i *dest((__m128i*) (target + 64*block));
+                for(size_t k(0); k < 4; ++k)
+                    _mm_storeu_si128(dest + k, r[k]);
+            }
+        }
+        else if(width == 8)
+        {
+            for(size_t block(0); block < blocks; ++block)
+            {
+                __m128i r[8];
+                for(size_t k(0); k < 4; ++k)
+                {
+                    r[2*k] = _mm_loadu_si128((const __m128i*) (source + k*count + 16*block));
+                    r[2*k + 1] = _mm_loadu_si128((const __m128i*) (source + (k + 4)*count + 16*block));
+                }
+
+                transpose32(r[0], r[2], r[4], r[6]);
+                transpose32(r[1], r[3], r[5], r[7]);
+
+                // three more rounds complete the 5-bit rotation
+                for(size_t round(0); round < 3; ++round)
+                    for(size_t k(0); k < 8; k += 2)
+                        unpackPair(r[k], r[k + 1]);
+
+                __m128i *dest((__m128i*) (target + 128*block));
+                for(size_t k(0); k < 8; ++k)
+                    _mm_storeu_si128(dest + k, r[k]);
+            }
+        }
+        else
+            return 0;
+
+        return 16*blocks;
+    }
+#endif
+
+    void byteShuffle(size_t width, const char *source, char *target, size_t count)
+    {
+        size_t start(0);
+#ifdef GTAR_USE_SSE2
+        start = byteShuffleSSE2(width, source, target, count);
+#endif
+        for(size_t i(start); i < count; ++i)
+            for(size_t b(0); b < width; ++b)
+                target[b*count + i] = source[i*width + b];
+    }
+
+    void byteUnshuffle(size_t width, const char *source, char *target, size_t count)
+    {
+        size_t start(0);
+#ifdef GTAR_USE_SSE2
+        start = byteUnshuffleSSE2(width, source, target, count);
+#endif
+        for(size_t i(start); i < count; ++i)
+            for(size_t b(0); b < width; ++b)
+                target[i*width + b] = source[b*count + i];
+    }
+
+    // Transpose an 8x8 matrix of bits, where bit j of byte i of the
+    // input becomes bit i of byte j of the output
+    inline uint64_t transposeBits(uint64_t x)
+    {
+        uint64_t t;
+        t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+        x = x ^ t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+        x = x ^ t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+        x = x ^ t ^ (t << 28);
+        return x;
+    }
+
+    // Group bit j of every byte of each plane (of length count) into
+    // a contiguous run of bytes; bytes past the last multiple of 8
+    // in each plane are copied unchanged
+    void bitTranspose(const char *source, char *target, size_t planes,
+                      size_t count, bool encode)
+    {
+        const size_t blocks(count/8);
+
+        for(size_t plane(0); plane < planes; ++plane)
+        {
+            const unsigned char *src((const unsigned char*) source + plane*count);
+            unsigned char *dest((unsigned char*) target + plane*count);
+            size_t start(0);
+
+#ifdef GTAR_USE_SSE2
+            // handle pairs of blocks at once: movemask gathers the
+            // high bit of each of 16 bytes
+            const __m128i bitSelect(_mm_set_epi8(
+                (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01));
+
+            for(; start + 2 <= blocks; start += 2)
+            {
+                if(encode)
+                {
+                    __m128i x(_mm_loadu_si128((const __m128i*) (src + 8*start)));
+                    for(size_t j(8); j > 0; --j)
+                    {
+                        const int mask(_mm_movemask_epi8(x));
+                        dest[(j - 1)*blocks + start] = mask & 0xff;
+                        dest[(j - 1)*blocks + start + 1] = (mask >> 8) & 0xff;
+                        x = _mm_slli_epi16(x, 1);
+                    }
+                }
+                else
+                {
+                    __m128i x(_mm_setzero_si128());
+                    for(size_t j(0); j < 8; ++j)
+                    {
+                        const __m128i spread(_mm_unpacklo_epi64(
+                            _mm_set1_epi8((char) src[j*blocks + start]),
+                            _mm_set1_epi8((char) src[j*blocks + start + 1])));
+                        const __m128i isSet(_mm_cmpeq_epi8(_mm_and_si128(spread, bitSelect), bitSelect));
+                        x = _mm_or_si128(x, _mm_and_si128(isSet, _mm_set1_epi8((char) (1 << j))));
+                    }
+                    _mm_storeu_si128((__m128i*) (dest + 8*start), x);
+                }
+            }
+#endif
+
+            for(size_t block(start); block < blocks; ++block)
+            {
+                uint64_t x(0);
+                for(size_t i(0); i < 8; ++i)
+                    x |= (uint64_t) (encode? src[8*block + i]: src[i*blocks + block]) << (8*i);
+
+                x = transposeBits(x);
+
+                for(size_t j(0); j < 8; ++j)
+                {
+                    const unsigned char byte((x >> (8*j)) & 0xff);
+                    if(encode)
+                        dest[j*blocks + block] = byte;
+                    else
+                        dest[8*block + j] = byte;
+                }
+            }
+
+            memcpy(dest + 8*blocks, src + 8*blocks, count - 8*blocks);
+        }
+    }
+
+    void shuffleEncode(ShuffleMode mode, size_t width, const char *source,
+                       char *target, size_t byteLength)
+    {
+        const size_t count(width? byteLength/width: 0);
+
+        switch(mode)
+        {
+        case ByteShuffle:
+            byteShuffle(width, source, target, count);
+            break;
+        case BitShuffle:
+        {
+            vector<char> bytes(count*width);
+            byteShuffle(width, source, bytes.size()? &bytes[0]: NULL, count);
+            bitTranspose(bytes.size()? &bytes[0]: NULL, target, width, count, true);
+        }
+            break;
+        case NoShuffle:
+        default:
+            memcpy(target, source, count*width);
+        }
+
+        memcpy(target + count*width, source + count*width, byteLength - count*width);
+    }
+
+    void shuffleDecode(ShuffleMode mode, size_t width, const char *source,
+                       char *target, size_t byteLength)
+    {
+        const size_t count(width? byteLength/width: 0);
+
+        switch(mode)
+        {
+        case ByteShuffle:
+            byteUnshuffle(width, source, target, count);
+            break;
+        case BitShuffle:
+        {
+            vector<char> bytes(count*width);
+            bitTranspose(source, bytes.size()? &bytes[0]: NULL, width, count, false);
+            byteUnshuffle(width, bytes.size()? &bytes[0]: NULL, target, count);
+        }
+            break;
+        case NoShuffle:
+        default:
+            memcpy(target, source, count*width);
+        }
+
+        memcpy(target + count*width, source + count*width, byteLength - count*width);
+    }
+
+    template<typename T>
+    T dequantizeWord(double step, int32_t stored)
+    {
+        return (T) (stored*step);
+    }
+
+    template<typename T>
+    bool quantizeWords(double tolerance, const char *source, char *target, size_t count,
+                       double &quantizedTolerance)
+    {
+        // rounding the dequantized values to T adds up to half of
+        // its precision at their magnitude, so the values are
+        // quantized with a smaller tolerance to leave room for it
+        double maxMagnitude(0);
+        for(size_t i(0); i < count; ++i)
+        {
+            T value;
+            memcpy(&value, source + i*sizeof(T), sizeof(T));
+            // written so that NaN fails as well
+            if(!(fabs((double) value) <= DBL_MAX))
+                return false;
+            maxMagnitude = std::max(maxMagnitude, fabs((double) value));
+        }
+
+        // the relative margin is rounded up to a power of two so that
+        // frames of similar magnitude are quantized alike (and can be
+        // delta encoded against each other)
+        int exponent(0);
+        frexp((maxMagnitude + tolerance)*std::numeric_limits<T>::epsilon()/tolerance, &exponent);
+        quantizedTolerance = tolerance*(1 - ldexp(1.0, exponent));
+        if(!(quantizedTolerance >= 0.5*tolerance))
+            return false;
+
+        const double step(2*quantizedTolerance);
+        for(size_t i(0); i < count; ++i)
+        {
+            T value;
+            memcpy(&value, source + i*sizeof(T), sizeof(T));
+
+            const double level(floor(value/step + 0.5));
+            if(!(level >= -2147483647.0 && level <= 2147483647.0))
+                return false;
+
+            const int32_t stored((int32_t) level);
+
+            // check the value exactly as it will be read back
+            if(!(fabs((double) dequantizeWord<T>(step, stored) - (double) value) <= tolerance))
+                return false;
+
+            memcpy(target + i*sizeof(int32_t), &stored, sizeof(int32_t));
+        }
+
+        return true;
+    }
+
+    template<typename T>
+    void dequantizeWords(double step, const char *source, char *target, size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+        {
+            int32_t stored;
+            memcpy(&stored, source + i*sizeof(int32_t), sizeof(int32_t));
+
+            const T value(dequantizeWord<T>(step, stored));
+            memcpy(target + i*sizeof(T), &value, sizeof(T));
+        }
+    }
+
+    bool quantizeEncode(double tolerance, size_t width, const char *source,
+                        char *target, size_t count, double &quantizedTolerance)
+    {
+        switch(width)
+        {
+        case 4:
+            return quantizeWords<float>(tolerance, source, target, count, quantizedTolerance);
+        case 8:
+            return quantizeWords<double>(tolerance, source, target, count, quantizedTolerance);
+        default:
+            return false;
+        }
+    }
+
+    void quantizeDecode(double tolerance, size_t width, const char *source,
+                        char *target, size_t count)
+    {
+        const double step(2*tolerance);
+
+        switch(width)
+        {
+        case 4:
+            dequantizeWords<float>(step, source, target, count);
+            break;
+        case 8:
+            dequantizeWords<double>(step, source, target, count);
+            break;
+        default:
+            stringstream message;
+            message << "Can't dequantize values of width " << width;
+            throw runtime_error(message.str());
+        }
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
@@ -0,0 +1,113 @@
+// Filter.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <map>
+#include <string>
+
+#ifndef __FILTER_HPP_
+#define __FILTER_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Ways in which consecutive frames of a record can be stored
+    /// relative to the previous frame of the same record. DictDelta
+    /// leaves the contents alone and instead compresses each frame
+    /// using the previous one as a dictionary.
+    enum DeltaMode {NoDelta, XorDelta, DiffDelta, DictDelta};
+
+    /// Ways in which the bytes of multi-byte words can be rearranged
+    /// to make them more compressible
+    enum ShuffleMode {NoShuffle, ByteShuffle, BitShuffle};
+
+    /// Header prepended to the stored contents of records which have
+    /// been transformed by one or more filters before being handed to
+    /// the archive backend. Records which are not filtered are stored
+    /// untouched and carry no header.
+    class FilterHeader
+    {
+    public:
+        /// Default constructor: create a header with no fields
+        FilterHeader();
+
+        /// Parse a header from the beginning of the given buffer.
+        /// Returns the number of bytes taken up by the header, or 0 if
+        /// the buffer does not begin with a filter header.
+        size_t parse(const char *bytes, size_t byteLength);
+
+        /// Serialize this header into the bytes which should be
+        /// prepended to the filtered contents of a record
+        std::string serialize() const;
+
+        /// Returns true if the given field is set
+        bool has(const std::string &key) const;
+        /// Returns the value of the given field, or the empty string
+        /// if it is not set
+        std::string get(const std::string &key) const;
+        /// Set the value of the given field
+        void set(const std::string &key, const std::string &value);
+
+    private:
+        /// Stored key/value fields of the header
+        std::map<std::string, std::string> m_fields;
+    };
+
+    /// Return the name of a delta mode as stored in a FilterHeader
+    std::string deltaModeName(DeltaMode mode);
+    /// Parse the name of a delta mode as stored in a FilterHeader
+    DeltaMode parseDeltaMode(const std::string &name);
+
+    /// Encode target in place relative to reference, treating both as
+    /// arrays of little-endian words of the given width (in
+    /// bytes). DictDelta leaves target unchanged.
+    void deltaEncode(DeltaMode mode, size_t width, char *target,
+                     const char *reference, size_t byteLength);
+    /// Undo deltaEncode() in place, given the same reference
+    void deltaDecode(DeltaMode mode, size_t width, char *target,
+                     const char *reference, size_t byteLength);
+
+    /// Return the name of a shuffle mode as stored in a FilterHeader
+    std::string shuffleModeName(ShuffleMode mode);
+    /// Parse the name of a shuffle mode as stored in a FilterHeader
+    ShuffleMode parseShuffleMode(const std::string &name);
+
+    /// Rearrange source, treated as an array of words of the given
+    /// width (in bytes), into target such that the first byte of
+    /// every word is stored first, then the second byte of every
+    /// word, and so on. BitShuffle additionally groups each bit of
+    /// those bytes together. Any bytes past the last whole word are
+    /// copied unchanged.
+    void shuffleEncode(ShuffleMode mode, size_t width, const char *source,
+                       char *target, size_t byteLength);
+    /// Undo shuffleEncode(), writing the original words into target
+    void shuffleDecode(ShuffleMode mode, size_t width, const char *source,
+                       char *target, size_t byteLength);
+
+    /// Quantize count floating-point values of the given width (4 for
+    /// float, 8 for double) from source to multiples of
+    /// 2*quantizedTolerance, storing the multiples as 32-bit
+    /// little-endian integers in target. quantizedTolerance is set
+    /// somewhat smaller than tolerance, so that every value
+    /// quantizeDecode() gives back (given quantizedTolerance) is
+    /// within tolerance of the original, including the rounding of
+    /// the stored type. Returns false if any value is not finite, is
+    /// too large to be represented, or can't be read back within
+    /// tolerance, in which case the contents of target are
+    /// unspecified.
+    bool quantizeEncode(double tolerance, size_t width, const char *source,
+                        char *target, size_t count, double &quantizedTolerance);
+    /// Undo quantizeEncode(), writing count values of the given width
+    /// into target, given the quantizedTolerance it returned
+    void quantizeDecode(double tolerance, size_t width, const char *source,
+                        char *target, size_t count);
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
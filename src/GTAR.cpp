@@ -1,27 +1,146 @@
 // GTAR.cpp
 // by Matthew Spellings <mspells@umich.edu>
 
+#include "Deflate.hpp"
 #include "GTAR.hpp"
 #include "SharedArray.hpp"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <sstream>
 #include <stdexcept>
 #include <stdint.h>
 #include <sys/stat.h>
 
+// Archives are merged on several threads if C++11 threads are
+// available
+#if __cplusplus > 199711L
+#define GTAR_USE_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
 #ifdef GTAR_NAMESPACE_PARENT
 namespace GTAR_NAMESPACE_PARENT{
 #endif
 
 namespace gtar{
 
+    using std::make_pair;
     using std::map;
+    using std::max;
+    using std::pair;
     using std::runtime_error;
     using std::set;
     using std::string;
+    using std::stringstream;
     using std::swap;
     using std::vector;
 
+    // Find the setting for the given record name, falling back to
+    // the archive-wide setting stored under the empty name
+    template<typename T>
+    T findSetting(const map<string, T> &settings, const string &name, const T &fallback)
+    {
+        typename map<string, T>::const_iterator iter(settings.find(name));
+
+        if(iter == settings.end())
+            iter = settings.find("");
+
+        return iter == settings.end()? fallback: iter->second;
+    }
+
+    // Identifies strings written by GTAR::exportIndex() and the
+    // version of their layout
+    static const char INDEX_MAGIC[] = "getaridx";
+    static const uint64_t INDEX_VERSION = 1;
+
+    // Append an unsigned integer to an index in groups of 7 bits,
+    // least significant first
+    static void putIndexInt(string &target, uint64_t value)
+    {
+        while(value >= 0x80)
+        {
+            target.push_back((char) ((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        target.push_back((char) value);
+    }
+
+    // Append a string to an index, preceded by its length
+    static void putIndexString(string &target, const string &value)
+    {
+        putIndexInt(target, value.size());
+        target.append(value);
+    }
+
+    // Reads the integers and strings of an index in the order they
+    // were appended, throwing if it ends too soon
+    class IndexReader
+    {
+    public:
+        IndexReader(const string &source, size_t position):
+            m_source(source), m_position(position)
+        {}
+
+        uint64_t readInt()
+        {
+            uint64_t result(0);
+            for(unsigned int shift(0); shift < 64; shift += 7)
+            {
+                if(m_position >= m_source.size())
+                    fail();
+
+                const unsigned char byte(m_source[m_position++]);
+                result |= ((uint64_t) (byte & 0x7f)) << shift;
+                if(!(byte & 0x80))
+                    return result;
+            }
+
+            fail();
+            return result;
+        }
+
+        string readString()
+        {
+            const uint64_t length(readInt());
+            if(length > m_source.size() - m_position)
+                fail();
+
+            const string result(m_source, m_position, length);
+            m_position += length;
+            return result;
+        }
+
+    private:
+        void fail() const
+        {
+            throw runtime_error("Archive index is truncated or corrupt");
+        }
+
+        const string &m_source;
+        size_t m_position;
+    };
+
+    // Split the path of a record type around the position of its
+    // index, so that the path of a record of that type with any
+    // index is the first part, the index, and then the second part
+    static pair<string, string> pathTemplate(const Record &type)
+    {
+        Record marked(type);
+        marked.setIndex(string(1, '\0'));
+        const string path(marked.getPath());
+        const size_t split(path.find('\0'));
+
+        if(split == string::npos)
+            return make_pair(path, string());
+
+        return make_pair(path.substr(0, split), path.substr(split + 1));
+    }
+
     bool littleEndian()
     {
         int x(1);
@@ -62,9 +181,19 @@ namespace gtar{
         m_archive.writePtr(path, contents, byteLength, mode, false);
     }
 
-    GTAR::GTAR(const string &filename, const OpenMode mode):
-        m_archive(), m_records(), m_indexedRecords()
+    void GTAR::BulkWriter::writeStrided(const string &path, const void *contents,
+                                        size_t elementSize, const vector<size_t> &shape,
+                                        const vector<ptrdiff_t> &strides, CompressMode mode)
+    {
+        m_archive.writeStrided(path, contents, elementSize, shape, strides, mode, false);
+    }
+
+    GTAR::GTAR(const string &filename, const OpenMode mode, const string &index):
+        m_filename(filename), m_mode(mode), m_archive(), m_records(), m_indexedRecords(),
+        m_deltaModes(), m_shuffleModes(), m_quantizeTolerances(), m_codecs(), m_deltaStates(),
+        m_deltaReads(), m_cache(), m_sharedCache(), m_closedStats(), m_recordStats()
     {
+        TraceSpan span("open", &filename);
         OpenMode realMode(mode);
 
         if(mode == Append)
@@ -77,26 +206,57 @@ namespace gtar{
                 realMode = Write;
         }
 
+        ArchiveIndex entries;
+        const bool indexed(realMode == Read && !index.empty() && loadIndex(index, entries));
+
         if(filename.length() >= 4 && filename.rfind(".tar") == filename.length() - 4)
-            m_archive.reset(new TarArchive(filename, realMode));
+            m_archive.reset(new TarArchive(filename, realMode, indexed? &entries: NULL));
         else if(filename.length() >= 1 && filename.rfind("/") == filename.length() - 1)
             m_archive.reset(new DirArchive(filename, realMode));
         else if(filename.length() >= 7 && filename.rfind(".sqlite") == filename.length() - 7)
         {
-            m_archive.reset(new SqliteArchive(filename, realMode));
+            m_archive.reset(new SqliteArchive(filename, realMode, indexed? &entries: NULL));
         }
         else
             m_archive.reset(new ZipArchive(filename, realMode));
 
-        // Populate our record list unconditionally
-        const unsigned int size(m_archive->size());
-        for(unsigned int index(0); index < size; ++index)
-            insertRecord(m_archive->getItemName(index));
+        // Populate our record list unless the index already did
+        if(!indexed)
+        {
+            const unsigned int size(m_archive->size());
+            for(unsigned int index(0); index < size; ++index)
+                insertRecord(m_archive->getItemName(index));
+        }
+    }
+
+    GTAR::~GTAR()
+    {
+        // errors writing a trace can't be reported here
+        try
+        {
+            close();
+        }
+        catch(...)
+        {
+        }
     }
 
     void GTAR::close()
     {
-        m_archive.reset();
+        if(m_archive.get())
+        {
+            {
+                TraceSpan span("close");
+                // keep the counters, including the work done to close
+                m_archive->close();
+                m_closedStats = m_archive->stats();
+                m_archive.reset();
+                m_cache.clear();
+                m_sharedCache.reset();
+            }
+
+            writeTrace();
+        }
     }
 
     void GTAR::writeString(const string &path, const string &contents,
@@ -117,14 +277,18 @@ namespace gtar{
         writePtr(path, contents, byteLength, mode, true);
     }
 
+    void GTAR::writeStrided(const string &path, const void *contents,
+                            size_t elementSize, const vector<size_t> &shape,
+                            const vector<ptrdiff_t> &strides, CompressMode mode)
+    {
+        writeStrided(path, contents, elementSize, shape, strides, mode, true);
+    }
+
     void GTAR::writeString(const string &path, const string &contents,
                            CompressMode mode, bool immediate)
     {
         if(m_archive.get())
-        {
-            m_archive->writePtr(path, contents.data(), contents.size(), mode, immediate);
-            insertRecord(path);
-        }
+            writePtr(path, contents.data(), contents.size(), mode, immediate);
         else
             throw runtime_error("Calling writeString() with a closed GTAR object");
     }
@@ -133,10 +297,8 @@ namespace gtar{
                           CompressMode mode, bool immediate)
     {
         if(m_archive.get())
-        {
-            m_archive->writeVec(path, contents, mode, immediate);
-            insertRecord(path);
-        }
+            writePtr(path, contents.size()? &contents[0]: NULL, contents.size(),
+                     mode, immediate);
         else
             throw runtime_error("Calling writeBytes() with a closed GTAR object");
     }
@@ -146,13 +308,114 @@ namespace gtar{
     {
         if(m_archive.get())
         {
-            m_archive->writePtr(path, contents, byteLength, mode, immediate);
+            TraceSpan span("write", &path);
+            const ArchiveStats before(m_archive->stats());
+            const Record rec(path);
+            const pair<int, int> setting(
+                findSetting(m_codecs, rec.getName(), make_pair(-1, -1)));
+            const Codec *codec(setting.first >= 0 && mode != NoCompress?
+                               &getCodec(setting.first): NULL);
+            int level(codec && setting.second < 0? codec->defaultLevel(mode): setting.second);
+
+            // compressing against the previous frame needs a codec
+            // which supports dictionaries, applied as a filter
+            const bool dictionary(
+                mode != NoCompress && rec.getResolution() == Individual &&
+                findSetting(m_deltaModes, rec.getName(), make_pair(NoDelta, 0u)).first == DictDelta);
+            if(dictionary && (!codec || !codec->usesDictionary()))
+            {
+                codec = &getCodec(LZ4Codec);
+                level = codec->defaultLevel(mode);
+            }
+
+            // codecs the backend can't store itself are applied as a
+            // filter instead
+            const bool nativeCodec(codec && !dictionary && m_archive->storesCodec(codec->id()));
+
+            vector<char> encoded;
+            bool isEncoded(false);
+            {
+                ScopedTimer timer(m_archive->stats().compressTime, "encode", &path);
+                isEncoded = encodeRecord(path, (const char*) contents, byteLength,
+                                         nativeCodec? NULL: codec, level, encoded);
+            }
+            const void *stored(isEncoded? &encoded[0]: contents);
+            const size_t storedLength(isEncoded? encoded.size(): byteLength);
+
+            if(nativeCodec)
+                m_archive->writeCodec(path, stored, storedLength, codec->id(), level, immediate);
+            else if(codec)
+                m_archive->writePtr(path, stored, storedLength, NoCompress, immediate);
+            else
+                m_archive->writePtr(path, stored, storedLength, mode, immediate);
+
+            // count the bytes we were given rather than the filtered
+            // ones the archive stored
+            ArchiveStats &stats(m_archive->stats());
+            stats.uncompressedBytesWritten =
+                stats.uncompressedBytesWritten + byteLength - storedLength;
+
             insertRecord(path);
+            addRecordStats(path, before);
         }
         else
             throw runtime_error("Calling writePtr() with a closed GTAR object");
     }
 
+    // Copy the elements of an ndim-dimensional strided array into
+    // target in C order, returning the end of what was copied
+    static char *gatherStrided(const char *source, size_t elementSize, const size_t *shape,
+                               const ptrdiff_t *strides, size_t ndim, char *target)
+    {
+        if(!ndim)
+        {
+            memcpy(target, source, elementSize);
+            return target + elementSize;
+        }
+        else if(ndim == 1 && strides[0] == (ptrdiff_t) elementSize)
+        {
+            memcpy(target, source, shape[0]*elementSize);
+            return target + shape[0]*elementSize;
+        }
+        else if(ndim == 1)
+        {
+            for(size_t i(0); i < shape[0]; ++i, source += strides[0], target += elementSize)
+                memcpy(target, source, elementSize);
+            return target;
+        }
+
+        for(size_t i(0); i < shape[0]; ++i, source += strides[0])
+            target = gatherStrided(source, elementSize, shape + 1, strides + 1,
+                                   ndim - 1, target);
+        return target;
+    }
+
+    void GTAR::writeStrided(const string &path, const void *contents,
+                            size_t elementSize, const vector<size_t> &shape,
+                            const vector<ptrdiff_t> &strides, CompressMode mode,
+                            bool immediate)
+    {
+        if(shape.size() != strides.size())
+        {
+            stringstream result;
+            result << "Mismatched shape and strides (" << shape.size() << " and " <<
+                strides.size() << " dimensions) writing " << path;
+            throw runtime_error(result.str());
+        }
+
+        size_t byteLength(elementSize);
+        for(size_t i(0); i < shape.size(); ++i)
+            byteLength *= shape[i];
+
+        vector<char> gathered(byteLength);
+        if(byteLength)
+            gatherStrided((const char*) contents, elementSize,
+                          shape.size()? &shape[0]: NULL, strides.size()? &strides[0]: NULL,
+                          shape.size(), &gathered[0]);
+
+        writePtr(path, byteLength? &gathered[0]: NULL, byteLength, mode, immediate);
+    }
+
     void GTAR::beginBulkWrites()
     {
         if(m_archive.get())
@@ -170,11 +433,730 @@ namespace gtar{
     }
 
     SharedArray<char> GTAR::readBytes(const string &path)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling readBytes() with a closed GTAR object");
+
+        TraceSpan span("read", &path);
+        const ArchiveStats before(m_archive->stats());
+        const double start(monotonicSeconds());
+
+        SharedArray<char> result;
+        if(m_cache.capacity())
+        {
+            ArchiveStats &stats(m_archive->stats());
+            if(m_cache.find(path, result))
+            {
+                ++stats.cacheHits;
+                stats.uncompressedBytesRead += result.size();
+                addRecordStats(path, before);
+                return result;
+            }
+            ++stats.cacheMisses;
+        }
+
+        const string sharedKey(m_sharedCache.get()? sharedCacheKey(path): string());
+        if(m_sharedCache.get())
+        {
+            ArchiveStats &stats(m_archive->stats());
+            if(m_sharedCache->find(sharedKey, result))
+            {
+                ++stats.sharedCacheHits;
+                stats.uncompressedBytesRead += result.size();
+                if(m_cache.capacity())
+                    m_cache.insert(path, result);
+                addRecordStats(path, before);
+                return result;
+            }
+            ++stats.sharedCacheMisses;
+        }
+
+        result = decodeRecord(path, 0);
+
+        if(m_cache.capacity())
+            m_cache.insert(path, result);
+        if(m_sharedCache.get())
+            m_sharedCache->insert(sharedKey, result);
+
+        // time not spent by the archive itself went to undoing
+        // filters, and the bytes we return are the uncompressed ones
+        ArchiveStats &stats(m_archive->stats());
+        const double archiveTime(
+            (stats.compressTime - before.compressTime) +
+            (stats.decompressTime - before.decompressTime) +
+            (stats.ioTime - before.ioTime));
+        stats.decompressTime += max(0.0, monotonicSeconds() - start - archiveTime);
+        stats.uncompressedBytesRead = before.uncompressedBytesRead + result.size();
+
+        addRecordStats(path, before);
+        return result;
+    }
+
+    void GTAR::readBytesInto(const string &path, void *target, size_t byteLength)
+    {
+        SharedArray<char> contents(readBytes(path));
+
+        if(contents.size() != byteLength)
+        {
+            stringstream message;
+            message << "Error reading " << path << ": expected " << byteLength
+                    << " bytes but found " << contents.size();
+            throw runtime_error(message.str());
+        }
+
+        if(byteLength)
+            memcpy(target, contents.get(), byteLength);
+    }
+
+    void GTAR::readFrames(const Record &record, const vector<string> &frames,
+                          void *target, size_t frameLength)
+    {
+        Record rec(record);
+
+        for(size_t i(0); i < frames.size(); ++i)
+        {
+            rec.setIndex(frames[i]);
+            readBytesInto(rec.getPath(), (char*) target + i*frameLength, frameLength);
+        }
+    }
+
+    void GTAR::copyRecords(GTAR &source, const vector<string> &paths, CompressMode mode)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling copyRecords() with a closed GTAR object");
+        else if(!source.m_archive.get())
+            throw runtime_error("Calling copyRecords() from a closed GTAR object");
+        else if(&source == this)
+            throw runtime_error("Can't copy records from an archive into itself");
+
+        m_archive->beginBulkWrites();
+
+        try
+        {
+            for(vector<string>::const_iterator iter(paths.begin());
+                iter != paths.end(); ++iter)
+            {
+                TraceSpan span("copy", &*iter);
+                const RawRecord raw(source.m_archive->readRaw(*iter));
+                const ArchiveStats before(m_archive->stats());
+
+                if(raw.codec == NoCodec || !m_archive->writeRaw(*iter, raw, false))
+                {
+                    SharedArray<char> contents;
+                    {
+                        ScopedTimer timer(m_archive->stats().decompressTime, "decompress", &*iter);
+                        contents = decodeRaw(raw);
+                    }
+                    m_archive->writePtr(*iter, contents.get(), contents.size(), mode, false);
+                }
+
+                insertRecord(*iter);
+                addRecordStats(*iter, before);
+            }
+        }
+        catch(...)
+        {
+            m_archive->endBulkWrites();
+            throw;
+        }
+
+        m_archive->endBulkWrites();
+    }
+
+    // A record to be copied by mergeArchives()
+    struct MergeJob
+    {
+        MergeJob(const string &path_, size_t input_, bool decode_):
+            path(path_), input(input_), decode(decode_), state(0), raw(),
+            decompressTime(0), compressTime(0)
+        {}
+
+        // Path of the record
+        string path;
+        // Index of the input file to take it from
+        size_t input;
+        // Whether to undo any filters the record was stored with,
+        // since frames of the record come from several inputs and
+        // delta-encoded frames refer to others by path
+        bool decode;
+        // 0 until the record is read, 1 until it can be written, and
+        // then 2
+        int state;
+        // Contents of the record, as read and then as they will be
+        // written
+        RawRecord raw;
+        // Seconds spent decompressing and compressing the record
+        // before writing it, which are counted by the target archive
+        // as it is written
+        double decompressTime;
+        double compressTime;
+    };
+
+    // Input archives opened by one reader thread
+    class MergeSources
+    {
+    public:
+        MergeSources(const vector<string> &inputs):
+            m_inputs(inputs), m_sources(inputs.size(), NULL)
+        {}
+
+        ~MergeSources()
+        {
+            for(size_t i(0); i < m_sources.size(); ++i)
+                delete m_sources[i];
+        }
+
+        // Get the given input, opening it the first time
+        GTAR &get(size_t input)
+        {
+            if(!m_sources[input])
+                m_sources[input] = new GTAR(m_inputs[input], Read);
+            return *m_sources[input];
+        }
+
+    private:
+        // Not copyable
+        MergeSources(const MergeSources&);
+        void operator=(const MergeSources&);
+
+        const vector<string> &m_inputs;
+        vector<GTAR*> m_sources;
+    };
+
+    class GTAR::MergePipeline
+    {
+    public:
+        MergePipeline(GTAR &target, const vector<string> &inputs, vector<MergeJob> &jobs,
+                      CompressMode mode, unsigned int numThreads):
+            m_target(target), m_inputs(inputs), m_jobs(jobs), m_mode(mode),
+            m_numThreads(numThreads)
+#ifdef GTAR_USE_THREADS
+            , m_mutex(), m_changed(), m_window(0), m_nextRead(0), m_nextWrite(0),
+            m_numRead(0), m_readJobs(), m_error()
+#endif
+        {}
+
+        void run()
+        {
+            m_target.m_archive->beginBulkWrites();
+
+            try
+            {
+#ifdef GTAR_USE_THREADS
+                const unsigned int threads(deflateThreads(m_numThreads));
+                if(threads > 1 && m_jobs.size() > 1)
+                    runThreads(threads);
+                else
+#endif
+                {
+                    MergeSources sources(m_inputs);
+                    for(size_t i(0); i < m_jobs.size(); ++i)
+                    {
+                        readJob(m_jobs[i], sources);
+                        encodeJob(m_jobs[i]);
+                        writeJob(m_jobs[i]);
+                    }
+                }
+            }
+            catch(...)
+            {
+                m_target.m_archive->endBulkWrites();
+                throw;
+            }
+
+            m_target.m_archive->endBulkWrites();
+        }
+
+    private:
+        // Read the record of a job as it is stored, or with its
+        // filters undone if necessary
+        void readJob(MergeJob &job, MergeSources &sources)
+        {
+            GTAR &source(sources.get(job.input));
+
+            if(job.decode)
+            {
+                job.raw = RawRecord();
+                job.raw.pieces.push_back(source.readBytes(job.path));
+                job.raw.byteLength = job.raw.pieces.back().size();
+            }
+            else
+                job.raw = source.m_archive->readRaw(job.path);
+        }
+
+        // Decompress the record of a job and compress it again
+        // unless the target can store it as it is
+        void encodeJob(MergeJob &job) const
+        {
+            const Archive &target(*m_target.m_archive);
+
+            if(job.raw.codec == NoCodec || !target.storesRaw(job.raw))
+            {
+                SharedArray<char> contents;
+                {
+                    ScopedTimer timer(job.decompressTime, "decompress", &job.path);
+                    contents = decodeRaw(job.raw);
+                }
+                ScopedTimer timer(job.compressTime, "compress", &job.path);
+                job.raw = target.encodeRaw(contents, m_mode);
+            }
+        }
+
+        // Write the record of a job to the target and free it
+        void writeJob(MergeJob &job)
+        {
+            TraceSpan span("write", &job.path);
+            Archive &target(*m_target.m_archive);
+            const ArchiveStats before(target.stats());
+            target.stats().decompressTime += job.decompressTime;
+            target.stats().compressTime += job.compressTime;
+
+            if(job.raw.codec == NoCodec || !target.writeRaw(job.path, job.raw, false))
+            {
+                SharedArray<char> contents;
+                {
+                    ScopedTimer timer(target.stats().decompressTime, "decompress", &job.path);
+                    contents = decodeRaw(job.raw);
+                }
+                target.writePtr(job.path, contents.get(), contents.size(),
+                                job.raw.codec == NoCodec? NoCompress: m_mode, false);
+            }
+
+            m_target.insertRecord(job.path);
+            m_target.addRecordStats(job.path, before);
+            job.raw = RawRecord();
+        }
+
+#ifdef GTAR_USE_THREADS
+        void runThreads(unsigned int threads)
+        {
+            // reading is mostly waiting for the disk, so most of the
+            // threads compress
+            const unsigned int numReaders(max(1u, threads/4));
+            const unsigned int numEncoders(max(1u, threads - numReaders));
+            // bound the number of records held in memory at once
+            m_window = 4*threads;
+
+            vector<std::thread> pool;
+            for(unsigned int i(0); i < numReaders; ++i)
+                pool.push_back(std::thread(&MergePipeline::readRecords, this));
+            for(unsigned int i(0); i < numEncoders; ++i)
+                pool.push_back(std::thread(&MergePipeline::encodeRecords, this));
+
+            writeRecords();
+
+            for(size_t i(0); i < pool.size(); ++i)
+                pool[i].join();
+
+            if(!m_error.empty())
+                throw runtime_error(m_error);
+        }
+
+        void readRecords()
+        {
+            try
+            {
+                MergeSources sources(m_inputs);
+
+                while(true)
+                {
+                    size_t index(0);
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        while(m_error.empty() && m_nextRead < m_jobs.size() &&
+                              m_nextRead >= m_nextWrite + m_window)
+                            m_changed.wait(lock);
+
+                        if(!m_error.empty() || m_nextRead >= m_jobs.size())
+                            return;
+                        index = m_nextRead++;
+                    }
+
+                    readJob(m_jobs[index], sources);
+
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_jobs[index].state = 1;
+                    m_readJobs.push_back(index);
+                    ++m_numRead;
+                    m_changed.notify_all();
+                }
+            }
+            catch(std::exception &error)
+            {
+                fail(error.what());
+            }
+            catch(...)
+            {
+                fail(string());
+            }
+        }
+
+        void encodeRecords()
+        {
+            try
+            {
+                while(true)
+                {
+                    size_t index(0);
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        while(m_error.empty() && m_readJobs.empty() && m_numRead < m_jobs.size())
+                            m_changed.wait(lock);
+
+                        if(!m_error.empty() || m_readJobs.empty())
+                            return;
+                        index = m_readJobs.front();
+                        m_readJobs.pop_front();
+                    }
+
+                    encodeJob(m_jobs[index]);
+
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_jobs[index].state = 2;
+                    m_changed.notify_all();
+                }
+            }
+            catch(std::exception &error)
+            {
+                fail(error.what());
+            }
+            catch(...)
+            {
+                fail(string());
+            }
+        }
+
+        void writeRecords()
+        {
+            try
+            {
+                for(size_t index(0); index < m_jobs.size(); ++index)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        while(m_error.empty() && m_jobs[index].state < 2)
+                            m_changed.wait(lock);
+
+                        if(!m_error.empty())
+                            return;
+                    }
+
+                    writeJob(m_jobs[index]);
+
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_nextWrite = index + 1;
+                    m_changed.notify_all();
+                }
+            }
+            catch(std::exception &error)
+            {
+                fail(error.what());
+            }
+            catch(...)
+            {
+                fail(string());
+            }
+        }
+
+        // Record the first error and stop every thread
+        void fail(const string &error)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_error.empty())
+                m_error = error.empty()? string("Error merging archives"): error;
+            m_changed.notify_all();
+        }
+#endif
+
+        GTAR &m_target;
+        const vector<string> &m_inputs;
+        vector<MergeJob> &m_jobs;
+        const CompressMode m_mode;
+        const unsigned int m_numThreads;
+#ifdef GTAR_USE_THREADS
+        std::mutex m_mutex;
+        // Notified whenever the state of any job changes
+        std::condition_variable m_changed;
+        // Maximum number of jobs read but not yet written
+        size_t m_window;
+        // Index of the next job to read and of the next to write
+        size_t m_nextRead;
+        size_t m_nextWrite;
+        // Number of jobs which have been read
+        size_t m_numRead;
+        // Jobs which have been read but not compressed
+        std::deque<size_t> m_readJobs;
+        // Message of the first error, which stops every thread
+        string m_error;
+#endif
+    };
+
+    void GTAR::mergeArchives(const vector<string> &inputs, CompressMode mode,
+                             unsigned int numThreads)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling mergeArchives() with a closed GTAR object");
+
+        // find the last input with each path, and which inputs the
+        // frames of each record come from
+        map<string, size_t> pathInputs;
+        for(size_t i(0); i < inputs.size(); ++i)
+        {
+            GTAR source(inputs[i], Read);
+            const unsigned int size(source.m_archive->size());
+            for(unsigned int index(0); index < size; ++index)
+                pathInputs[source.m_archive->getItemName(index)] = i;
+        }
+
+        map<string, set<size_t> > recordInputs;
+        for(map<string, size_t>::const_iterator iter(pathInputs.begin());
+            iter != pathInputs.end(); ++iter)
+        {
+            Record rec(iter->first);
+            rec.nullifyIndex();
+            recordInputs[rec.getPath()].insert(iter->second);
+        }
+
+        vector<MergeJob> jobs;
+        for(map<string, size_t>::const_iterator iter(pathInputs.begin());
+            iter != pathInputs.end(); ++iter)
+        {
+            Record rec(iter->first);
+            rec.nullifyIndex();
+            jobs.push_back(MergeJob(iter->first, iter->second,
+                                    recordInputs[rec.getPath()].size() > 1));
+        }
+
+        // set up the codec registry before any threads use it
+        getCodec(NoCodec);
+
+        MergePipeline(*this, inputs, jobs, mode, numThreads).run();
+    }
+
+    void GTAR::setDelta(const string &name, DeltaMode mode,
+                        unsigned int keyframeInterval)
+    {
+        m_deltaModes[name] = make_pair(mode, keyframeInterval);
+    }
+
+    void GTAR::setShuffle(const string &name, ShuffleMode mode)
+    {
+        m_shuffleModes[name] = mode;
+    }
+
+    void GTAR::setQuantization(const string &name, double tolerance)
+    {
+        if(!(tolerance >= 0))
+        {
+            stringstream message;
+            message << "Invalid quantization tolerance " << tolerance;
+            throw runtime_error(message.str());
+        }
+
+        m_quantizeTolerances[name] = tolerance;
+    }
+
+    void GTAR::setCodec(const string &name, unsigned int codec, int level)
+    {
+        // check that the codec exists now rather than on every write
+        getCodec(codec);
+        m_codecs[name] = make_pair((int) codec, level);
+    }
+
+    void GTAR::setVerifyChecksums(bool verify)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling setVerifyChecksums() with a closed GTAR object");
+
+        m_archive->setVerifyChecksums(verify);
+    }
+
+    void GTAR::setNumThreads(unsigned int numThreads)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling setNumThreads() with a closed GTAR object");
+
+        m_archive->setNumThreads(numThreads);
+    }
+
+    void GTAR::setMapFiles(bool mapFiles)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling setMapFiles() with a closed GTAR object");
+
+        m_archive->setMapFiles(mapFiles);
+    }
+
+    void GTAR::setCacheSize(size_t bytes)
+    {
+        m_cache.setCapacity(bytes);
+    }
+
+    void GTAR::setSharedCache(size_t bytes, const string &name)
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling setSharedCache() with a closed GTAR object");
+        else if(m_mode != Read && bytes)
+            throw runtime_error("Only archives opened for reading can share a cache");
+
+        m_sharedCache.reset();
+        if(bytes)
+            m_sharedCache.reset(new SharedCache(
+                name.empty()? defaultSharedCacheName(m_filename): name, bytes));
+    }
+
+    string GTAR::sharedCacheName() const
+    {
+        return m_sharedCache.get()? m_sharedCache->name(): string();
+    }
+
+    string GTAR::exportIndex()
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling exportIndex() with a closed GTAR object");
+        if(m_mode != Read)
+            throw runtime_error("Can only export the index of an archive opened for reading");
+
+        struct stat fileStat;
+        if(stat(m_filename.c_str(), &fileStat) != 0)
+        {
+            stringstream msg;
+            msg << "Error finding the size of " << m_filename << ": " << strerror(errno);
+            throw runtime_error(msg.str());
+        }
+
+        const ArchiveIndex entries(m_archive->getIndex());
+        const bool hasOffsets(entries.offsets.size() == entries.names.size() &&
+                              entries.lengths.size() == entries.names.size());
+
+        string result(INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1);
+        putIndexInt(result, INDEX_VERSION);
+        putIndexInt(result, fileStat.st_size);
+        putIndexInt(result, modificationTime(fileStat));
+        putIndexInt(result, hasOffsets);
+
+        // files are stored as the record type they belong to and
+        // their index, which usually rebuild the path exactly
+        map<Record, size_t> typeIds;
+        vector<pair<string, string> > templates;
+        putIndexInt(result, m_indexedRecords.size());
+        for(map<Record, vector<string> >::const_iterator iter(m_indexedRecords.begin());
+            iter != m_indexedRecords.end(); ++iter)
+        {
+            const Record &rec(iter->first);
+            putIndexString(result, rec.getGroup());
+            putIndexString(result, rec.getName());
+            putIndexInt(result, rec.getBehavior());
+            putIndexInt(result, rec.getFormat());
+            putIndexInt(result, rec.getResolution());
+
+            typeIds[rec] = templates.size();
+            templates.push_back(pathTemplate(rec));
+        }
+
+        putIndexInt(result, entries.names.size());
+        uint64_t end(0);
+        for(size_t i(0); i < entries.names.size(); ++i)
+        {
+            const string &path(entries.names[i]);
+            Record rec(path);
+            const string index(rec.nullifyIndex());
+            const size_t typeId(typeIds[rec]);
+            const bool verbatim(templates[typeId].first + index + templates[typeId].second != path);
+
+            putIndexInt(result, 2*typeId + verbatim);
+            putIndexString(result, index);
+            if(verbatim)
+                putIndexString(result, path);
+
+            // positions are stored relative to the end of the
+            // previous file, which makes them small
+            if(hasOffsets)
+            {
+                const uint64_t gap(entries.offsets[i] - end);
+                putIndexInt(result, entries.offsets[i] >= end? 2*gap: 2*(end - entries.offsets[i]) - 1);
+                putIndexInt(result, entries.lengths[i]);
+                end = entries.offsets[i] + entries.lengths[i];
+            }
+        }
+
+        return result;
+    }
+
+    unsigned int GTAR::refresh()
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling refresh() with a closed GTAR object");
+        if(m_mode != Read)
+            throw runtime_error("Can only refresh an archive opened for reading");
+
+        TraceSpan span("refresh", &m_filename);
+        const unsigned int oldSize(m_archive->size());
+        m_archive->refresh();
+
+        const unsigned int size(m_archive->size());
+        for(unsigned int index(oldSize); index < size; ++index)
+            insertRecord(m_archive->getItemName(index));
+
+        // backends which don't list rewritten files again still
+        // report them so that they aren't read back from the cache
+        const vector<string> rewritten(m_archive->rewrittenFiles());
+        for(size_t i(0); i < rewritten.size(); ++i)
+            m_cache.erase(rewritten[i]);
+
+        // rewritten frames of delta-encoded records may be the
+        // references of those remembered by sequential reads
+        if(size != oldSize || rewritten.size())
+            m_deltaReads.clear();
+
+        return size - oldSize;
+    }
+
+    vector<string> GTAR::getPaths()
+    {
+        if(!m_archive.get())
+            throw runtime_error("Calling getPaths() with a closed GTAR object");
+
+        vector<string> result;
+        set<string> seen;
+        const unsigned int size(m_archive->size());
+        for(unsigned int index(0); index < size; ++index)
+        {
+            const string path(m_archive->getItemName(index));
+            if(seen.insert(path).second)
+                result.push_back(path);
+        }
+
+        return result;
+    }
+
+    FileInfo GTAR::getFileInfo(const string &path)
     {
         if(m_archive.get())
-            return m_archive->read(path);
+            return m_archive->getFileInfo(path);
         else
-            throw runtime_error("Calling readBytes() with a closed GTAR object");
+            throw runtime_error("Calling getFileInfo() with a closed GTAR object");
+    }
+
+    ArchiveStats GTAR::stats() const
+    {
+        if(m_archive.get())
+            return m_archive->stats();
+        else
+            return m_closedStats;
+    }
+
+    map<string, ArchiveStats> GTAR::recordStats() const
+    {
+        return m_recordStats;
+    }
+
+    void GTAR::resetStats()
+    {
+        if(m_archive.get())
+            m_archive->stats() = ArchiveStats();
+        m_closedStats = ArchiveStats();
+        m_recordStats.clear();
     }
 
     vector<Record> GTAR::getRecordTypes() const
@@ -201,6 +1183,9 @@ namespace gtar{
 
     void GTAR::insertRecord(const string &path)
     {
+        // the record may have been rewritten since it was cached
+        m_cache.erase(path);
+
         Record rec(path);
         const string index(rec.nullifyIndex());
 
@@ -208,6 +1193,429 @@ namespace gtar{
         m_indexedRecords[rec].push_back(index);
     }
 
+    string GTAR::sharedCacheKey(const string &path)
+    {
+        // a rewritten record is stored somewhere else in the archive
+        // (or at least at another time, for directories), so older
+        // copies decoded by any process are never found for it
+        const FileInfo info(m_archive->getFileInfo(path));
+        stringstream key;
+        key << path << '\0' << info.version << ':' << info.storedLength << ':' << info.byteLength;
+        return key.str();
+    }
+
+    bool GTAR::loadIndex(const string &index, ArchiveIndex &entries)
+    {
+        const size_t magicLength(sizeof(INDEX_MAGIC) - 1);
+        if(index.compare(0, magicLength, INDEX_MAGIC, magicLength))
+            throw runtime_error("Not an archive index exported by GTAR::exportIndex()");
+
+        IndexReader reader(index, magicLength);
+
+        // indices from other versions are ignored rather than
+        // rejected; the archive can always be read to find them
+        if(reader.readInt() != INDEX_VERSION)
+            return false;
+
+        // the modification time of a directory doesn't change when
+        // files are added to its subdirectories, so they are always
+        // searched
+        struct stat fileStat;
+        if(stat(m_filename.c_str(), &fileStat) != 0 || S_ISDIR(fileStat.st_mode))
+            return false;
+
+        const uint64_t fileSize(reader.readInt());
+        const uint64_t fileTime(reader.readInt());
+        if(fileSize != (uint64_t) fileStat.st_size || fileTime != modificationTime(fileStat))
+            return false;
+
+        // formats which need the positions of files can't use an
+        // index of another format
+        const bool hasOffsets(reader.readInt());
+        if(!hasOffsets && m_filename.length() >= 4 &&
+           m_filename.rfind(".tar") == m_filename.length() - 4)
+            return false;
+
+        vector<Record> types;
+        vector<pair<string, string> > templates;
+        const uint64_t numTypes(reader.readInt());
+        for(uint64_t i(0); i < numTypes; ++i)
+        {
+            const string group(reader.readString());
+            const string name(reader.readString());
+            const Behavior behavior((Behavior) reader.readInt());
+            const Format format((Format) reader.readInt());
+            const Resolution resolution((Resolution) reader.readInt());
+
+            types.push_back(Record(group, name, "", behavior, format, resolution));
+            templates.push_back(pathTemplate(types.back()));
+        }
+
+        ArchiveIndex result;
+        map<Record, indexSet> records;
+        map<Record, vector<string> > indexedRecords;
+        const uint64_t numEntries(reader.readInt());
+        uint64_t end(0);
+        for(uint64_t i(0); i < numEntries; ++i)
+        {
+            const uint64_t code(reader.readInt());
+            const uint64_t typeId(code/2);
+            if(typeId >= types.size())
+                throw runtime_error("Archive index is truncated or corrupt");
+
+            const string index(reader.readString());
+            if(code % 2)
+                result.names.push_back(reader.readString());
+            else
+                result.names.push_back(templates[typeId].first + index + templates[typeId].second);
+
+            if(hasOffsets)
+            {
+                const uint64_t gap(reader.readInt());
+                result.offsets.push_back(gap % 2? end - (gap + 1)/2: end + gap/2);
+                result.lengths.push_back(reader.readInt());
+                end = result.offsets.back() + result.lengths.back();
+            }
+
+            records[types[typeId]].insert(index);
+            indexedRecords[types[typeId]].push_back(index);
+        }
+
+        swap(entries, result);
+        swap(m_records, records);
+        swap(m_indexedRecords, indexedRecords);
+        return true;
+    }
+
+    void GTAR::addRecordStats(const string &path, const ArchiveStats &before)
+    {
+        Record rec(path);
+        if(rec.getBehavior() != Constant)
+            rec.setIndex("*");
+
+        ArchiveStats delta(m_archive->stats());
+        delta -= before;
+        m_recordStats[rec.getPath()] += delta;
+    }
+
+    bool GTAR::encodeRecord(const string &path, const char *contents,
+                            size_t byteLength, const Codec *codec, int level,
+                            vector<char> &encoded)
+    {
+        Record rec(path);
+        rec.nullifyIndex();
+
+        // a rewritten frame may be the reference of others; forget
+        // any decoded copy of it
+        map<Record, pair<string, SharedArray<char> > >::iterator lastRead(m_deltaReads.find(rec));
+        if(lastRead != m_deltaReads.end() && lastRead->second.first == path)
+            m_deltaReads.erase(lastRead);
+
+        // filters other than compression only make sense for arrays
+        const bool individual(rec.getResolution() == Individual);
+
+        size_t width(formatSize(rec.getFormat()));
+        FilterHeader header;
+        // contents after each filter stage, if any has been applied
+        vector<char> filtered;
+        bool isFiltered(false);
+
+        const double tolerance(findSetting(m_quantizeTolerances, rec.getName(), 0.0));
+
+        if(individual && tolerance > 0 && (rec.getFormat() == Float32 || rec.getFormat() == Float64) &&
+           byteLength && byteLength % width == 0)
+        {
+            const size_t count(byteLength/width);
+            vector<char> quantized(count*sizeof(int32_t));
+
+            double quantizedTolerance(0);
+            if(quantizeEncode(tolerance, width, contents, &quantized[0], count, quantizedTolerance))
+            {
+                stringstream toleranceStream;
+                toleranceStream.precision(17);
+                toleranceStream << quantizedTolerance;
+                header.set("quantize", toleranceStream.str());
+
+                filtered.swap(quantized);
+                isFiltered = true;
+                width = sizeof(int32_t);
+            }
+        }
+
+        // the filters below work on the quantized values, if any
+        const char *current(isFiltered? &filtered[0]: contents);
+        const size_t currentLength(isFiltered? filtered.size(): byteLength);
+
+        const pair<DeltaMode, unsigned int> delta(
+            findSetting(m_deltaModes, rec.getName(), make_pair(NoDelta, 0u)));
+
+        // reference frame for codecs, when compressing against the
+        // previous frame
+        vector<char> dictionary;
+
+        if(individual && rec.getBehavior() != Constant && delta.first != NoDelta &&
+           (delta.first != DictDelta || codec))
+        {
+            DeltaState &state(m_deltaStates[rec]);
+            const string quantize(header.get("quantize"));
+
+            // store a keyframe if there is nothing compatible to refer
+            // to or it is time to bound the length of the chain again
+            const bool keyframe(state.path.empty() || state.path == path ||
+                                state.quantize != quantize ||
+                                state.contents.size() != currentLength || !currentLength ||
+                                state.sinceKeyframe + 1 >= delta.second);
+
+            vector<char> previous;
+            previous.swap(state.contents);
+            state.contents.assign(current, current + currentLength);
+
+            if(keyframe)
+                state.sinceKeyframe = 0;
+            else
+            {
+                header.set("delta", deltaModeName(delta.first));
+                header.set("ref", state.path);
+
+                if(delta.first == DictDelta)
+                    dictionary.swap(previous);
+                else
+                {
+                    filtered.assign(current, current + currentLength);
+                    deltaEncode(delta.first, width, &filtered[0], &previous[0], currentLength);
+                    isFiltered = true;
+                }
+
+                ++state.sinceKeyframe;
+            }
+
+            state.path = path;
+            state.quantize = quantize;
+        }
+
+        const ShuffleMode shuffle(findSetting(m_shuffleModes, rec.getName(), NoShuffle));
+
+        if(individual && shuffle != NoShuffle && width > 1 && currentLength)
+        {
+            vector<char> shuffled(currentLength);
+            shuffleEncode(shuffle, width, isFiltered? &filtered[0]: contents,
+                          &shuffled[0], currentLength);
+            filtered.swap(shuffled);
+            isFiltered = true;
+
+            // the codec sees shuffled data, so the dictionary has to
+            // be shuffled too
+            if(dictionary.size())
+            {
+                vector<char> shuffledDictionary(dictionary.size());
+                shuffleEncode(shuffle, width, &dictionary[0], &shuffledDictionary[0],
+                              dictionary.size());
+                dictionary.swap(shuffledDictionary);
+            }
+
+            header.set("shuffle", shuffleModeName(shuffle));
+        }
+
+        if(codec && currentLength)
+        {
+            const char *source(isFiltered? &filtered[0]: contents);
+            vector<char> compressed(codec->compressedBound(currentLength));
+            char *target(compressed.size()? &compressed[0]: NULL);
+            if(dictionary.size())
+                compressed.resize(codec->compressWithDictionary(
+                                      source, currentLength, target, compressed.size(),
+                                      level, &dictionary[0], dictionary.size()));
+            else
+                compressed.resize(codec->compressBytes(source, currentLength, target,
+                                                       compressed.size(), level));
+            filtered.swap(compressed);
+            isFiltered = true;
+
+            stringstream sizeStream;
+            sizeStream << currentLength;
+            header.set("codec", codec->name());
+            header.set("size", sizeStream.str());
+        }
+
+        if(!isFiltered)
+            return false;
+
+        stringstream widthStream;
+        widthStream << width;
+        header.set("width", widthStream.str());
+
+        const string headerBytes(header.serialize());
+        encoded.resize(headerBytes.size() + filtered.size());
+        memcpy(&encoded[0], headerBytes.data(), headerBytes.size());
+        memcpy(&encoded[headerBytes.size()], &filtered[0], filtered.size());
+
+        return true;
+    }
+
+    SharedArray<char> GTAR::decodeRecord(const string &path, unsigned int depth)
+    {
+        Record rec;
+
+        // references are usually the frame decoded just before this
+        // one when reading sequentially
+        if(depth)
+        {
+            rec = Record(path);
+            rec.nullifyIndex();
+
+            map<Record, pair<string, SharedArray<char> > >::iterator lastRead(m_deltaReads.find(rec));
+            if(lastRead != m_deltaReads.end() && lastRead->second.first == path)
+            {
+                SharedArray<char> &cached(lastRead->second.second);
+                SharedArray<char> result(new char[cached.size()], cached.size());
+                memcpy(result.get(), cached.get(), cached.size());
+                return result;
+            }
+        }
+
+        SharedArray<char> stored(m_archive->read(path));
+        FilterHeader header;
+        const size_t headerLength(header.parse(stored.get(), stored.size()));
+
+        if(!headerLength && !depth)
+            return stored;
+
+        size_t width(0);
+        stringstream widthStream(header.get("width"));
+        widthStream >> width;
+
+        const DeltaMode delta(header.has("delta")? parseDeltaMode(header.get("delta")): NoDelta);
+        // contents of the frame this one was stored relative to
+        SharedArray<char> referenceBytes;
+
+        if(delta != NoDelta)
+        {
+            // chains are bounded by the keyframe interval, so a chain
+            // longer than the number of entries must contain a cycle
+            if(depth > m_archive->size())
+            {
+                stringstream message;
+                message << "Error decoding record at " << path
+                        << ": cycle in delta references";
+                throw runtime_error(message.str());
+            }
+
+            referenceBytes = decodeRecord(header.get("ref"), depth + 1);
+        }
+
+        // contents of the record following the header
+        SharedArray<char> payload(stored);
+        size_t payloadOffset(headerLength);
+
+        if(header.has("codec"))
+        {
+            const Codec *codec(findCodec(header.get("codec")));
+            size_t size(0);
+            stringstream sizeStream(header.get("size"));
+            sizeStream >> size;
+
+            if(!codec)
+            {
+                stringstream message;
+                message << "Error decoding record at " << path
+                        << ": unknown codec " << header.get("codec");
+                throw runtime_error(message.str());
+            }
+
+            payload = SharedArray<char>(new char[size], size);
+            payloadOffset = 0;
+
+            size_t decompressedSize(0);
+            if(delta == DictDelta)
+            {
+                SharedArray<char> dictionary(referenceBytes);
+
+                if(header.has("shuffle"))
+                {
+                    dictionary = SharedArray<char>(new char[referenceBytes.size()],
+                                                   referenceBytes.size());
+                    shuffleEncode(parseShuffleMode(header.get("shuffle")), width,
+                                  referenceBytes.get(), dictionary.get(), dictionary.size());
+                }
+
+                decompressedSize = codec->decompressWithDictionary(
+                    stored.get() + headerLength, stored.size() - headerLength,
+                    payload.get(), size, dictionary.get(), dictionary.size());
+            }
+            else
+                decompressedSize = codec->decompressBytes(
+                    stored.get() + headerLength, stored.size() - headerLength,
+                    payload.get(), size);
+
+            if(decompressedSize != size)
+            {
+                stringstream message;
+                message << "Error decoding record at " << path
+                        << ": decompressed size does not match " << size;
+                throw runtime_error(message.str());
+            }
+        }
+
+        const size_t byteLength(payload.size() - payloadOffset);
+        SharedArray<char> result(payload);
+
+        // undo the filters in the reverse order of encodeRecord()
+        if(header.has("shuffle"))
+        {
+            result = SharedArray<char>(new char[byteLength], byteLength);
+            shuffleDecode(parseShuffleMode(header.get("shuffle")), width,
+                          payload.get() + payloadOffset, result.get(), byteLength);
+        }
+        else if(payloadOffset)
+        {
+            result = SharedArray<char>(new char[byteLength], byteLength);
+            memcpy(result.get(), payload.get() + payloadOffset, byteLength);
+        }
+
+        if(delta != NoDelta)
+        {
+            if(referenceBytes.size() != byteLength)
+            {
+                stringstream message;
+                message << "Error decoding record at " << path
+                        << ": reference frame " << header.get("ref") << " has "
+                        << referenceBytes.size() << " bytes instead of " << byteLength;
+                throw runtime_error(message.str());
+            }
+
+            deltaDecode(delta, width, result.get(), referenceBytes.get(), byteLength);
+
+            if(!depth)
+            {
+                rec = Record(path);
+                rec.nullifyIndex();
+            }
+        }
+
+        if(delta != NoDelta || depth)
+        {
+            SharedArray<char> cached(new char[byteLength], byteLength);
+            memcpy(cached.get(), result.get(), byteLength);
+            m_deltaReads[rec] = make_pair(path, cached);
+        }
+
+        // references are compared and cached before dequantization
+        if(header.has("quantize") && !depth)
+        {
+            double tolerance(0);
+            stringstream toleranceStream(header.get("quantize"));
+            toleranceStream >> tolerance;
+
+            const size_t valueWidth(formatSize(Record(path).getFormat()));
+            const size_t count(byteLength/sizeof(int32_t));
+            SharedArray<char> values(new char[count*valueWidth], count*valueWidth);
+            quantizeDecode(tolerance, valueWidth, result.get(), values.get(), count);
+            result = values;
+        }
+
+        return result;
+    }
+
 }
 
 #ifdef GTAR_NAMESPACE_PARENT
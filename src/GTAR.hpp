@@ -2,6 +2,7 @@
 // by Matthew Spellings <mspells@umich.edu>
 
 #include <algorithm>
+#include <cstddef>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -16,7 +17,11 @@
 #endif
 
 #include "Archive.hpp"
+#include "Codec.hpp"
 #include "DirArchive.hpp"
+#include "Filter.hpp"
+#include "RecordCache.hpp"
+#include "SharedCache.hpp"
 #include "SqliteArchive.hpp"
 #include "TarArchive.hpp"
 #include "ZipArchive.hpp"
@@ -75,6 +80,11 @@ namespace gtar{
             /// Write the contents of a pointer to the given location
             void writePtr(const std::string &path, const void *contents,
                           const size_t byteLength, CompressMode mode);
+            /// Write the elements of a strided array to the given
+            /// location in C order
+            void writeStrided(const std::string &path, const void *contents,
+                              size_t elementSize, const std::vector<size_t> &shape,
+                              const std::vector<ptrdiff_t> &strides, CompressMode mode);
 
             /// Write an individual binary property to the specified
             /// location, converting to little endian if necessary.
@@ -92,8 +102,16 @@ namespace gtar{
 
         /// Constructor. Opens the file at filename in the given
         /// mode. The format of the file depends on the extension of
-        /// filename.
-        GTAR(const std::string &filename, const OpenMode mode);
+        /// filename. If an index exported by exportIndex() is given
+        /// for an archive opened for reading, the files and records
+        /// are taken from it rather than found by reading the
+        /// archive, as long as the size and modification time of the
+        /// file still match those stored in the index; otherwise the
+        /// index is ignored. Directory archives are always searched.
+        GTAR(const std::string &filename, const OpenMode mode,
+             const std::string &index=std::string());
+        /// Destructor. Closes the archive if it is still open.
+        ~GTAR();
 
         /// Manually close the opened archive (it automatically closes
         /// itself upon destruction)
@@ -108,6 +126,15 @@ namespace gtar{
         /// Write the contents of a pointer to the given location
         void writePtr(const std::string &path, const void *contents,
                       const size_t byteLength, CompressMode mode);
+        /// Write the elements of a strided array (such as a view of
+        /// some columns of a larger array) to the given location in C
+        /// order. contents points to the first element, and shape
+        /// and strides (in bytes, possibly negative or zero) have an
+        /// entry for each dimension. The elements are gathered into
+        /// a single buffer here rather than by the caller.
+        void writeStrided(const std::string &path, const void *contents,
+                          size_t elementSize, const std::vector<size_t> &shape,
+                          const std::vector<ptrdiff_t> &strides, CompressMode mode);
 
         /// Write an individual binary property to the specified
         /// location, converting to little endian if necessary.
@@ -129,6 +156,173 @@ namespace gtar{
         SharedPtr<T> readUniform(const std::string &path);
         /// Read a bytestring from the specified location
         SharedArray<char> readBytes(const std::string &path);
+        /// Read the contents of the specified location into target,
+        /// which must be exactly byteLength bytes long. Throws if
+        /// nothing of that size is stored there.
+        void readBytesInto(const std::string &path, void *target, size_t byteLength);
+        /// Read the given frames (indices) of a record into target,
+        /// one after another. Each frame must be frameLength bytes
+        /// long, and target must have room for all of them.
+        void readFrames(const Record &record, const std::vector<std::string> &frames,
+                        void *target, size_t frameLength);
+
+        /// Copy the records at the given paths from another archive
+        /// into this one exactly as they are stored there, filters
+        /// and all. Records compressed in a form this archive can
+        /// also store (such as deflated records between zip files)
+        /// are copied without being decompressed; the rest are
+        /// stored with the given compression mode. Delta-encoded
+        /// frames refer to other frames by path, so all frames of
+        /// such records should be copied together.
+        void copyRecords(GTAR &source, const std::vector<std::string> &paths,
+                         CompressMode mode);
+        /// Copy every record of the archives with the given file
+        /// names into this one, in the manner of the gtar.cat tool:
+        /// where several inputs have a record at the same path, the
+        /// record from the last of them is kept. Records are read by
+        /// a pool of reader threads, decompressed and compressed
+        /// again (with the given mode) by a pool of compressor
+        /// threads where this archive can't store them as they are,
+        /// and written in order by the calling thread. numThreads is
+        /// the total number of reader and compressor threads, or 0
+        /// for one per processor.
+        void mergeArchives(const std::vector<std::string> &inputs, CompressMode mode,
+                           unsigned int numThreads=0);
+
+        /// Store frames of individual records with the given name
+        /// relative to the previously-written frame of the same
+        /// record. Every keyframeInterval-th frame is stored in full,
+        /// so reading any frame needs to visit at most
+        /// keyframeInterval stored frames. An empty name applies the
+        /// setting to all records without a setting of their own.
+        void setDelta(const std::string &name, DeltaMode mode,
+                      unsigned int keyframeInterval=16);
+        /// Rearrange the bytes (or bits) of the multi-byte elements of
+        /// individual records with the given name before they are
+        /// stored, which usually makes them more compressible. An
+        /// empty name applies the setting to all records without a
+        /// setting of their own.
+        void setShuffle(const std::string &name, ShuffleMode mode);
+        /// Store float32 and float64 individual records with the given
+        /// name lossily, rounded to the nearest multiple of a step
+        /// slightly smaller than 2*tolerance (leaving room for the
+        /// rounding of the stored type), so that each value read back
+        /// is within the given absolute tolerance of the value
+        /// written. Frames containing values which can't be quantized
+        /// (because they are not finite or are too large for the
+        /// tolerance) are stored losslessly. A tolerance of 0
+        /// disables quantization.
+        /// An empty name applies the setting to all records without a
+        /// setting of their own.
+        void setQuantization(const std::string &name, double tolerance);
+        /// Compress records with the given name using the given codec
+        /// (see CodecId) instead of the default for the archive
+        /// format. If level is negative, the codec's level for the
+        /// CompressMode of each write is used. Backends which can't
+        /// store the codec themselves store the compressed record
+        /// with a filter header. Records written with NoCompress are
+        /// never compressed. An empty name applies the setting to all
+        /// records without a setting of their own.
+        void setCodec(const std::string &name, unsigned int codec, int level=-1);
+        /// Enable or disable verification of the CRC-32 checksums
+        /// stored with each record of zip archives as they are
+        /// read. Verification is enabled by default; disabling it
+        /// makes reading trusted archives faster, especially records
+        /// which are stored without compression.
+        void setVerifyChecksums(bool verify);
+        /// Set the number of threads used to compress large records
+        /// in zip archives, which are split into pieces compressed
+        /// in parallel. Parallel compression is off by default (1
+        /// thread); 0 uses one thread per processor.
+        void setNumThreads(unsigned int numThreads);
+        /// Map large uncompressed records of tar, zip, and directory
+        /// archives opened for reading into memory rather than
+        /// reading them. Off by default: the records read this way
+        /// point into the file, so they change if another process
+        /// rewrites it, and reading them crashes the program (with
+        /// SIGBUS) if it is truncated. Only enable mapping for
+        /// archives which won't be written to while records read from
+        /// them are in use.
+        void setMapFiles(bool mapFiles);
+        /// Keep up to the given number of bytes of the most recently
+        /// read records in memory after decoding them, so that
+        /// reading them again (such as constant records read for
+        /// each frame) doesn't touch the archive. Records are copied
+        /// out of the cache, and those larger than the whole cache
+        /// are never kept. The default of 0 disables the cache. Hits
+        /// and misses are counted by stats().
+        void setCacheSize(size_t bytes);
+        /// Share decoded records with other processes reading the
+        /// same archive through a cache in POSIX shared memory of
+        /// about the given number of bytes, which is created by the
+        /// first process to attach to it. Reads check the cache of
+        /// setCacheSize() first, then the shared cache, and add what
+        /// they decode to both. The cache is named by
+        /// defaultSharedCacheName() unless a name is given; it
+        /// outlives every process using it until removeSharedCache()
+        /// is called. Only archives opened for reading may share a
+        /// cache. A size of 0 detaches from the cache. Hits and
+        /// misses are counted by stats(). Records are found by their
+        /// path along with where and how large the archive stores
+        /// them, so records rewritten since are decoded again by
+        /// processes which have found them with refresh() (and
+        /// processes which haven't don't share their older copies
+        /// with those which have).
+        void setSharedCache(size_t bytes, const std::string &name="");
+        /// Name of the shared cache this archive is attached to (see
+        /// setSharedCache()), or an empty string
+        std::string sharedCacheName() const;
+
+        /// Export the files and records found when the archive was
+        /// opened (along with the size and modification time of the
+        /// file) as a compact binary string, which can be given to
+        /// the constructor to open the same archive again without
+        /// finding them. Only archives opened for reading can be
+        /// exported.
+        std::string exportIndex();
+
+        /// Find the records added to an archive opened for reading
+        /// since it was opened or last refreshed, such as by a
+        /// simulation still writing to it, without reading the rest
+        /// of the archive again. Returns the number of files found.
+        /// Tar archives are read from the end of the last file found,
+        /// sqlite archives from the last row found, and directory
+        /// archives only list the directories which changed (and
+        /// check the files already found for rewrites). Zip
+        /// archives can only be read up to the last time their
+        /// writer closed them, when their central directory is
+        /// written; their central directory is read again when the
+        /// file has changed. Files which are still being written are
+        /// found by a later refresh. Rewritten files are read again
+        /// rather than from either cache; sqlite and directory
+        /// archives don't count them as found.
+        unsigned int refresh();
+
+        /// Get the paths of all of the files in the archive, in the
+        /// order they were first stored
+        std::vector<std::string> getPaths();
+        /// Get the stored size, size, and compression of the file at
+        /// the given path without reading it (for most formats).
+        /// Compression applied as a filter (see setCodec()) is not
+        /// reported.
+        FileInfo getFileInfo(const std::string &path);
+
+        /// Get counters of the bytes, files, seeks, and transactions
+        /// read and written and the time spent compressing,
+        /// decompressing, in system calls, and finding the files of
+        /// the archive since it was opened (or resetStats() was
+        /// called). Uncompressed sizes count the bytes given to and
+        /// returned from this object, after any filters. The
+        /// counters remain available after close(), including the
+        /// time spent closing.
+        ArchiveStats stats() const;
+        /// Get the counters of stats() for each kind of record read
+        /// or written, by path with any index replaced by
+        /// "*". Opening and closing the archive and committing bulk
+        /// writes are not attributed to any record.
+        std::map<std::string, ArchiveStats> recordStats() const;
+        /// Reset all of the counters of stats() and recordStats() to 0
+        void resetStats();
 
         /// Query all of the records in the archive. These will all
         /// have empty indices.
@@ -148,6 +342,11 @@ namespace gtar{
         void writePtr(const std::string &path, const void *contents,
                       const size_t byteLength, CompressMode mode,
                       bool immediate);
+        /// Write the elements of a strided array to the given location
+        void writeStrided(const std::string &path, const void *contents,
+                          size_t elementSize, const std::vector<size_t> &shape,
+                          const std::vector<ptrdiff_t> &strides, CompressMode mode,
+                          bool immediate);
 
         /// Write an individual binary property to the specified
         /// location, converting to little endian if necessary.
@@ -165,15 +364,87 @@ namespace gtar{
         /// Flush writes out of temporary buffers
         void endBulkWrites();
 
+        /// Reads, compresses, and writes the records for
+        /// mergeArchives() on several threads
+        class MergePipeline;
+        friend class MergePipeline;
+
         /// Insert a record into the set of cached records
         void insertRecord(const std::string &path);
+        /// Key of the record at the given path in the shared cache
+        std::string sharedCacheKey(const std::string &path);
+        /// Read an index written by exportIndex() into entries and
+        /// the set of cached records. Returns false, leaving them
+        /// untouched, if it doesn't describe the archive file as it
+        /// is now.
+        bool loadIndex(const std::string &index, ArchiveIndex &entries);
+        /// Add the work done by the archive since it had the given
+        /// counters to the counters of the record at the given path
+        void addRecordStats(const std::string &path, const ArchiveStats &before);
+
+        /// Apply any filters configured for the record at the given
+        /// path, compressing the result with codec (if not NULL) at
+        /// the given level. Returns true and fills encoded with the bytes to
+        /// store if the record should be stored filtered.
+        bool encodeRecord(const std::string &path, const char *contents,
+                          size_t byteLength, const Codec *codec, int level,
+                          std::vector<char> &encoded);
+        /// Read the record at the given path, undoing any filters it
+        /// was stored with. depth is the number of references which
+        /// have been followed to reach this record.
+        SharedArray<char> decodeRecord(const std::string &path, unsigned int depth);
+
+        /// Most recently written frame of a delta-encoded record
+        struct DeltaState
+        {
+            DeltaState():
+                path(), quantize(), contents(), sinceKeyframe(0)
+            {}
+
+            /// Path of the frame
+            std::string path;
+            /// Quantization tolerance of the frame, if any
+            std::string quantize;
+            /// Contents of the frame after quantization, before
+            /// delta encoding
+            std::vector<char> contents;
+            /// Number of frames written since the last keyframe
+            unsigned int sinceKeyframe;
+        };
 
+        /// Name of the archive file
+        std::string m_filename;
+        /// Mode the archive was opened in
+        OpenMode m_mode;
         /// The archive abstraction object we'll use
         gtar_unique_ptr<Archive> m_archive;
 
         /// Cached record objects
         std::map<Record, indexSet> m_records;
         std::map<Record, std::vector<std::string> > m_indexedRecords;
+
+        /// Delta mode and keyframe interval for each record name
+        std::map<std::string, std::pair<DeltaMode, unsigned int> > m_deltaModes;
+        /// Shuffle mode for each record name
+        std::map<std::string, ShuffleMode> m_shuffleModes;
+        /// Quantization tolerance for each record name
+        std::map<std::string, double> m_quantizeTolerances;
+        /// Codec id and level for each record name
+        std::map<std::string, std::pair<int, int> > m_codecs;
+        /// Last frame written for each delta-encoded record
+        std::map<Record, DeltaState> m_deltaStates;
+        /// Last (path, contents) decoded for each delta-encoded
+        /// record (before dequantization), so that sequential reads
+        /// don't have to revisit the whole chain back to the keyframe
+        std::map<Record, std::pair<std::string, SharedArray<char> > > m_deltaReads;
+        /// Most recently read records
+        RecordCache m_cache;
+        /// Records shared with other processes, if any
+        gtar_unique_ptr<SharedCache> m_sharedCache;
+        /// Counters of the archive when it was closed
+        ArchiveStats m_closedStats;
+        /// Counters for each kind of record (see recordStats())
+        std::map<std::string, ArchiveStats> m_recordStats;
     };
 
     /// Swap the bytes of a series of characters if this is a big-endian machine
@@ -243,7 +514,7 @@ namespace gtar{
     template<typename T>
     SharedArray<T> GTAR::readIndividual(const std::string &path)
     {
-        SharedArray<char> bytes(m_archive->read(path));
+        SharedArray<char> bytes(readBytes(path));
         maybeSwapEndian<T>((T*) bytes.get(), bytes.size());
 
         const size_t resultSize(bytes.size()/sizeof(T));
@@ -259,7 +530,7 @@ namespace gtar{
     template<typename T>
     SharedPtr<T> GTAR::readUniform(const std::string &path)
     {
-        SharedArray<char> bytes(m_archive->read(path));
+        SharedArray<char> bytes(readBytes(path));
 
         maybeSwapEndian<T>((T*) bytes.get(), bytes.size());
 
@@ -0,0 +1,89 @@
+// MappedFile.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include "MappedFile.hpp"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define GTAR_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::string;
+
+    // Smaller pieces are read instead; the cost of setting up a
+    // mapping and faulting its pages in outweighs the copy
+    static const size_t MIN_MAPPED_LENGTH = 1 << 20;
+
+#ifndef GTAR_NO_MMAP
+    // Unmaps a mapped region once no SharedArray refers to it
+    class MappedRegion: public SharedArrayOwner
+    {
+    public:
+        MappedRegion(void *address, size_t length):
+            m_address(address), m_length(length)
+        {}
+
+        virtual ~MappedRegion()
+        {
+            munmap(m_address, m_length);
+        }
+
+    private:
+        void *m_address;
+        size_t m_length;
+    };
+#endif
+
+    bool mapFile(const string &filename, size_t offset, size_t byteLength,
+                 SharedArray<char> &target)
+    {
+#ifdef GTAR_NO_MMAP
+        return false;
+#else
+        if(byteLength < MIN_MAPPED_LENGTH)
+            return false;
+
+        const int fd(open(filename.c_str(), O_RDONLY));
+        if(fd < 0)
+            return false;
+
+        // touching pages past the end of the file would crash
+        struct stat fileStat;
+        if(fstat(fd, &fileStat) || (size_t) fileStat.st_size < offset + byteLength)
+        {
+            close(fd);
+            return false;
+        }
+
+        // mappings must start on a page boundary
+        const size_t pageOffset(offset % sysconf(_SC_PAGESIZE));
+        const size_t mapLength(byteLength + pageOffset);
+        void *address(mmap(NULL, mapLength, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                           fd, offset - pageOffset));
+        close(fd);
+
+        if(address == MAP_FAILED)
+            return false;
+
+        SharedArray<char> result((char*) address + pageOffset, byteLength,
+                                 new MappedRegion(address, mapLength));
+        target.swap(result);
+        return true;
+#endif
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
@@ -0,0 +1,36 @@
+// MappedFile.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstddef>
+#include <string>
+
+#include "SharedArray.hpp"
+
+#ifndef __MAPPEDFILE_HPP_
+#define __MAPPEDFILE_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Point target at byteLength bytes of the given file, starting
+    /// at offset, by mapping them into memory rather than reading
+    /// them. The mapping is copy-on-write, so changes to target never
+    /// reach the file, and lasts until the last reference to target
+    /// is released. Changes to the file by others do show through,
+    /// and truncating it makes reading target crash (SIGBUS), so
+    /// only files which won't be rewritten should be mapped. Returns false, leaving target alone, for pieces
+    /// small enough that reading them is faster, on platforms
+    /// without mmap, or if mapping fails.
+    bool mapFile(const std::string &filename, size_t offset, size_t byteLength,
+                 SharedArray<char> &target);
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
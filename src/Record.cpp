@@ -18,6 +18,24 @@ namespace gtar{
     using std::stringstream;
     using std::vector;
 
+    size_t formatSize(Format format)
+    {
+        switch(format)
+        {
+        case Float32:
+        case Int32:
+        case UInt32:
+            return 4;
+        case Float64:
+        case Int64:
+        case UInt64:
+            return 8;
+        case UInt8:
+        default:
+            return 1;
+        }
+    }
+
     Record::Record():
         m_group(), m_name(), m_index(), m_behavior(Constant),
         m_format(UInt8), m_resolution(Text)
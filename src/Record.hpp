@@ -23,6 +23,9 @@ namespace gtar{
     /// Level of detail of property storage
     enum Resolution {Text, Uniform, Individual};
 
+    /// Size, in bytes, of a single element of the given format
+    size_t formatSize(Format format);
+
     /// Simple class for a record which can be stored in an archive
     class Record
     {
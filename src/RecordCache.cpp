@@ -0,0 +1,108 @@
+// RecordCache.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstring>
+
+#include "RecordCache.hpp"
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::make_pair;
+    using std::map;
+    using std::string;
+
+    // Copy the contents of an array into newly-allocated memory
+    static SharedArray<char> copyArray(const SharedArray<char> &source)
+    {
+        SharedArray<char> local(source);
+        SharedArray<char> result(new char[local.size()], local.size());
+        if(local.size())
+            memcpy(result.get(), local.get(), local.size());
+        return result;
+    }
+
+    RecordCache::RecordCache():
+        m_capacity(0), m_size(0), m_entries(), m_positions()
+    {}
+
+    void RecordCache::setCapacity(size_t capacity)
+    {
+        m_capacity = capacity;
+        shrink(capacity);
+    }
+
+    size_t RecordCache::capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t RecordCache::size() const
+    {
+        return m_size;
+    }
+
+    bool RecordCache::find(const string &path, SharedArray<char> &target)
+    {
+        map<string, EntryList::iterator>::iterator position(m_positions.find(path));
+
+        if(position == m_positions.end())
+            return false;
+
+        // move the record to the front of the list
+        m_entries.splice(m_entries.begin(), m_entries, position->second);
+        target = copyArray(position->second->second);
+        return true;
+    }
+
+    void RecordCache::insert(const string &path, const SharedArray<char> &contents)
+    {
+        erase(path);
+
+        if(!contents.size() || contents.size() > m_capacity)
+            return;
+
+        shrink(m_capacity - contents.size());
+
+        m_entries.push_front(make_pair(path, copyArray(contents)));
+        m_positions[path] = m_entries.begin();
+        m_size += contents.size();
+    }
+
+    void RecordCache::erase(const string &path)
+    {
+        map<string, EntryList::iterator>::iterator position(m_positions.find(path));
+
+        if(position == m_positions.end())
+            return;
+
+        m_size -= position->second->second.size();
+        m_entries.erase(position->second);
+        m_positions.erase(position);
+    }
+
+    void RecordCache::clear()
+    {
+        m_entries.clear();
+        m_positions.clear();
+        m_size = 0;
+    }
+
+    void RecordCache::shrink(size_t capacity)
+    {
+        while(m_size > capacity && !m_entries.empty())
+        {
+            m_size -= m_entries.back().second.size();
+            m_positions.erase(m_entries.back().first);
+            m_entries.pop_back();
+        }
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
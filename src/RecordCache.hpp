@@ -0,0 +1,76 @@
+// RecordCache.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "SharedArray.hpp"
+
+#ifndef __RECORD_CACHE_HPP_
+#define __RECORD_CACHE_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Least-recently-used cache of the decoded contents of records,
+    /// keyed by path and bounded by the total number of bytes it
+    /// holds. The cache keeps its own copies of records, so that
+    /// what it returns can be modified or disowned freely.
+    class RecordCache
+    {
+    public:
+        /// Create an empty cache which holds nothing
+        RecordCache();
+
+        /// Set the maximum number of bytes of records to hold,
+        /// forgetting the least recently used ones if necessary. 0
+        /// disables the cache.
+        void setCapacity(size_t capacity);
+        /// Maximum number of bytes of records held
+        size_t capacity() const;
+        /// Number of bytes of records currently held
+        size_t size() const;
+
+        /// If the record at the given path is held, set target to a
+        /// copy of it, mark it as the most recently used, and return
+        /// true
+        bool find(const std::string &path, SharedArray<char> &target);
+        /// Hold a copy of the contents of the record at the given
+        /// path, if it fits, forgetting the least recently used
+        /// records to make room
+        void insert(const std::string &path, const SharedArray<char> &contents);
+        /// Forget the record at the given path, if it is held
+        void erase(const std::string &path);
+        /// Forget every record
+        void clear();
+
+    private:
+        typedef std::list<std::pair<std::string, SharedArray<char> > > EntryList;
+
+        /// Forget the least recently used records until at most
+        /// capacity bytes are held
+        void shrink(size_t capacity);
+
+        /// Maximum number of bytes to hold
+        size_t m_capacity;
+        /// Number of bytes held
+        size_t m_size;
+        /// Records held, most recently used first
+        EntryList m_entries;
+        /// Position of each record held in m_entries
+        std::map<std::string, EntryList::iterator> m_positions;
+    };
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
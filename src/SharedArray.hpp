@@ -15,6 +15,16 @@ namespace gtar{
 template<typename T> class SharedArray;
 template<typename T> class SharedPtr;
 
+/// Base class for objects which own memory that a SharedArray points
+/// to but which was not allocated with new[], such as a
+/// memory-mapped file. The owner is deleted (and should free the
+/// memory) when the last reference to the array goes away.
+class SharedArrayOwner
+{
+public:
+    virtual ~SharedArrayOwner() {}
+};
+
 /// Shim for the SharedArray class. Wraps the reference counting and
 /// pointer storage for a SharedArray.
 template<typename T>
@@ -23,11 +33,13 @@ class SharedArrayShim
     friend class SharedArray<T>;
 public:
     /// Constructor. Takes ownership of a target pointer and remembers
-    /// the given length (in numbers of objects)
-    SharedArrayShim(T *target, size_t length):
+    /// the given length (in numbers of objects). If owner is given,
+    /// target is freed by deleting owner rather than with delete[].
+    SharedArrayShim(T *target, size_t length, SharedArrayOwner *owner=NULL):
         m_target(target),
         m_length(length),
-        m_count(1)
+        m_count(1),
+        m_owner(owner)
     {}
 
     /// Increase the reference count for the stored pointer
@@ -43,8 +55,12 @@ public:
         if(!m_count)
         {
             m_length = 0;
-            delete[] m_target;
+            if(m_owner)
+                delete m_owner;
+            else
+                delete[] m_target;
             m_target = NULL;
+            m_owner = NULL;
         }
     }
 
@@ -55,6 +71,8 @@ private:
     size_t m_length;
     /// Number of references to this pointer
     size_t m_count;
+    /// Object which frees m_target, if it wasn't allocated with new[]
+    SharedArrayOwner *m_owner;
 };
 
 /// Generic reference-counting shared array implementation for
@@ -77,6 +95,13 @@ public:
         m_shim(new SharedArrayShim<T>(target, length))
     {}
 
+    /// Owner constructor: point to memory held by the given owner,
+    /// which this array takes ownership of and deletes when the
+    /// last reference to the memory is released.
+    SharedArray(T *target, size_t length, SharedArrayOwner *owner):
+        m_shim(new SharedArrayShim<T>(target, length, owner))
+    {}
+
     /// Copy constructor: make this object point to the same array as
     /// rhs, increasing the reference count if necessary
     SharedArray(const SharedArray<T> &rhs):
@@ -168,11 +193,18 @@ public:
         m_shim = NULL;
     }
 
-    /// Stop managing this array and give it to C.
+    /// Stop managing this array and give it to C. Memory held by an
+    /// owner can't be freed with delete[], so it is copied instead.
     T *disown()
     {
         T *result(NULL);
-        if(m_shim)
+        if(m_shim && m_shim->m_owner)
+        {
+            result = new T[size()];
+            std::copy(begin(), end(), result);
+            release();
+        }
+        else if(m_shim)
         {
             result = m_shim->m_target;
             delete m_shim;
@@ -0,0 +1,541 @@
+// SharedCache.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+// Shared memory and process-shared atomics need POSIX and C++11
+#if __cplusplus > 199711L && (defined(__unix__) || defined(__APPLE__))
+#define GTAR_USE_SHARED_MEMORY
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "SharedCache.hpp"
+#include "Trace.hpp"
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::runtime_error;
+    using std::string;
+    using std::stringstream;
+
+    // 64-bit FNV-1a hash
+    static uint64_t hashBytes(const char *bytes, size_t length)
+    {
+        uint64_t result(14695981039346656037ULL);
+        for(size_t i(0); i < length; ++i)
+        {
+            result ^= (unsigned char) bytes[i];
+            result *= 1099511628211ULL;
+        }
+        return result;
+    }
+
+    // Shared memory object names must start with a single slash
+    static string segmentName(const string &name)
+    {
+        if(!name.empty() && name[0] == '/')
+            return name;
+        return "/" + name;
+    }
+
+    string defaultSharedCacheName(const string &filename)
+    {
+        string path(filename);
+#ifdef GTAR_USE_SHARED_MEMORY
+        char resolved[PATH_MAX];
+        if(realpath(filename.c_str(), resolved))
+            path = resolved;
+#endif
+
+        stringstream identity;
+        identity << path;
+
+        struct stat fileStat;
+        if(stat(filename.c_str(), &fileStat) == 0)
+            identity << '\0' << fileStat.st_size << ':' << fileStat.st_mtime;
+
+        const string key(identity.str());
+        char result[32];
+        snprintf(result, sizeof(result), "/getar-%016llx",
+                 (unsigned long long) hashBytes(key.data(), key.size()));
+        return result;
+    }
+
+#ifdef GTAR_USE_SHARED_MEMORY
+
+    // Identifies initialized segments of this layout
+    static const uint64_t SEGMENT_MAGIC = 0x6765746172636331ULL;
+    // Number of directory slots, starting from the one a path hashes
+    // to, which may hold the record of that path
+    static const uint32_t SLOT_WINDOW = 32;
+    // Alignment of records in the data area
+    static const uint64_t RECORD_ALIGNMENT = 8;
+    // Number of times to try taking the lock before giving up on
+    // adding a record
+    static const unsigned int LOCK_ATTEMPTS = 2000;
+
+    // Start of a segment, which is followed by its directory of
+    // slots and then by the data area. Records are found in the
+    // directory without locking; the lock (the pid of the process
+    // holding it) is only taken to add and evict records.
+    struct SegmentHeader
+    {
+        std::atomic<uint64_t> magic;
+        uint64_t numSlots;
+        uint64_t dataOffset;
+        uint64_t dataLength;
+        std::atomic<int64_t> lock;
+        // First slot in order of the location of its record in the
+        // data area, or -1; only used while holding the lock
+        int64_t head;
+    };
+
+    // A record in the data area. Each slot is a seqlock: sequence
+    // is odd while the slot is being changed, and readers check that
+    // it didn't change while they copied the record.
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        // Length of the path, stored at the start of the record, or
+        // 0 if the slot is empty
+        uint32_t keyLength;
+        uint64_t hash;
+        // Location of the record (path, then contents) in the data
+        // area and length of its contents
+        uint64_t offset;
+        uint64_t length;
+        // monotonicSeconds() (in microseconds) when the record was
+        // last found or added
+        std::atomic<uint64_t> lastUsed;
+        // Neighbouring slots in order of location in the data area,
+        // or -1; only used while holding the lock
+        int64_t prev;
+        int64_t next;
+    };
+
+    static size_t roundUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1)/alignment*alignment;
+    }
+
+    static uint64_t nowMicroseconds()
+    {
+        return (uint64_t) (1e6*monotonicSeconds());
+    }
+
+    static SegmentHeader &header(char *segment)
+    {
+        return *(SegmentHeader*) segment;
+    }
+
+    static Slot *slots(char *segment)
+    {
+        return (Slot*) (segment + roundUp(sizeof(SegmentHeader), 64));
+    }
+
+    static char *data(char *segment)
+    {
+        return segment + header(segment).dataOffset;
+    }
+
+    // Mark a slot as being changed
+    static uint32_t beginChange(Slot &slot)
+    {
+        uint32_t sequence(slot.sequence.load(std::memory_order_relaxed));
+        // a process may have died while changing the slot
+        sequence += (sequence & 1)? 2: 1;
+        slot.sequence.store(sequence, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return sequence;
+    }
+
+    static void endChange(Slot &slot, uint32_t sequence)
+    {
+        slot.sequence.store(sequence + 1, std::memory_order_release);
+    }
+
+    // Empty a slot, removing it from the ordered list of records
+    static void evict(char *segment, int64_t index)
+    {
+        SegmentHeader &head(header(segment));
+        Slot *directory(slots(segment));
+        Slot &slot(directory[index]);
+
+        if(!slot.keyLength)
+            return;
+
+        const uint32_t sequence(beginChange(slot));
+
+        if(slot.prev >= 0)
+            directory[slot.prev].next = slot.next;
+        else
+            head.head = slot.next;
+        if(slot.next >= 0)
+            directory[slot.next].prev = slot.prev;
+
+        slot.keyLength = 0;
+        slot.length = 0;
+        slot.prev = slot.next = -1;
+
+        endChange(slot, sequence);
+    }
+
+    // Find a free range of the data area of the given length,
+    // returning false if there is none. prev is set to the slot
+    // whose record precedes the range, or -1.
+    static bool findRoom(char *segment, uint64_t length, uint64_t &offset, int64_t &prev)
+    {
+        SegmentHeader &head(header(segment));
+        Slot *directory(slots(segment));
+
+        uint64_t end(0);
+        prev = -1;
+        // bounded in case a process died while changing the list
+        uint64_t steps(0);
+        for(int64_t index(head.head); index >= 0 && steps < head.numSlots;
+            index = directory[index].next, ++steps)
+        {
+            if(directory[index].offset >= end + length)
+                break;
+            end = roundUp(directory[index].offset + directory[index].keyLength +
+                          directory[index].length, RECORD_ALIGNMENT);
+            prev = index;
+        }
+
+        offset = end;
+        return end + length <= head.dataLength;
+    }
+
+    // Take the lock of the segment, returning false if it couldn't
+    // be taken for a while
+    static bool lockSegment(char *segment)
+    {
+        std::atomic<int64_t> &lock(header(segment).lock);
+        const int64_t pid(getpid());
+
+        for(unsigned int attempt(0); attempt < LOCK_ATTEMPTS; ++attempt)
+        {
+            int64_t holder(0);
+            if(lock.compare_exchange_strong(holder, pid, std::memory_order_acquire))
+                return true;
+
+            // the process holding the lock may have died
+            if(holder > 0 && kill((pid_t) holder, 0) != 0 && errno == ESRCH)
+                lock.compare_exchange_strong(holder, 0, std::memory_order_relaxed);
+            else if(attempt > 16)
+                usleep(50);
+        }
+
+        return false;
+    }
+
+    static void unlockSegment(char *segment)
+    {
+        header(segment).lock.store(0, std::memory_order_release);
+    }
+
+    SharedCache::SharedCache(const string &name, size_t capacity):
+        m_name(segmentName(name)), m_segment(NULL), m_length(0)
+    {
+        // about one slot for each 64kB, but enough for many small records
+        uint64_t numSlots(256);
+        while(numSlots < 16384 && numSlots*65536 < capacity)
+            numSlots *= 2;
+
+        const size_t dataOffset(roundUp(roundUp(sizeof(SegmentHeader), 64) +
+                                        numSlots*sizeof(Slot), 64));
+        size_t length(dataOffset + roundUp(capacity, RECORD_ALIGNMENT));
+
+        int fd(shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600));
+        const bool created(fd >= 0);
+
+        if(!created && errno == EEXIST)
+            fd = shm_open(m_name.c_str(), O_RDWR, 0600);
+
+        if(fd < 0)
+        {
+            stringstream message;
+            message << "Error opening shared cache " << m_name << ": " << strerror(errno);
+            throw runtime_error(message.str());
+        }
+
+        if(created && ftruncate(fd, length) != 0)
+        {
+            stringstream message;
+            message << "Error sizing shared cache " << m_name << ": " << strerror(errno);
+            close(fd);
+            shm_unlink(m_name.c_str());
+            throw runtime_error(message.str());
+        }
+        else if(!created)
+        {
+            // the process creating the segment may not have sized it yet
+            struct stat segmentStat;
+            segmentStat.st_size = 0;
+            for(unsigned int attempt(0); attempt < 1000; ++attempt)
+            {
+                if(fstat(fd, &segmentStat) == 0 && segmentStat.st_size)
+                    break;
+                usleep(1000);
+            }
+            length = segmentStat.st_size;
+        }
+
+        void *mapped(length? mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0):
+                     MAP_FAILED);
+        close(fd);
+
+        if(mapped == MAP_FAILED)
+        {
+            stringstream message;
+            message << "Error mapping shared cache " << m_name;
+            throw runtime_error(message.str());
+        }
+
+        m_segment = (char*) mapped;
+        m_length = length;
+        SegmentHeader &head(header(m_segment));
+
+        if(created)
+        {
+            new (&head) SegmentHeader();
+            head.numSlots = numSlots;
+            head.dataOffset = dataOffset;
+            head.dataLength = length - dataOffset;
+            head.lock.store(0);
+            head.head = -1;
+
+            Slot *directory(slots(m_segment));
+            for(uint64_t i(0); i < numSlots; ++i)
+            {
+                new (&directory[i]) Slot();
+                directory[i].sequence.store(0);
+                directory[i].keyLength = 0;
+                directory[i].lastUsed.store(0);
+                directory[i].prev = directory[i].next = -1;
+            }
+
+            head.magic.store(SEGMENT_MAGIC, std::memory_order_release);
+        }
+        else
+        {
+            for(unsigned int attempt(0); attempt < 1000; ++attempt)
+            {
+                if(length >= sizeof(SegmentHeader) &&
+                   head.magic.load(std::memory_order_acquire) == SEGMENT_MAGIC)
+                    break;
+                usleep(1000);
+            }
+
+            if(length < sizeof(SegmentHeader) ||
+               head.magic.load(std::memory_order_acquire) != SEGMENT_MAGIC ||
+               head.dataOffset + head.dataLength != length ||
+               head.dataOffset < roundUp(sizeof(SegmentHeader), 64) + head.numSlots*sizeof(Slot) ||
+               !head.numSlots || (head.numSlots & (head.numSlots - 1)))
+            {
+                munmap(m_segment, m_length);
+                stringstream message;
+                message << "Shared memory " << m_name << " is not a getar cache";
+                throw runtime_error(message.str());
+            }
+        }
+    }
+
+    SharedCache::~SharedCache()
+    {
+        munmap(m_segment, m_length);
+    }
+
+    size_t SharedCache::capacity() const
+    {
+        return header(m_segment).dataLength;
+    }
+
+    bool SharedCache::find(const string &path, SharedArray<char> &target)
+    {
+        SegmentHeader &head(header(m_segment));
+        Slot *directory(slots(m_segment));
+        const char *area(data(m_segment));
+        const uint64_t hash(hashBytes(path.data(), path.size()));
+
+        for(uint32_t i(0); i < SLOT_WINDOW; ++i)
+        {
+            Slot &slot(directory[(hash + i) & (head.numSlots - 1)]);
+            const uint32_t sequence(slot.sequence.load(std::memory_order_acquire));
+
+            if((sequence & 1) || slot.hash != hash || slot.keyLength != path.size())
+                continue;
+
+            const uint64_t offset(slot.offset), length(slot.length);
+            // fields may be torn while another process changes them
+            if(offset > head.dataLength || length > head.dataLength - offset ||
+               path.size() > head.dataLength - offset - length ||
+               memcmp(area + offset, path.data(), path.size()))
+                continue;
+
+            SharedArray<char> result(new char[length], length);
+            memcpy(result.get(), area + offset + path.size(), length);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+
+            slot.lastUsed.store(nowMicroseconds(), std::memory_order_relaxed);
+            target = result;
+            return true;
+        }
+
+        return false;
+    }
+
+    void SharedCache::insert(const string &path, const SharedArray<char> &contents)
+    {
+        SegmentHeader &head(header(m_segment));
+        Slot *directory(slots(m_segment));
+        const uint64_t hash(hashBytes(path.data(), path.size()));
+        const uint64_t length(path.size() + contents.size());
+
+        if(path.empty() || !contents.size() || length > head.dataLength ||
+           !lockSegment(m_segment))
+            return;
+
+        // pick an empty slot near where the path hashes to, or the
+        // least recently used one, unless another process added the
+        // record already
+        int64_t chosen(-1);
+        for(uint32_t i(0); i < SLOT_WINDOW; ++i)
+        {
+            const int64_t index((hash + i) & (head.numSlots - 1));
+            Slot &slot(directory[index]);
+
+            if(slot.keyLength == path.size() && slot.hash == hash &&
+               !memcmp(data(m_segment) + slot.offset, path.data(), path.size()))
+            {
+                unlockSegment(m_segment);
+                return;
+            }
+            else if(chosen < 0 || !slot.keyLength ||
+                    (directory[chosen].keyLength &&
+                     slot.lastUsed.load(std::memory_order_relaxed) <
+                     directory[chosen].lastUsed.load(std::memory_order_relaxed)))
+                chosen = index;
+        }
+        evict(m_segment, chosen);
+
+        // evict the least recently used records until there is room
+        uint64_t offset(0);
+        int64_t prev(-1);
+        while(!findRoom(m_segment, length, offset, prev))
+        {
+            int64_t oldest(-1);
+            for(uint64_t index(0); index < head.numSlots; ++index)
+                if(directory[index].keyLength &&
+                   (oldest < 0 || directory[index].lastUsed.load(std::memory_order_relaxed) <
+                    directory[oldest].lastUsed.load(std::memory_order_relaxed)))
+                    oldest = index;
+
+            if(oldest < 0)
+            {
+                unlockSegment(m_segment);
+                return;
+            }
+            evict(m_segment, oldest);
+        }
+
+        Slot &slot(directory[chosen]);
+        const uint32_t sequence(beginChange(slot));
+
+        SharedArray<char> local(contents);
+        memcpy(data(m_segment) + offset, path.data(), path.size());
+        memcpy(data(m_segment) + offset + path.size(), local.get(), local.size());
+
+        slot.keyLength = path.size();
+        slot.hash = hash;
+        slot.offset = offset;
+        slot.length = local.size();
+        slot.lastUsed.store(nowMicroseconds(), std::memory_order_relaxed);
+
+        slot.prev = prev;
+        slot.next = prev >= 0? directory[prev].next: head.head;
+        if(slot.next >= 0)
+            directory[slot.next].prev = chosen;
+        if(prev >= 0)
+            directory[prev].next = chosen;
+        else
+            head.head = chosen;
+
+        endChange(slot, sequence);
+        unlockSegment(m_segment);
+    }
+
+    void removeSharedCache(const string &name)
+    {
+        const string segment(segmentName(name));
+        if(shm_unlink(segment.c_str()) != 0 && errno != ENOENT)
+        {
+            stringstream message;
+            message << "Error removing shared cache " << segment << ": " << strerror(errno);
+            throw runtime_error(message.str());
+        }
+    }
+
+#else
+
+    SharedCache::SharedCache(const string &name, size_t capacity):
+        m_name(segmentName(name)), m_segment(NULL), m_length(0)
+    {
+        throw runtime_error("Shared caches are not supported on this system");
+    }
+
+    SharedCache::~SharedCache()
+    {
+    }
+
+    size_t SharedCache::capacity() const
+    {
+        return 0;
+    }
+
+    bool SharedCache::find(const string &path, SharedArray<char> &target)
+    {
+        return false;
+    }
+
+    void SharedCache::insert(const string &path, const SharedArray<char> &contents)
+    {
+    }
+
+    void removeSharedCache(const string &name)
+    {
+    }
+
+#endif
+
+    const string &SharedCache::name() const
+    {
+        return m_name;
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
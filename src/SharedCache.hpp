@@ -0,0 +1,80 @@
+// SharedCache.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <cstddef>
+#include <string>
+
+#include "SharedArray.hpp"
+
+#ifndef __SHARED_CACHE_HPP_
+#define __SHARED_CACHE_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Cache of the decoded contents of records in POSIX shared
+    /// memory, which every process attached to it (such as workers
+    /// reading the same archive in parallel) can read from and add
+    /// to. Records are found without locking; adding a record takes
+    /// a lock shared by the processes and evicts the least recently
+    /// used records to make room. Only available on POSIX systems
+    /// when compiled with C++11 or greater.
+    class SharedCache
+    {
+    public:
+        /// Attach to the shared memory segment of the given name,
+        /// creating it with room for about the given number of bytes
+        /// of records if it doesn't exist yet. Throws if shared
+        /// memory isn't available.
+        SharedCache(const std::string &name, size_t capacity);
+        /// Detach from the segment, which remains available to other
+        /// processes until removeSharedCache() is called
+        ~SharedCache();
+
+        /// Name of the shared memory segment
+        const std::string &name() const;
+        /// Number of bytes of records the segment can hold
+        size_t capacity() const;
+
+        /// If the record at the given path is held, set target to a
+        /// copy of it, mark it as the most recently used, and return
+        /// true
+        bool find(const std::string &path, SharedArray<char> &target);
+        /// Hold a copy of the contents of the record at the given
+        /// path if it fits, evicting the least recently used records
+        /// to make room. Records are silently not added if another
+        /// process holds the lock for too long.
+        void insert(const std::string &path, const SharedArray<char> &contents);
+
+    private:
+        // Not copyable
+        SharedCache(const SharedCache &rhs);
+        void operator=(const SharedCache &rhs);
+
+        /// Name of the segment
+        std::string m_name;
+        /// Start of the mapped segment
+        char *m_segment;
+        /// Size of the mapped segment
+        size_t m_length;
+    };
+
+    /// Name of the shared cache used by default for the archive with
+    /// the given file name, which is derived from its absolute path,
+    /// size, and modification time so that a rewritten archive gets
+    /// a new cache
+    std::string defaultSharedCacheName(const std::string &filename);
+    /// Remove the shared cache segment of the given name, freeing its
+    /// memory once every process has detached from it
+    void removeSharedCache(const std::string &name);
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
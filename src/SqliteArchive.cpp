@@ -9,10 +9,11 @@
 #include <stdexcept>
 
 #include "lz4.h"
-#include "lz4hc.h"
+#include "Codec.hpp"
 #include "SqliteArchive.hpp"
 
-#define LZ4_CHUNK_SIZE std::min(LZ4_MAX_INPUT_SIZE, SQLITE_MAX_LENGTH)/2
+// LZ4 can only compress chunks of up to LZ4_MAX_INPUT_SIZE bytes
+#define CODEC_CHUNK_SIZE std::min(LZ4_MAX_INPUT_SIZE, SQLITE_MAX_LENGTH)/2
 #define RAW_CHUNK_SIZE SQLITE_MAX_LENGTH/2
 
 #ifdef GTAR_NAMESPACE_PARENT
@@ -27,11 +28,14 @@ namespace gtar{
     using std::stringstream;
     using std::vector;
 
-    SqliteArchive::SqliteArchive(const string &filename, const OpenMode mode):
-        m_filename(filename), m_mode(mode), m_fileNames(), m_connection(0),
+    SqliteArchive::SqliteArchive(const string &filename, const OpenMode mode,
+                                 const ArchiveIndex *index):
+        m_filename(filename), m_mode(mode), m_fileNames(), m_knownFiles(),
+        m_rewrittenFiles(), m_connection(0),
         m_begin_stmt(0), m_end_stmt(0), m_rollback_stmt(0),
         m_insert_filename_stmt(0), m_insert_contents_stmt(0),
-        m_select_contents_stmt(0), m_list_files_stmt(0)
+        m_select_contents_stmt(0), m_select_info_stmt(0), m_list_files_stmt(0),
+        m_lastRowid(0)
     {
         sqlite3_initialize();
 
@@ -153,6 +157,8 @@ namespace gtar{
         // so it shouldn't have much of an effect even in write-only
         // mode.
         {
+            ScopedTimer timer(m_stats.indexTime, "index");
+
             execStatus = sqlite3_prepare_v2(m_connection,
                                             "SELECT file_list.*, file_contents.contents "
                                             "FROM file_list INNER JOIN file_contents "
@@ -169,7 +175,21 @@ namespace gtar{
             }
 
             execStatus = sqlite3_prepare_v2(m_connection,
-                                            "SELECT path FROM file_list;",
+                                            "SELECT uncompressed_size, compressed_size, "
+                                            "compress_level, rowid FROM file_list "
+                                            "WHERE path = ?;",
+                                            -1, &m_select_info_stmt, 0);
+            if(execStatus != SQLITE_OK)
+            {
+                stringstream result;
+                result << "Couldn't compile select_info statement: ";
+                result << sqlite3_errmsg(m_connection);
+                throw runtime_error(result.str());
+            }
+
+            execStatus = sqlite3_prepare_v2(m_connection,
+                                            "SELECT rowid, path FROM file_list "
+                                            "WHERE rowid > ? ORDER BY rowid;",
                                             -1, &m_list_files_stmt, 0);
             if(execStatus != SQLITE_OK)
             {
@@ -179,14 +199,21 @@ namespace gtar{
                 throw runtime_error(result.str());
             }
 
-            while(sqlite3_step(m_list_files_stmt) == SQLITE_ROW)
+            // an index of the same file already holds the names
+            if(index)
             {
-                const size_t bytes(sqlite3_column_bytes(m_list_files_stmt, 0));
-                const string str((const char*) sqlite3_column_text(m_list_files_stmt, 0), bytes);
-                m_fileNames.push_back(str);
+                m_fileNames = index->names;
+
+                sqlite3_stmt *lastRowStmt(0);
+                execStatus = sqlite3_prepare_v2(m_connection,
+                                                "SELECT max(rowid) FROM file_list;",
+                                                -1, &lastRowStmt, 0);
+                if(execStatus == SQLITE_OK && sqlite3_step(lastRowStmt) == SQLITE_ROW)
+                    m_lastRowid = sqlite3_column_int64(lastRowStmt, 0);
+                sqlite3_finalize(lastRowStmt);
             }
-
-            sqlite3_reset(m_list_files_stmt);
+            else
+                findFiles();
         }
     }
 
@@ -195,6 +222,47 @@ namespace gtar{
         close();
     }
 
+    void SqliteArchive::findFiles()
+    {
+        // rewritten files are replaced by new rows with the same
+        // path, which are found again here; they keep their place in
+        // the list and are reported by rewrittenFiles() instead
+        const bool refreshing(!m_fileNames.empty());
+        if(refreshing && m_knownFiles.empty())
+            m_knownFiles.insert(m_fileNames.begin(), m_fileNames.end());
+
+        sqlite3_bind_int64(m_list_files_stmt, 1, m_lastRowid);
+
+        while(sqlite3_step(m_list_files_stmt) == SQLITE_ROW)
+        {
+            m_lastRowid = sqlite3_column_int64(m_list_files_stmt, 0);
+            const size_t bytes(sqlite3_column_bytes(m_list_files_stmt, 1));
+            const string str((const char*) sqlite3_column_text(m_list_files_stmt, 1), bytes);
+
+            if(!refreshing || m_knownFiles.insert(str).second)
+                m_fileNames.push_back(str);
+            else
+                m_rewrittenFiles.push_back(str);
+        }
+
+        sqlite3_reset(m_list_files_stmt);
+    }
+
+    void SqliteArchive::refresh()
+    {
+        if(m_mode != Read || !m_connection)
+            return;
+
+        ScopedTimer timer(m_stats.indexTime, "index");
+        m_rewrittenFiles.clear();
+        findFiles();
+    }
+
+    vector<string> SqliteArchive::rewrittenFiles() const
+    {
+        return m_rewrittenFiles;
+    }
+
     void SqliteArchive::close()
     {
         sqlite3_finalize(m_begin_stmt);
@@ -209,6 +277,8 @@ namespace gtar{
         m_insert_contents_stmt = 0;
         sqlite3_finalize(m_select_contents_stmt);
         m_select_contents_stmt = 0;
+        sqlite3_finalize(m_select_info_stmt);
+        m_select_info_stmt = 0;
         sqlite3_finalize(m_list_files_stmt);
         m_list_files_stmt = 0;
 
@@ -219,61 +289,143 @@ namespace gtar{
     void SqliteArchive::writePtr(const string &path, const void *contents,
                                  const size_t byteLength, CompressMode mode,
                                  bool immediate)
+    {
+        const unsigned int codec(mode == NoCompress? NoCodec: LZ4Codec);
+        writeCodec(path, contents, byteLength, codec, getCodec(codec).defaultLevel(mode),
+                   immediate);
+    }
+
+    bool SqliteArchive::storesCodec(unsigned int /*codec*/) const
+    {
+        return true;
+    }
+
+    void SqliteArchive::writeCodec(const string &path, const void *contents,
+                                   const size_t byteLength, unsigned int codec,
+                                   int level, bool immediate)
     {
         if(m_mode == Read)
             throw runtime_error("Can't write to an archive opened for reading");
 
+        if(codec != NoCodec)
+        {
+            RawRecord raw;
+            {
+                ScopedTimer timer(m_stats.compressTime, "compress", &path);
+                raw = compressChunks((const char*) contents, byteLength, codec, level);
+            }
+            insertRaw(path, raw, immediate);
+            return;
+        }
+
         vector<const char*> rawTargets;
         vector<size_t> rawSizes;
-        size_t compressedSize(0);
-        unsigned int rawCompression(0);
-        vector<SharedArray<char> > compressedBytes;
 
-        if(mode == FastCompress || mode == MediumCompress)
+        for(size_t chunkidx(0); chunkidx*RAW_CHUNK_SIZE < byteLength; ++chunkidx)
         {
-            for(size_t chunkidx(0); chunkidx*LZ4_CHUNK_SIZE < byteLength; ++chunkidx)
-            {
-                const int sourceSize(min((size_t) LZ4_CHUNK_SIZE, byteLength - chunkidx*LZ4_CHUNK_SIZE));
-                const int maxSize(LZ4_compressBound(sourceSize));
-
-                compressedBytes.push_back(SharedArray<char>(new char[maxSize], maxSize));
-                rawTargets.push_back(compressedBytes.back().get());
-                rawSizes.push_back(LZ4_compress_default(
-                                       ((const char*) contents) + chunkidx*LZ4_CHUNK_SIZE,
-                                       compressedBytes.back().get(), sourceSize,
-                                       maxSize));
-                compressedSize += rawSizes.back();
-            }
-            rawCompression = 1;
+            const int sourceSize(min((size_t) RAW_CHUNK_SIZE, byteLength - chunkidx*RAW_CHUNK_SIZE));
+            rawTargets.push_back(((const char*) contents) + chunkidx*RAW_CHUNK_SIZE);
+            rawSizes.push_back(sourceSize);
         }
-        else if(mode == SlowCompress)
+
+        insertChunks(path, rawTargets, rawSizes, byteLength, byteLength, NoCodec, immediate);
+    }
+
+    bool SqliteArchive::writeRaw(const string &path, const RawRecord &raw, bool immediate)
+    {
+        if(m_mode == Read)
+            throw runtime_error("Can't write to an archive opened for reading");
+
+        if(!storesRaw(raw))
+            return false;
+
+        insertRaw(path, raw, immediate);
+        return true;
+    }
+
+    bool SqliteArchive::storesRaw(const RawRecord &raw) const
+    {
+        if(raw.codec == NoCodec)
+            return false;
+
+        // pieces are decompressed one after the other, so any
+        // division of the record into pieces can be stored as long
+        // as each one fits in a blob
+        for(size_t i(0); i < raw.pieces.size(); ++i)
+            if(raw.pieces[i].size() > (size_t) SQLITE_MAX_LENGTH)
+                return false;
+
+        return true;
+    }
+
+    RawRecord SqliteArchive::encodeRaw(const SharedArray<char> &contents, CompressMode mode) const
+    {
+        if(mode == NoCompress || !contents.size())
+            return Archive::encodeRaw(contents, mode);
+
+        SharedArray<char> source(contents);
+        return compressChunks(source.get(), source.size(), LZ4Codec,
+                              getCodec(LZ4Codec).defaultLevel(mode));
+    }
+
+    RawRecord SqliteArchive::compressChunks(const char *contents, size_t byteLength,
+                                            unsigned int codec, int level)
+    {
+        const Codec &compressor(getCodec(codec));
+        RawRecord result;
+
+        for(size_t chunkidx(0); chunkidx*CODEC_CHUNK_SIZE < byteLength; ++chunkidx)
         {
-            for(size_t chunkidx(0); chunkidx*LZ4_CHUNK_SIZE < byteLength; ++chunkidx)
+            const size_t sourceSize(min((size_t) CODEC_CHUNK_SIZE, byteLength - chunkidx*CODEC_CHUNK_SIZE));
+            const size_t maxSize(compressor.compressedBound(sourceSize));
+            char *compressed(new char[maxSize]);
+
+            try
             {
-                const int sourceSize(min((size_t) LZ4_CHUNK_SIZE, byteLength - chunkidx*LZ4_CHUNK_SIZE));
-                const int maxSize(LZ4_compressBound(sourceSize));
-
-                compressedBytes.push_back(SharedArray<char>(new char[maxSize], maxSize));
-                rawTargets.push_back(compressedBytes.back().get());
-                rawSizes.push_back(LZ4_compress_HC(
-                                       ((const char*) contents) + chunkidx*LZ4_CHUNK_SIZE,
-                                       compressedBytes.back().get(), sourceSize,
-                                       maxSize, LZ4HC_CLEVEL_OPT_MIN));
-                compressedSize += rawSizes.back();
+                const size_t compressedSize(
+                    compressor.compressBytes(contents + chunkidx*CODEC_CHUNK_SIZE, sourceSize,
+                                             compressed, maxSize, level));
+                // the piece owns the whole buffer, but only reports
+                // the compressed size
+                result.pieces.push_back(SharedArray<char>(compressed, compressedSize));
             }
-            rawCompression = 1;
-        }
-        else
-        {
-            for(size_t chunkidx(0); chunkidx*RAW_CHUNK_SIZE < byteLength; ++chunkidx)
+            catch(...)
             {
-                const int sourceSize(min((size_t) RAW_CHUNK_SIZE, byteLength - chunkidx*RAW_CHUNK_SIZE));
-                rawTargets.push_back(((const char*) contents) + chunkidx*RAW_CHUNK_SIZE);
-                rawSizes.push_back(sourceSize);
+                delete[] compressed;
+                throw;
             }
-            compressedSize = byteLength;
         }
 
+        result.codec = codec;
+        result.byteLength = byteLength;
+        return result;
+    }
+
+    void SqliteArchive::insertRaw(const string &path, const RawRecord &raw, bool immediate)
+    {
+        vector<SharedArray<char> > pieces(raw.pieces);
+        vector<const char*> rawTargets;
+        vector<size_t> rawSizes;
+        size_t compressedSize(0);
+
+        for(size_t i(0); i < pieces.size(); ++i)
+        {
+            rawTargets.push_back(pieces[i].get());
+            rawSizes.push_back(pieces[i].size());
+            compressedSize += rawSizes.back();
+        }
+
+        insertChunks(path, rawTargets, rawSizes, raw.byteLength, compressedSize, raw.codec,
+                     immediate);
+    }
+
+    void SqliteArchive::insertChunks(const string &path, const vector<const char*> &rawTargets,
+                                     const vector<size_t> &rawSizes, size_t byteLength,
+                                     size_t compressedSize, unsigned int rawCompression,
+                                     bool immediate)
+    {
+        ScopedTimer timer(m_stats.ioTime, "store", &path);
+
         sqlite3_bind_text(m_insert_filename_stmt, 1, path.c_str(), path.size(), 0);
         sqlite3_bind_int64(m_insert_filename_stmt, 2, byteLength);
         sqlite3_bind_int64(m_insert_filename_stmt, 3, compressedSize);
@@ -311,6 +463,8 @@ namespace gtar{
 
                 status = sqlite3_step(m_end_stmt);
             }
+
+            ++m_stats.transactions;
         }
         else
         {
@@ -341,11 +495,16 @@ namespace gtar{
             throw runtime_error(result.str());
         }
 
+        ++m_stats.writes;
+        m_stats.bytesWritten += compressedSize;
+        m_stats.uncompressedBytesWritten += byteLength;
+
         m_fileNames.push_back(path);
     }
 
     void SqliteArchive::beginBulkWrites()
     {
+        ScopedTimer timer(m_stats.ioTime, "begin transaction");
         int status;
         do {status = sqlite3_step(m_begin_stmt);} while(status == SQLITE_BUSY);
         sqlite3_reset(m_begin_stmt);
@@ -353,14 +512,40 @@ namespace gtar{
 
     void SqliteArchive::endBulkWrites()
     {
+        ScopedTimer timer(m_stats.ioTime, "commit");
         int status;
         do {status = sqlite3_step(m_end_stmt);} while(status == SQLITE_BUSY);
         sqlite3_reset(m_end_stmt);
+
+        if(status == SQLITE_DONE)
+            ++m_stats.transactions;
     }
 
     SharedArray<char> SqliteArchive::read(const std::string &path)
     {
-        SharedArray<char> result;
+        const RawRecord raw(readRaw(path));
+
+        if(raw.pieces.empty())
+            return SharedArray<char>();
+
+        try
+        {
+            ScopedTimer timer(m_stats.decompressTime, "decompress", &path);
+            return decodeRaw(raw);
+        }
+        catch(runtime_error &error)
+        {
+            stringstream message;
+            message << "Error decompressing record at " << path
+                    << ": " << error.what();
+            throw runtime_error(message.str());
+        }
+    }
+
+    RawRecord SqliteArchive::readRaw(const std::string &path)
+    {
+        RawRecord result;
+        ScopedTimer timer(m_stats.ioTime, "load", &path);
 
         sqlite3_bind_text(m_select_contents_stmt, 1, path.c_str(), path.size(), 0);
 
@@ -368,64 +553,21 @@ namespace gtar{
 
         if(selectResult == SQLITE_ROW)
         {
-            const size_t uncompSize(sqlite3_column_int64(m_select_contents_stmt, 1));
+            result.byteLength = sqlite3_column_int64(m_select_contents_stmt, 1);
             // const size_t compSize(sqlite3_column_int64(m_select_contents_stmt, 2));
-            const size_t compLevel(sqlite3_column_int64(m_select_contents_stmt, 3));
+            result.codec = sqlite3_column_int64(m_select_contents_stmt, 3);
 
-            vector<SharedArray<char> >chunks;
-            vector<size_t> chunkSizes;
             do
             {
-                chunkSizes.push_back(sqlite3_column_bytes(m_select_contents_stmt, 4));
-                chunks.push_back(SharedArray<char>(new char[chunkSizes.back()], chunkSizes.back()));
-                memcpy(chunks.back().get(), sqlite3_column_blob(m_select_contents_stmt, 4), chunkSizes.back());
+                const size_t chunkSize(sqlite3_column_bytes(m_select_contents_stmt, 4));
+                result.pieces.push_back(SharedArray<char>(new char[chunkSize], chunkSize));
+                memcpy(result.pieces.back().get(), sqlite3_column_blob(m_select_contents_stmt, 4), chunkSize);
+                m_stats.bytesRead += chunkSize;
             }
             while(sqlite3_step(m_select_contents_stmt) == SQLITE_ROW);
 
-            switch(compLevel)
-            {
-            case 0:
-                if(chunks.size() == 1)
-                    result = chunks.back();
-                else
-                {
-                    SharedArray<char> concat(new char[uncompSize], uncompSize);
-                    size_t totalBytes(0);
-                    for(size_t chunkidx(0); chunkidx < chunks.size(); ++chunkidx)
-                    {
-                        memcpy(concat.get() + totalBytes, chunks[chunkidx].get(), chunkSizes[chunkidx]);
-                        totalBytes += chunkSizes[chunkidx];
-                    }
-                    result = concat;
-                }
-                break;
-            case 1: // LZ4
-            {
-                SharedArray<char> uncompressed(new char[uncompSize], uncompSize);
-                for(size_t chunkidx(0), totalBytes(0); chunkidx < chunks.size(); ++chunkidx)
-                {
-                    int byteCount(LZ4_decompress_safe(
-                        (const char*) chunks[chunkidx].get(),
-                        uncompressed.get() + totalBytes, chunkSizes[chunkidx],
-                        std::min((size_t) INT_MAX, uncompSize - totalBytes)));
-                    if(byteCount < 0)
-                    {
-                        stringstream message;
-                        message << "Error decompressing record at " << path;
-                        message << ": LZ4 decompression error";
-                        throw runtime_error(message.str());
-                    }
-                    totalBytes += byteCount;
-                }
-                result = uncompressed;
-            }
-                break;
-            default:
-                stringstream message;
-                message << "Error decompressing record at " << path
-                        << ": unknown compression " << compLevel;
-                throw runtime_error(message.str());
-            }
+            ++m_stats.reads;
+            m_stats.uncompressedBytesRead += result.byteLength;
         }
         else if(selectResult != SQLITE_DONE)
         {
@@ -441,6 +583,26 @@ namespace gtar{
         return result;
     }
 
+    FileInfo SqliteArchive::getFileInfo(const string &path)
+    {
+        FileInfo result;
+
+        sqlite3_bind_text(m_select_info_stmt, 1, path.c_str(), path.size(), 0);
+
+        if(sqlite3_step(m_select_info_stmt) == SQLITE_ROW)
+        {
+            result.byteLength = sqlite3_column_int64(m_select_info_stmt, 0);
+            result.storedLength = sqlite3_column_int64(m_select_info_stmt, 1);
+            result.codec = sqlite3_column_int64(m_select_info_stmt, 2);
+            // rewritten files replace their row with a new one
+            result.version = sqlite3_column_int64(m_select_info_stmt, 3);
+        }
+
+        sqlite3_reset(m_select_info_stmt);
+
+        return result;
+    }
+
     unsigned int SqliteArchive::size()
     {
         return m_fileNames.size();
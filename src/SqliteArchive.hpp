@@ -1,7 +1,9 @@
 // SqliteArchive.hpp
 // by Matthew Spellings <mspells@umich.edu>
 
+#include <set>
 #include <string>
+#include <vector>
 #include "sqlite3.h"
 
 #include "Archive.hpp"
@@ -21,8 +23,11 @@ namespace gtar{
     {
     public:
         // Constructor: Open or create an archive object with the
-        // given filename and access mode
-        SqliteArchive(const std::string &filename, const OpenMode mode);
+        // given filename and access mode. If an index (see
+        // getIndex()) of the same file is given, the names of the
+        // files are taken from it instead of the database.
+        SqliteArchive(const std::string &filename, const OpenMode mode,
+                      const ArchiveIndex *index=NULL);
 
         // Destructor: Clean up memory used
         virtual ~SqliteArchive();
@@ -36,24 +41,83 @@ namespace gtar{
                               const size_t byteLength, CompressMode mode,
                               bool immediate=false);
 
+        // Returns true: sqlite archives record the codec of each
+        // record in the compress_level column
+        virtual bool storesCodec(unsigned int codec) const;
+
+        // Write the contents of a pointer to the given path within
+        // the archive, compressed with the given codec and level
+        virtual void writeCodec(const std::string &path, const void *contents,
+                                const size_t byteLength, unsigned int codec,
+                                int level, bool immediate=false);
+
         virtual void beginBulkWrites();
         virtual void endBulkWrites();
 
         // Read the contents of the given location within the archive
         virtual SharedArray<char> read(const std::string &path);
 
+        // Read the chunks of the given location as they are stored,
+        // compressed with the codec in the compress_level column
+        virtual RawRecord readRaw(const std::string &path);
+
+        // Store the pieces of a compressed raw record as chunks
+        virtual bool writeRaw(const std::string &path, const RawRecord &raw,
+                              bool immediate=false);
+
+        // Returns true for compressed raw records with pieces small
+        // enough to be stored as chunks
+        virtual bool storesRaw(const RawRecord &raw) const;
+
+        // Compress contents in chunks, as writePtr() would with mode
+        virtual RawRecord encodeRaw(const SharedArray<char> &contents,
+                                    CompressMode mode) const;
+
+        // Return the sizes and compression of the file at the given
+        // location from the archive's index
+        virtual FileInfo getFileInfo(const std::string &path);
+
         // Return the number of files stored in the archive
         virtual unsigned int size();
         // Return the name of the file with the given numerical index
         virtual std::string getItemName(unsigned int index);
 
+        // Find the rows added to the file list since the archive was
+        // opened or last refreshed
+        virtual void refresh();
+
+        virtual std::vector<std::string> rewrittenFiles() const;
+
     private:
+        // Append the paths of the rows of the file list after
+        // m_lastRowid to m_fileNames
+        void findFiles();
+
+        // Compress contents in chunks with the given codec and level
+        static RawRecord compressChunks(const char *contents, size_t byteLength,
+                                        unsigned int codec, int level);
+
+        // Insert the rows for the pieces of a raw record
+        void insertRaw(const std::string &path, const RawRecord &raw, bool immediate);
+
+        // Insert the rows for a record stored in the given chunks
+        void insertChunks(const std::string &path, const std::vector<const char*> &rawTargets,
+                          const std::vector<size_t> &rawSizes, size_t byteLength,
+                          size_t compressedSize, unsigned int rawCompression,
+                          bool immediate);
+
         // Name of the archive file we're accessing
         const std::string m_filename;
         // How we're accessing the archive
         const OpenMode m_mode;
         // Cached list of paths in archive
         std::vector<std::string> m_fileNames;
+        // Set of the paths in m_fileNames, filled by the first
+        // refresh() which finds any files
+        std::set<std::string> m_knownFiles;
+        // Paths already in m_fileNames found again by the last
+        // refresh()
+        std::vector<std::string> m_rewrittenFiles;
 
         // Pointer to our db handle
         sqlite3 *m_connection;
@@ -64,7 +128,11 @@ namespace gtar{
         sqlite3_stmt *m_insert_filename_stmt;
         sqlite3_stmt *m_insert_contents_stmt;
         sqlite3_stmt *m_select_contents_stmt;
+        sqlite3_stmt *m_select_info_stmt;
         sqlite3_stmt *m_list_files_stmt;
+
+        // Largest rowid of the file list found so far
+        sqlite3_int64 m_lastRowid;
     };
 }
 
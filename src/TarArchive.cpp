@@ -7,6 +7,7 @@
 #include <sstream>
 #include <stdexcept>
 
+#include "MappedFile.hpp"
 #include "TarArchive.hpp"
 
 #ifdef GTAR_NAMESPACE_PARENT
@@ -24,7 +25,8 @@ namespace gtar{
     using std::stringstream;
     using std::vector;
 
-    TarArchive::TarArchive(const string &filename, const OpenMode mode):
+    TarArchive::TarArchive(const string &filename, const OpenMode mode,
+                           const ArchiveIndex *index):
         m_filename(filename), m_mode(mode), m_file(), m_filePosition(0), m_maxPosition(0)
     {
         ios_base::openmode fileMode(ios_base::binary | ios_base::in);
@@ -66,93 +68,133 @@ namespace gtar{
         }
 
         // populate the file location maps
+        if(index)
         {
-            bool done(false);
-            size_t offset(0);
-            TarHeader recordHeader;
+            ScopedTimer timer(m_stats.indexTime, "index");
+            m_fileNames = index->names;
 
-            while(!m_file.eof() && !done)
+            for(size_t i(0); i < m_fileNames.size(); ++i)
             {
-                memset(&recordHeader, 0, sizeof(TarHeader));
-                m_file.read((char*) &recordHeader, sizeof(TarHeader));
+                m_fileOffsets[m_fileNames[i]] = index->offsets[i];
+                m_fileSizes[m_fileNames[i]] = index->lengths[i];
+            }
+
+            if(m_fileNames.size())
+            {
+                const string lastName = m_fileNames[m_fileNames.size() - 1];
+                m_maxPosition = m_fileOffsets[lastName] + (m_fileSizes[lastName] + 511)/512*512;
+            }
+        }
+        else
+            findFiles(0);
+
+        if(m_mode == Append)
+        {
+            m_file.seekp(m_maxPosition);
+            m_filePosition = m_maxPosition;
+        }
+
+    }
+
+    TarArchive::~TarArchive()
+    {
+        close();
+    }
 
-                if(recordHeader.magic[0] == '\0')
+    void TarArchive::findFiles(size_t offset)
+    {
+        ScopedTimer timer(m_stats.indexTime, "index");
+        bool done(false);
+        TarHeader recordHeader;
+
+        m_file.clear();
+        m_file.seekg(0, ios_base::end);
+        const size_t fileSize(m_file.tellg());
+        m_file.seekg(offset);
+
+        while(!m_file.eof() && !done)
+        {
+            memset(&recordHeader, 0, sizeof(TarHeader));
+            m_file.read((char*) &recordHeader, sizeof(TarHeader));
+
+            // a header which hasn't been completely written yet
+            // (or the end of a file without the final empty records)
+            if(m_file.gcount() < (std::streamsize) sizeof(TarHeader))
+                done = true;
+            else if(recordHeader.magic[0] == '\0')
+            {
+                bool allZero(true);
+                // check if this record is all zero; if so, assume
+                // we're at the end of the file
+                for(size_t i(0); i < sizeof(TarHeader); ++i)
                 {
-                    bool allZero(true);
-                    // check if this record is all zero; if so, assume
-                    // we're at the end of the file
-                    for(size_t i(0); i < sizeof(TarHeader); ++i)
-                    {
-                        allZero &= ((char*) &recordHeader)[i] == '\0';
-                    }
-
-                    done |= allZero;
+                    allZero &= ((char*) &recordHeader)[i] == '\0';
                 }
-                else if(strncmp("ustar", recordHeader.magic, 5))
+
+                done |= allZero;
+            }
+            else if(strncmp("ustar", recordHeader.magic, 5))
+            {
+                stringstream message;
+                message << "Error reading tar record at position " <<
+                    offset << ": magic mismatch (is this actually a tar file?)";
+
+                // If this fails at offset 0, we must not have
+                // been given an actual tar archive; otherwise,
+                // finish reading immediately with whatever we've
+                // found so far
+                if(!offset)
+                    throw runtime_error(message.str());
+                else
                 {
-                    stringstream message;
-                    message << "Error reading tar record at position " <<
-                        offset << ": magic mismatch (is this actually a tar file?)";
-
-                    // If this fails at offset 0, we must not have
-                    // been given an actual tar archive; otherwise,
-                    // finish reading immediately with whatever we've
-                    // found so far
-                    if(!offset)
-                        throw runtime_error(message.str());
-                    else
-                    {
-                        std::cerr << message.str() << std::endl;
-                        done = true;
-                    }
+                    std::cerr << message.str() << std::endl;
+                    done = true;
                 }
+            }
+            else
+            {
+                string fileName(string(recordHeader.prefix) +
+                                string(recordHeader.name));
+
+                size_t size(0);
+                stringstream sizeStream;
+                sizeStream << recordHeader.size;
+                sizeStream >> oct >> size;
+
+                // a file whose contents haven't all been written yet
+                // is found by a later refresh()
+                if(offset + sizeof(TarHeader) + size > fileSize)
+                    done = true;
                 else
                 {
-                    string fileName(string(recordHeader.prefix) +
-                                    string(recordHeader.name));
-
-                    size_t size(0);
-                    stringstream sizeStream;
-                    sizeStream << recordHeader.size;
-                    sizeStream >> oct >> size;
-
                     m_fileNames.push_back(fileName);
                     m_fileOffsets[fileName] = offset + sizeof(TarHeader);
                     m_fileSizes[fileName] = size;
 
                     offset += sizeof(TarHeader) + (size + 511)/512*512;
+                    m_maxPosition = offset;
 
                     m_file.seekg(offset);
+                    ++m_stats.seeks;
                 }
             }
-
-            m_file.clear();
-            m_file.seekg(0);
-        }
-
-        if(m_fileNames.size())
-        {
-            const string lastName = m_fileNames[m_fileNames.size() - 1];
-            m_maxPosition = m_fileOffsets[lastName] + (m_fileSizes[lastName] + 511)/512*512;
-        }
-
-        if(m_mode == Append)
-        {
-            m_file.seekp(m_maxPosition);
-            m_filePosition = m_maxPosition;
         }
 
+        m_file.clear();
+        m_file.seekg(0);
     }
 
-    TarArchive::~TarArchive()
+    void TarArchive::refresh()
     {
-        close();
+        if(m_mode == Read)
+            findFiles(m_maxPosition);
     }
 
     void TarArchive::close()
     {
         if(m_file.is_open())
         {
+            ScopedTimer timer(m_stats.ioTime, "finalize");
             m_file.seekp(m_maxPosition);
             // pad the end of file with two 512B blocks
             for(size_t i(0); i < 1024; ++i)
@@ -178,6 +220,7 @@ namespace gtar{
             {
                 m_file.seekp(m_maxPosition);
                 m_filePosition = m_maxPosition;
+                ++m_stats.seeks;
             }
             break;
         }
@@ -254,17 +297,24 @@ namespace gtar{
         checksumStream << '\0' << ' ';
         checksumStream.get(recordHeader.chksum, 8);
 
-        m_file.write((const char*) &recordHeader, sizeof(TarHeader));
-        m_file.write((const char*) contents, byteLength);
-
-        // pad all records up to 512 bytes
-        if(byteLength % 512)
-            for(size_t i(byteLength % 512); i < 512; ++i)
-                m_file.put('\0');
+        {
+            ScopedTimer timer(m_stats.ioTime, "store", &path);
+            m_file.write((const char*) &recordHeader, sizeof(TarHeader));
+            m_file.write((const char*) contents, byteLength);
+
+            // pad all records up to 512 bytes
+            if(byteLength % 512)
+                for(size_t i(byteLength % 512); i < 512; ++i)
+                    m_file.put('\0');
+        }
 
         if(immediate)
             endBulkWrites();
 
+        ++m_stats.writes;
+        m_stats.bytesWritten += byteLength;
+        m_stats.uncompressedBytesWritten += byteLength;
+
         const size_t deltaSize = sizeof(TarHeader) + (byteLength + 511)/512*512;
         m_filePosition += deltaSize;
         m_maxPosition += deltaSize;
@@ -280,6 +330,7 @@ namespace gtar{
 
     void TarArchive::endBulkWrites()
     {
+        ScopedTimer timer(m_stats.ioTime, "flush");
         m_file.flush();
     }
 
@@ -288,10 +339,22 @@ namespace gtar{
         if(m_fileOffsets.find(path) == m_fileOffsets.end())
             return SharedArray<char>();
 
-        m_file.seekg(m_fileOffsets[path]);
-
         const size_t size(m_fileSizes[path]);
-        SharedArray<char> result(new char[size], size);
+        SharedArray<char> result;
+        ScopedTimer timer(m_stats.ioTime, "load", &path);
+
+        ++m_stats.reads;
+        m_stats.bytesRead += size;
+        m_stats.uncompressedBytesRead += size;
+
+        // large files are mapped rather than copied if asked to
+        if(m_mode == Read && m_mapFiles &&
+           mapFile(m_filename, m_fileOffsets[path], size, result))
+            return result;
+
+        m_file.seekg(m_fileOffsets[path]);
+        ++m_stats.seeks;
+        result = SharedArray<char>(new char[size], size);
 
         m_file.read(result.get(), size);
 
@@ -300,6 +363,20 @@ namespace gtar{
         return result;
     }
 
+    FileInfo TarArchive::getFileInfo(const string &path)
+    {
+        FileInfo result;
+        std::map<std::string, size_t>::const_iterator iter(m_fileSizes.find(path));
+
+        if(iter != m_fileSizes.end())
+        {
+            result.storedLength = result.byteLength = iter->second;
+            result.version = m_fileOffsets[path];
+        }
+
+        return result;
+    }
+
     unsigned int TarArchive::size()
     {
         return m_fileNames.size();
@@ -310,6 +387,21 @@ namespace gtar{
         return m_fileNames[index];
     }
 
+    ArchiveIndex TarArchive::getIndex()
+    {
+        ArchiveIndex result;
+        result.names = m_fileNames;
+
+        for(vector<string>::const_iterator iter(m_fileNames.begin());
+            iter != m_fileNames.end(); ++iter)
+        {
+            result.offsets.push_back(m_fileOffsets[*iter]);
+            result.lengths.push_back(m_fileSizes[*iter]);
+        }
+
+        return result;
+    }
+
 }
 
 #ifdef GTAR_NAMESPACE_PARENT
@@ -26,8 +26,11 @@ namespace gtar{
     {
     public:
         // Constructor: Open or create an archive object with the
-        // given filename and access mode
-        TarArchive(const std::string &filename, const OpenMode mode);
+        // given filename and access mode. If an index (see
+        // getIndex()) of the same file is given, it is used instead
+        // of reading every header of the file.
+        TarArchive(const std::string &filename, const OpenMode mode,
+                   const ArchiveIndex *index=NULL);
 
         // Destructor: Clean up memory used
         virtual ~TarArchive();
@@ -47,12 +50,29 @@ namespace gtar{
         // Read the contents of the given location within the archive
         virtual SharedArray<char> read(const std::string &path);
 
+        // Return the sizes and compression of the file at the given
+        // location from the archive's index
+        virtual FileInfo getFileInfo(const std::string &path);
+
         // Return the number of files stored in the archive
         virtual unsigned int size();
         // Return the name of the file with the given numerical index
         virtual std::string getItemName(unsigned int index);
 
+        // Return the names, positions, and sizes of the files in the
+        // archive
+        virtual ArchiveIndex getIndex();
+
+        // Read the headers of files appended since the archive was
+        // opened or last refreshed
+        virtual void refresh();
+
     private:
+        // Read the headers of the files stored from the given
+        // position onward, adding those which have been completely
+        // written to the file location maps
+        void findFiles(size_t offset);
+
         // Name of the archive file we're accessing
         const std::string m_filename;
         // How we're accessing the archive
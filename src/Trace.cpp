@@ -0,0 +1,369 @@
+// Trace.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Each thread records spans into its own buffer if C++11 threads are
+// available
+#if __cplusplus > 199711L
+#define GTAR_USE_THREADS
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#elif defined(_WIN32)
+#include <ctime>
+#else
+#include <sys/time.h>
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Trace.hpp"
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    using std::ofstream;
+    using std::runtime_error;
+    using std::string;
+    using std::stringstream;
+    using std::vector;
+
+    // Number of spans kept for each thread
+    static const size_t TRACE_BUFFER_SIZE = 1 << 14;
+    // Number of characters of the detail of each span which are kept
+    static const size_t TRACE_DETAIL_LENGTH = 96;
+
+    // A span recorded by recordSpan()
+    struct TraceEvent
+    {
+        const char *name;
+        char detail[TRACE_DETAIL_LENGTH];
+        double start;
+        double end;
+        unsigned int thread;
+    };
+
+    // Ring buffer of the most recent spans of a thread. Only the
+    // thread using it writes to it, so spans are recorded without
+    // locks; writeTrace() keeps only the spans which can't have been
+    // overwritten while it copied them.
+    struct TraceBuffer
+    {
+        TraceBuffer():
+            events(TRACE_BUFFER_SIZE), count(0), owned(false), thread(0)
+        {}
+
+        std::vector<TraceEvent> events;
+#ifdef GTAR_USE_THREADS
+        // Number of spans ever recorded
+        std::atomic<uint64_t> count;
+        // Whether a running thread records into this buffer; buffers
+        // of threads which have exited are reused by new ones
+        std::atomic<bool> owned;
+#else
+        uint64_t count;
+        bool owned;
+#endif
+        // Thread id to record spans with
+        unsigned int thread;
+    };
+
+    // Where spans are written and the buffers of every thread
+    struct TraceState
+    {
+        TraceState():
+#ifdef GTAR_USE_THREADS
+            mutex(),
+#endif
+            filename(), buffers(), numThreads(0)
+        {}
+
+#ifdef GTAR_USE_THREADS
+        // Guards the other members and writing the trace
+        std::mutex mutex;
+#endif
+        string filename;
+        vector<TraceBuffer*> buffers;
+        unsigned int numThreads;
+    };
+
+#ifdef GTAR_USE_THREADS
+    static std::atomic<bool> s_tracing(false);
+#else
+    static bool s_tracing(false);
+#endif
+
+    static TraceState *createTraceState()
+    {
+        TraceState *result(new TraceState());
+        const char *filename(getenv("GETAR_TRACE"));
+
+#ifdef GTAR_TRACE_FILE
+        if(!filename || !*filename)
+            filename = GTAR_TRACE_FILE;
+#endif
+
+        if(filename && *filename)
+        {
+            result->filename = filename;
+            s_tracing = true;
+        }
+
+        return result;
+    }
+
+    static TraceState &traceState()
+    {
+        // never destroyed, so that threads may still record spans
+        // while the program exits
+        static TraceState *state(createTraceState());
+        return *state;
+    }
+
+#ifdef GTAR_USE_THREADS
+    // Gives up a thread's buffer when the thread exits
+    struct LocalTraceBuffer
+    {
+        LocalTraceBuffer():
+            buffer(NULL)
+        {}
+
+        ~LocalTraceBuffer()
+        {
+            if(buffer)
+                buffer->owned = false;
+        }
+
+        TraceBuffer *buffer;
+    };
+
+    static thread_local LocalTraceBuffer s_localBuffer;
+#endif
+
+    // Find the buffer of the current thread
+    static TraceBuffer &localBuffer()
+    {
+#ifdef GTAR_USE_THREADS
+        if(s_localBuffer.buffer)
+            return *s_localBuffer.buffer;
+
+        TraceState &state(traceState());
+        std::lock_guard<std::mutex> lock(state.mutex);
+#else
+        static TraceBuffer *singleBuffer(NULL);
+        if(singleBuffer)
+            return *singleBuffer;
+
+        TraceState &state(traceState());
+#endif
+
+        TraceBuffer *result(NULL);
+        for(size_t i(0); i < state.buffers.size() && !result; ++i)
+            if(!state.buffers[i]->owned)
+                result = state.buffers[i];
+
+        if(!result)
+        {
+            result = new TraceBuffer();
+            state.buffers.push_back(result);
+        }
+
+        result->owned = true;
+        result->thread = ++state.numThreads;
+
+#ifdef GTAR_USE_THREADS
+        s_localBuffer.buffer = result;
+#else
+        singleBuffer = result;
+#endif
+        return *result;
+    }
+
+    // Write a string as a JSON string literal
+    static void writeJsonString(std::ostream &output, const char *value)
+    {
+        output << '"';
+        for(; *value; ++value)
+        {
+            const unsigned char c(*value);
+            if(c == '"' || c == '\\')
+                output << '\\' << c;
+            else if(c < 0x20)
+                output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c
+                       << std::dec << std::setfill(' ');
+            else
+                output << c;
+        }
+        output << '"';
+    }
+
+    double monotonicSeconds()
+    {
+#ifdef GTAR_USE_THREADS
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif defined(_WIN32)
+        return (double) clock()/CLOCKS_PER_SEC;
+#else
+        timeval now;
+        gettimeofday(&now, NULL);
+        return now.tv_sec + 1e-6*now.tv_usec;
+#endif
+    }
+
+    void startTracing(const string &filename)
+    {
+        TraceState &state(traceState());
+#ifdef GTAR_USE_THREADS
+        std::lock_guard<std::mutex> lock(state.mutex);
+#endif
+        state.filename = filename;
+        s_tracing = !filename.empty();
+    }
+
+    void stopTracing()
+    {
+        writeTrace();
+        s_tracing = false;
+    }
+
+    bool tracingEnabled()
+    {
+        // read the environment the first time
+        traceState();
+#ifdef GTAR_USE_THREADS
+        return s_tracing.load(std::memory_order_relaxed);
+#else
+        return s_tracing;
+#endif
+    }
+
+    void recordSpan(const char *name, const string *detail, double start, double end)
+    {
+        TraceBuffer &buffer(localBuffer());
+#ifdef GTAR_USE_THREADS
+        const uint64_t index(buffer.count.load(std::memory_order_relaxed));
+#else
+        const uint64_t index(buffer.count);
+#endif
+        TraceEvent &event(buffer.events[index % TRACE_BUFFER_SIZE]);
+
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        event.thread = buffer.thread;
+
+        const size_t detailLength(detail? std::min(detail->size(), TRACE_DETAIL_LENGTH - 1): 0);
+        if(detailLength)
+            memcpy(event.detail, detail->data(), detailLength);
+        event.detail[detailLength] = '\0';
+
+#ifdef GTAR_USE_THREADS
+        buffer.count.store(index + 1, std::memory_order_release);
+#else
+        buffer.count = index + 1;
+#endif
+    }
+
+    void writeTrace()
+    {
+        if(!tracingEnabled())
+            return;
+
+        TraceState &state(traceState());
+#ifdef GTAR_USE_THREADS
+        std::lock_guard<std::mutex> lock(state.mutex);
+#endif
+
+        vector<TraceEvent> events;
+        for(size_t i(0); i < state.buffers.size(); ++i)
+        {
+            TraceBuffer &buffer(*state.buffers[i]);
+#ifdef GTAR_USE_THREADS
+            const uint64_t end(buffer.count.load(std::memory_order_acquire));
+#else
+            const uint64_t end(buffer.count);
+#endif
+            const uint64_t begin(end > TRACE_BUFFER_SIZE? end - TRACE_BUFFER_SIZE: 0);
+
+            vector<TraceEvent> copied;
+            for(uint64_t index(begin); index < end; ++index)
+                copied.push_back(buffer.events[index % TRACE_BUFFER_SIZE]);
+
+            // the thread may have kept recording while we copied,
+            // overwriting the oldest spans and perhaps in the middle
+            // of overwriting one more
+#ifdef GTAR_USE_THREADS
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after(buffer.count.load(std::memory_order_relaxed));
+#else
+            const uint64_t after(end);
+#endif
+            const uint64_t firstValid(after + 1 > TRACE_BUFFER_SIZE?
+                                      after + 1 - TRACE_BUFFER_SIZE: 0);
+
+            for(uint64_t index(begin); index < end; ++index)
+                if(index >= firstValid)
+                    events.push_back(copied[index - begin]);
+        }
+
+#ifdef _WIN32
+        const int pid(_getpid());
+#else
+        const int pid(getpid());
+#endif
+
+        ofstream output(state.filename.c_str());
+        output << std::fixed << std::setprecision(3);
+        output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+        for(size_t i(0); i < events.size(); ++i)
+        {
+            const TraceEvent &event(events[i]);
+            output << (i? ",\n": "\n") << "{\"ph\": \"X\", \"cat\": \"getar\", \"name\": ";
+            writeJsonString(output, event.name);
+            output << ", \"pid\": " << pid << ", \"tid\": " << event.thread
+                   << ", \"ts\": " << 1e6*event.start
+                   << ", \"dur\": " << 1e6*(event.end - event.start);
+            if(event.detail[0])
+            {
+                output << ", \"args\": {\"path\": ";
+                writeJsonString(output, event.detail);
+                output << "}";
+            }
+            output << "}";
+        }
+
+        output << "\n]}\n";
+        output.close();
+
+        if(!output)
+        {
+            stringstream message;
+            message << "Error writing trace to " << state.filename;
+            throw runtime_error(message.str());
+        }
+    }
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
@@ -0,0 +1,71 @@
+// Trace.hpp
+// by Matthew Spellings <mspells@umich.edu>
+
+#include <string>
+
+#ifndef __TRACE_HPP_
+#define __TRACE_HPP_
+
+#ifdef GTAR_NAMESPACE_PARENT
+namespace GTAR_NAMESPACE_PARENT{
+#endif
+
+namespace gtar{
+
+    /// Seconds elapsed since an arbitrary fixed time, for measuring
+    /// durations
+    double monotonicSeconds();
+
+    /// Start recording spans of time spent opening, indexing,
+    /// reading, writing, compressing, and closing archives on every
+    /// thread. The spans are written to the given file in the Chrome
+    /// trace event format (which chrome://tracing and Perfetto can
+    /// display) each time an archive is closed and by
+    /// writeTrace(). Each thread keeps only its most recent spans.
+    /// Tracing is started automatically with the file named by the
+    /// GETAR_TRACE environment variable, if it is set, or the one
+    /// given by the GTAR_TRACE_FILE macro when libgetar was built.
+    void startTracing(const std::string &filename);
+    /// Write any recorded spans and stop recording them
+    void stopTracing();
+    /// Returns true if spans are being recorded
+    bool tracingEnabled();
+    /// Write the spans recorded so far to the trace file given to
+    /// startTracing(), if tracing is enabled
+    void writeTrace();
+
+    /// Record a span of the given name (which must remain valid
+    /// until the trace is written, like a string literal) between
+    /// two times given by monotonicSeconds() on the current
+    /// thread. detail (if not NULL) is a path or other string
+    /// describing what the span worked on.
+    void recordSpan(const char *name, const std::string *detail, double start, double end);
+
+    /// Records a span for the time it exists, if tracing is enabled
+    class TraceSpan
+    {
+    public:
+        TraceSpan(const char *name, const std::string *detail=NULL):
+            m_name(tracingEnabled()? name: NULL), m_detail(detail),
+            m_start(m_name? monotonicSeconds(): 0)
+        {}
+
+        ~TraceSpan()
+        {
+            if(m_name)
+                recordSpan(m_name, m_detail, m_start, monotonicSeconds());
+        }
+
+    private:
+        const char *m_name;
+        const std::string *m_detail;
+        const double m_start;
+    };
+
+}
+
+#ifdef GTAR_NAMESPACE_PARENT
+}
+#endif
+
+#endif
@@ -1,9 +1,15 @@
 // ZipArchive.cpp
 // by Matthew Spellings <mspells@umich.edu>
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
 
+#include "Codec.hpp"
+#include "Crc32.hpp"
+#include "Deflate.hpp"
+#include "MappedFile.hpp"
 #include "ZipArchive.hpp"
 #include "miniz.h"
 #include "SharedArray.hpp"
@@ -14,14 +20,32 @@ namespace GTAR_NAMESPACE_PARENT{
 
 namespace gtar{
 
+    using std::max;
+    using std::min;
     using std::runtime_error;
     using std::string;
     using std::stringstream;
     using std::vector;
 
+    // Zip compression method number assigned to Zstandard
+    static const mz_uint16 ZIP_METHOD_ZSTD = 93;
+    // Files at least twice this size are deflated in chunks of this
+    // size on multiple threads
+    static const size_t PARALLEL_DEFLATE_CHUNK = 1 << 20;
+    // Size of the fixed part of the header before each file
+    static const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+
     ZipArchive::ZipArchive(const string &filename, const OpenMode mode):
-        m_filename(filename), m_mode(mode), m_archive(), m_path_map()
+        m_filename(filename), m_mode(mode), m_archive(), m_path_map(),
+        m_fileSize(0), m_fileTime(0),
+#ifdef MINIZ_DISABLE_ZIP_READER_CRC32_CHECKS
+        m_verifyChecksums(false),
+#else
+        m_verifyChecksums(true),
+#endif
+        m_numThreads(1)
     {
+        ScopedTimer timer(m_stats.indexTime, "index");
         mz_zip_zero_struct(&m_archive);
 
         if(m_mode == Write)
@@ -40,6 +64,13 @@ namespace gtar{
         }
         else if(m_mode == Read)
         {
+            struct stat fileStat;
+            if(stat(filename.c_str(), &fileStat) == 0)
+            {
+                m_fileSize = fileStat.st_size;
+                m_fileTime = modificationTime(fileStat);
+            }
+
             mz_bool success(
                 mz_zip_reader_init_file_v2(&m_archive, filename.c_str(),
                                            MZ_ZIP_FLAG_CASE_SENSITIVE, 0, 0));
@@ -98,6 +129,7 @@ namespace gtar{
 
     void ZipArchive::close()
     {
+        ScopedTimer timer(m_stats.ioTime, "finalize");
         if(m_mode == Write || m_mode == Append)
         {
             mz_zip_writer_finalize_archive(&m_archive);
@@ -115,27 +147,112 @@ namespace gtar{
         if(m_mode == Read)
             throw runtime_error("Can't write to an archive opened for reading");
 
-        mz_uint flags(MZ_ZIP_FLAG_CASE_SENSITIVE);
-
         switch(mode)
         {
         case FastCompress:
-            flags |= MZ_BEST_SPEED;
+            // our own deflate encoder is much faster than miniz's
+            // fastest level
+            writeCodec(path, contents, byteLength, DeflateCodec, MZ_BEST_SPEED, immediate);
             break;
         case MediumCompress:
-            flags |= MZ_DEFAULT_LEVEL;
+            writeCodec(path, contents, byteLength, DeflateCodec, MZ_DEFAULT_LEVEL, immediate);
             break;
         case SlowCompress:
-            flags |= MZ_BEST_COMPRESSION;
+            writeCodec(path, contents, byteLength, DeflateCodec, MZ_BEST_COMPRESSION, immediate);
             break;
         case NoCompress:
         default:
-            flags |= MZ_NO_COMPRESSION;
+            writeCodec(path, contents, byteLength, NoCodec, 0, immediate);
         }
+    }
 
-        bool success(
-            mz_zip_writer_add_mem(&m_archive, path.c_str(), contents,
-                                  byteLength, flags));
+    bool ZipArchive::storesCodec(unsigned int codec) const
+    {
+        return codec == NoCodec || codec == DeflateCodec ||
+            codec == ZstdCodec || codec == ZstdLongCodec;
+    }
+
+    void ZipArchive::writeCodec(const string &path, const void *contents,
+                                const size_t byteLength, unsigned int codec,
+                                int level, bool immediate)
+    {
+        if(m_mode == Read)
+            throw runtime_error("Can't write to an archive opened for reading");
+
+        // the base class reports an error for other codecs
+        if(!storesCodec(codec))
+        {
+            Archive::writeCodec(path, contents, byteLength, codec, level, immediate);
+            return;
+        }
+
+        const mz_uint zipLevel(codec == DeflateCodec?
+                               min(max(level, 0), (int) MZ_UBER_COMPRESSION):
+                               MZ_NO_COMPRESSION);
+
+        if(codec == DeflateCodec && zipLevel != MZ_NO_COMPRESSION &&
+           byteLength >= 2*PARALLEL_DEFLATE_CHUNK && deflateThreads(m_numThreads) > 1)
+        {
+            // deflate large files in pieces on several threads and
+            // store them as one ordinary deflate stream
+            vector<char> compressed;
+            mz_uint32 crc(0);
+            {
+                ScopedTimer timer(m_stats.compressTime, "compress", &path);
+                crc = parallelDeflate((const char*) contents, byteLength, zipLevel,
+                                      PARALLEL_DEFLATE_CHUNK, m_numThreads, compressed);
+            }
+
+            addMem(path, &compressed[0], compressed.size(),
+                   MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                   MZ_DEFLATED, byteLength, crc);
+            return;
+        }
+
+        if((codec == ZstdCodec || codec == ZstdLongCodec ||
+            (codec == DeflateCodec && level == MZ_BEST_SPEED)) && byteLength)
+        {
+            // compress with the codec rather than miniz (which can
+            // only deflate, and does so slowly at its fastest level)
+            // and store the compressed bytes directly
+            const Codec &compressor(getCodec(codec));
+            vector<char> compressed(compressor.compressedBound(byteLength));
+            mz_uint32 crc(0);
+            {
+                ScopedTimer timer(m_stats.compressTime, "compress", &path);
+                compressed.resize(compressor.compressBytes((const char*) contents, byteLength,
+                                                           &compressed[0], compressed.size(),
+                                                           level));
+                crc = updateCrc32(0, (const char*) contents, byteLength);
+            }
+
+            addMem(path, &compressed[0], compressed.size(),
+                   MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                   codec == DeflateCodec? MZ_DEFLATED: ZIP_METHOD_ZSTD, byteLength, crc);
+            return;
+        }
+
+        addMem(path, contents, byteLength, MZ_ZIP_FLAG_CASE_SENSITIVE | zipLevel, 0, 0, 0);
+    }
+
+    void ZipArchive::addMem(const string &path, const void *contents,
+                            const size_t byteLength, mz_uint flags,
+                            mz_uint16 method, mz_uint64 uncompressedSize,
+                            mz_uint32 crc)
+    {
+        // miniz compresses the contents itself unless they are
+        // already compressed or stored as they are
+        const bool compressing(!(flags & MZ_ZIP_FLAG_COMPRESSED_DATA) && (flags & 0xF));
+
+        m_archive.m_compressed_data_method = method;
+        bool success(false);
+        {
+            ScopedTimer timer(compressing? m_stats.compressTime: m_stats.ioTime,
+                              compressing? "compress and store": "store", &path);
+            success = mz_zip_writer_add_mem_ex(&m_archive, path.c_str(), contents,
+                                               byteLength, NULL, 0, flags, uncompressedSize, crc);
+        }
+        m_archive.m_compressed_data_method = 0;
 
         if(!success)
         {
@@ -146,6 +263,22 @@ namespace gtar{
         }
 
         m_path_map[path] = size() - 1;
+
+        mz_zip_archive_file_stat stat;
+        mz_zip_reader_file_stat(&m_archive, size() - 1, &stat);
+        ++m_stats.writes;
+        m_stats.bytesWritten += stat.m_comp_size;
+        m_stats.uncompressedBytesWritten += stat.m_uncomp_size;
+    }
+
+    void ZipArchive::setVerifyChecksums(bool verify)
+    {
+        m_verifyChecksums = verify;
+    }
+
+    void ZipArchive::setNumThreads(unsigned int numThreads)
+    {
+        m_numThreads = numThreads;
     }
 
     void ZipArchive::beginBulkWrites()
@@ -156,12 +289,50 @@ namespace gtar{
     {
     }
 
-    void ZipArchive::fillPathMap()
+    void ZipArchive::fillPathMap(size_t start)
     {
-        for(size_t i(0); i < size(); ++i)
+        for(size_t i(start); i < size(); ++i)
             m_path_map[getItemName(i)] = i;
     }
 
+    void ZipArchive::refresh()
+    {
+        struct stat fileStat;
+        if(m_mode != Read || stat(m_filename.c_str(), &fileStat) != 0 ||
+           ((uint64_t) fileStat.st_size == m_fileSize && modificationTime(fileStat) == m_fileTime))
+            return;
+
+        ScopedTimer timer(m_stats.indexTime, "index");
+        mz_zip_archive refreshed;
+        mz_zip_zero_struct(&refreshed);
+
+        // while a writer has the archive open, the end of the file
+        // isn't a valid central directory; keep reading the files
+        // found before until it is (the files themselves aren't
+        // moved by writers appending to the archive)
+        if(!mz_zip_reader_init_file_v2(&refreshed, m_filename.c_str(),
+                                       MZ_ZIP_FLAG_CASE_SENSITIVE, 0, 0))
+            return;
+
+        // an archive with fewer files was replaced rather than
+        // appended to
+        const size_t oldSize(size());
+        if(mz_zip_reader_get_num_files(&refreshed) < oldSize)
+        {
+            mz_zip_reader_end(&refreshed);
+            return;
+        }
+
+        mz_zip_reader_end(&m_archive);
+        m_archive = refreshed;
+        // miniz's file reader refers to the archive object itself
+        m_archive.m_pIO_opaque = &m_archive;
+
+        m_fileSize = fileStat.st_size;
+        m_fileTime = modificationTime(fileStat);
+        fillPathMap(oldSize);
+    }
+
     SharedArray<char> ZipArchive::read(const string &path)
     {
         std::map<std::string, size_t>::iterator iter(m_path_map.find(path));
@@ -176,8 +347,74 @@ namespace gtar{
         mz_zip_archive_file_stat stat;
         mz_zip_reader_file_stat(&m_archive, fileIndex, &stat);
 
-        SharedArray<char> result(new char[stat.m_uncomp_size], stat.m_uncomp_size);
-        success = mz_zip_reader_extract_to_mem(&m_archive, fileIndex, result.get(), stat.m_uncomp_size, MZ_ZIP_FLAG_CASE_SENSITIVE);
+        ++m_stats.reads;
+        m_stats.bytesRead += stat.m_comp_size;
+        m_stats.uncompressedBytesRead += stat.m_uncomp_size;
+
+        SharedArray<char> result;
+        if(!stat.m_method && mapStored(stat, result))
+            return result;
+
+        result = SharedArray<char>(new char[stat.m_uncomp_size], stat.m_uncomp_size);
+
+        // decompress deflated and zstd entries with codecs rather
+        // than miniz's inflater, and check CRCs ourselves
+        if(stat.m_method == ZIP_METHOD_ZSTD)
+            success = readCodec(fileIndex, stat, ZstdCodec, result);
+        else if(stat.m_method == MZ_DEFLATED && stat.m_uncomp_size)
+            success = readCodec(fileIndex, stat, DeflateCodec, result);
+        else if(!stat.m_method)
+            success = readStored(fileIndex, stat, result);
+        else
+        {
+            ScopedTimer timer(m_stats.decompressTime, "decompress", &path);
+            ++m_stats.seeks;
+            success = mz_zip_reader_extract_to_mem(&m_archive, fileIndex, result.get(), stat.m_uncomp_size, MZ_ZIP_FLAG_CASE_SENSITIVE);
+        }
+
+        if(!success)
+        {
+            stringstream result;
+            result << "Failed extracting file " + path + ": ";
+            result << mz_zip_get_error_string(mz_zip_get_last_error(&m_archive));
+            throw runtime_error(result.str());
+        }
+
+        return result;
+    }
+
+    RawRecord ZipArchive::readRaw(const string &path)
+    {
+        std::map<std::string, size_t>::iterator iter(m_path_map.find(path));
+
+        if(iter == m_path_map.end())
+            return Archive::readRaw(path);
+
+        const size_t fileIndex(iter->second);
+        mz_zip_archive_file_stat stat;
+        mz_zip_reader_file_stat(&m_archive, fileIndex, &stat);
+
+        RawRecord result;
+        if(stat.m_method == ZIP_METHOD_ZSTD)
+            result.codec = ZstdCodec;
+        else if(stat.m_method == MZ_DEFLATED)
+            result.codec = DeflateCodec;
+
+        if(result.codec == NoCodec || !stat.m_uncomp_size)
+            return Archive::readRaw(path);
+
+        SharedArray<char> compressed(new char[stat.m_comp_size], stat.m_comp_size);
+        bool success(false);
+        {
+            ScopedTimer timer(m_stats.ioTime, "load", &path);
+            ++m_stats.reads;
+            ++m_stats.seeks;
+            m_stats.bytesRead += stat.m_comp_size;
+            m_stats.uncompressedBytesRead += stat.m_uncomp_size;
+            success = mz_zip_reader_extract_to_mem(
+                &m_archive, fileIndex, compressed.get(), stat.m_comp_size,
+                MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA);
+        }
 
         if(!success)
         {
@@ -187,6 +424,189 @@ namespace gtar{
             throw runtime_error(result.str());
         }
 
+        result.pieces.push_back(compressed);
+        result.byteLength = stat.m_uncomp_size;
+        result.crc = stat.m_crc32;
+        result.hasCrc = true;
+        return result;
+    }
+
+    bool ZipArchive::writeRaw(const string &path, const RawRecord &raw, bool /*immediate*/)
+    {
+        if(m_mode == Read)
+            throw runtime_error("Can't write to an archive opened for reading");
+
+        if(!storesRaw(raw))
+            return false;
+
+        // records from archives without checksums are decompressed
+        // to find one, which is still much faster than compressing
+        // them again
+        mz_uint32 crc(raw.crc);
+        if(!raw.hasCrc)
+        {
+            ScopedTimer timer(m_stats.decompressTime, "checksum", &path);
+            SharedArray<char> contents(decodeRaw(raw));
+            crc = updateCrc32(0, contents.get(), contents.size());
+        }
+
+        SharedArray<char> compressed(raw.pieces[0]);
+        addMem(path, compressed.get(), compressed.size(),
+               MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA,
+               raw.codec == DeflateCodec? MZ_DEFLATED: ZIP_METHOD_ZSTD, raw.byteLength, crc);
+        return true;
+    }
+
+    bool ZipArchive::storesRaw(const RawRecord &raw) const
+    {
+        return raw.pieces.size() == 1 && raw.codec != NoCodec && storesCodec(raw.codec);
+    }
+
+    RawRecord ZipArchive::encodeRaw(const SharedArray<char> &contents, CompressMode mode) const
+    {
+        SharedArray<char> source(contents);
+        int level(MZ_NO_COMPRESSION);
+        if(mode == FastCompress)
+            level = MZ_BEST_SPEED;
+        else if(mode == MediumCompress)
+            level = MZ_DEFAULT_LEVEL;
+        else if(mode == SlowCompress)
+            level = MZ_BEST_COMPRESSION;
+
+        if(level == MZ_NO_COMPRESSION || !source.size())
+            return Archive::encodeRaw(contents, mode);
+
+        const Codec &compressor(getCodec(DeflateCodec));
+        const size_t bound(compressor.compressedBound(source.size()));
+        vector<char> compressed(bound);
+        compressed.resize(compressor.compressBytes(source.get(), source.size(),
+                                                   &compressed[0], bound, level));
+
+        RawRecord result;
+        result.pieces.push_back(SharedArray<char>(new char[compressed.size()], compressed.size()));
+        memcpy(result.pieces.back().get(), &compressed[0], compressed.size());
+        result.codec = DeflateCodec;
+        result.byteLength = source.size();
+        result.crc = updateCrc32(0, source.get(), source.size());
+        result.hasCrc = true;
+        return result;
+    }
+
+    bool ZipArchive::readStored(size_t fileIndex, const mz_zip_archive_file_stat &stat,
+                                SharedArray<char> &target)
+    {
+        // the raw contents of stored files are the files themselves
+        {
+            ScopedTimer timer(m_stats.ioTime, "load");
+            ++m_stats.seeks;
+            if(!mz_zip_reader_extract_to_mem(&m_archive, fileIndex, target.get(), target.size(),
+                                             MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA))
+                return false;
+        }
+
+        ScopedTimer timer(m_stats.decompressTime, "checksum");
+        if(m_verifyChecksums && updateCrc32(0, target.get(), target.size()) != stat.m_crc32)
+        {
+            mz_zip_set_last_error(&m_archive, MZ_ZIP_CRC_CHECK_FAILED);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ZipArchive::mapStored(const mz_zip_archive_file_stat &stat, SharedArray<char> &target)
+    {
+        if(m_mode != Read || !m_mapFiles || stat.m_comp_size != stat.m_uncomp_size)
+            return false;
+
+        ScopedTimer timer(m_stats.ioTime, "map");
+
+        // the contents follow the local header and its variable-length
+        // name and extra fields
+        unsigned char header[ZIP_LOCAL_HEADER_SIZE];
+        if(m_archive.m_pRead(m_archive.m_pIO_opaque, stat.m_local_header_ofs, header,
+                             ZIP_LOCAL_HEADER_SIZE) != ZIP_LOCAL_HEADER_SIZE ||
+           header[0] != 'P' || header[1] != 'K' || header[2] != 3 || header[3] != 4)
+            return false;
+
+        const size_t dataOffset(stat.m_local_header_ofs + ZIP_LOCAL_HEADER_SIZE +
+                                (header[26] | (header[27] << 8)) +
+                                (header[28] | (header[29] << 8)));
+
+        SharedArray<char> mapped;
+        if(!mapFile(m_filename, dataOffset, stat.m_uncomp_size, mapped))
+            return false;
+
+        if(m_verifyChecksums && updateCrc32(0, mapped.get(), mapped.size()) != stat.m_crc32)
+        {
+            stringstream result;
+            result << "Failed extracting file " << stat.m_filename << ": ";
+            result << mz_zip_get_error_string(MZ_ZIP_CRC_CHECK_FAILED);
+            throw runtime_error(result.str());
+        }
+
+        target.swap(mapped);
+        return true;
+    }
+
+    bool ZipArchive::readCodec(size_t fileIndex, const mz_zip_archive_file_stat &stat,
+                               unsigned int codec, SharedArray<char> &target)
+    {
+        SharedArray<char> compressed(new char[stat.m_comp_size], stat.m_comp_size);
+
+        {
+            ScopedTimer timer(m_stats.ioTime, "load");
+            ++m_stats.seeks;
+            if(!mz_zip_reader_extract_to_mem(&m_archive, fileIndex, compressed.get(), stat.m_comp_size,
+                                             MZ_ZIP_FLAG_CASE_SENSITIVE | MZ_ZIP_FLAG_COMPRESSED_DATA))
+                return false;
+        }
+
+        ScopedTimer timer(m_stats.decompressTime, "decompress");
+        size_t decompressedSize(0);
+        try
+        {
+            decompressedSize = getCodec(codec).decompressBytes(
+                compressed.get(), compressed.size(), target.get(), target.size());
+        }
+        catch(runtime_error&)
+        {
+        }
+
+        if(decompressedSize != stat.m_uncomp_size)
+        {
+            mz_zip_set_last_error(&m_archive, MZ_ZIP_DECOMPRESSION_FAILED);
+            return false;
+        }
+
+        if(m_verifyChecksums && updateCrc32(0, target.get(), target.size()) != stat.m_crc32)
+        {
+            mz_zip_set_last_error(&m_archive, MZ_ZIP_CRC_CHECK_FAILED);
+            return false;
+        }
+
+        return true;
+    }
+
+    FileInfo ZipArchive::getFileInfo(const string &path)
+    {
+        std::map<std::string, size_t>::iterator iter(m_path_map.find(path));
+        FileInfo result;
+
+        if(iter == m_path_map.end())
+            return result;
+
+        mz_zip_archive_file_stat stat;
+        mz_zip_reader_file_stat(&m_archive, iter->second, &stat);
+
+        result.storedLength = stat.m_comp_size;
+        result.byteLength = stat.m_uncomp_size;
+        result.version = stat.m_local_header_ofs;
+        if(stat.m_method == ZIP_METHOD_ZSTD)
+            result.codec = ZstdCodec;
+        else if(stat.m_method == MZ_DEFLATED)
+            result.codec = DeflateCodec;
+
         return result;
     }
 
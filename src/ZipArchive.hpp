@@ -40,20 +40,86 @@ namespace gtar{
                               const size_t byteLength, CompressMode mode,
                               bool immediate=false);
 
+        // Returns true for codecs zip files can store natively
+        // (deflate, Zstandard, or no compression)
+        virtual bool storesCodec(unsigned int codec) const;
+
+        // Write the contents of a pointer to the given path within
+        // the archive, compressed with the given codec and level
+        virtual void writeCodec(const std::string &path, const void *contents,
+                                const size_t byteLength, unsigned int codec,
+                                int level, bool immediate=false);
+
+        // Enable or disable verification of the CRC-32 of each file
+        // as it is read
+        virtual void setVerifyChecksums(bool verify);
+
+        // Set the number of threads used to deflate large files (0
+        // for one per processor)
+        virtual void setNumThreads(unsigned int numThreads);
+
         virtual void beginBulkWrites();
         virtual void endBulkWrites();
 
         // Read the contents of the given location within the archive
         virtual SharedArray<char> read(const std::string &path);
 
+        // Read the compressed contents of the given location, for
+        // files which are deflated or compressed with Zstandard
+        virtual RawRecord readRaw(const std::string &path);
+
+        // Store a raw record compressed in one piece with deflate or
+        // Zstandard as it is
+        virtual bool writeRaw(const std::string &path, const RawRecord &raw,
+                              bool immediate=false);
+
+        // Returns true for raw records compressed in one piece with
+        // deflate or Zstandard
+        virtual bool storesRaw(const RawRecord &raw) const;
+
+        // Deflate contents at the level writePtr() uses for mode
+        virtual RawRecord encodeRaw(const SharedArray<char> &contents,
+                                    CompressMode mode) const;
+
+        // Return the sizes and compression of the file at the given
+        // location from the archive's index
+        virtual FileInfo getFileInfo(const std::string &path);
+
         // Return the number of files stored in the archive
         virtual unsigned int size();
         // Return the name of the file with the given numerical index
         virtual std::string getItemName(unsigned int index);
 
+        // Read the central directory again if the file changed since
+        // it was last read. Zip archives only have a complete central
+        // directory once their writer has closed them, so files
+        // appended since are found after the next close.
+        virtual void refresh();
+
     private:
-        // fill m_path_map
-        void fillPathMap();
+        // fill m_path_map with the files from the given index onward
+        void fillPathMap(size_t start=0);
+
+        // Add a file to the archive with the given miniz flags. For
+        // data which have already been compressed, also give the zip
+        // method number, uncompressed size, and crc32 of the data.
+        void addMem(const std::string &path, const void *contents,
+                    const size_t byteLength, mz_uint flags, mz_uint16 method,
+                    mz_uint64 uncompressedSize, mz_uint32 crc);
+
+        // Copy a file stored without compression into target, which
+        // must be exactly large enough
+        bool readStored(size_t fileIndex, const mz_zip_archive_file_stat &stat,
+                        SharedArray<char> &target);
+
+        // Point target at the contents of a large stored file mapped
+        // into memory, if possible
+        bool mapStored(const mz_zip_archive_file_stat &stat, SharedArray<char> &target);
+
+        // Decompress a file compressed with the given codec into
+        // target, which must be exactly large enough
+        bool readCodec(size_t fileIndex, const mz_zip_archive_file_stat &stat,
+                       unsigned int codec, SharedArray<char> &target);
 
         // Name of the archive file we're accessing
         const std::string m_filename;
@@ -63,6 +129,15 @@ namespace gtar{
         mz_zip_archive m_archive;
         // Stored map of path -> last archive index that contains the path
         std::map<std::string, size_t> m_path_map;
+        // Size and modification time of the file when its central
+        // directory was last read
+        uint64_t m_fileSize;
+        uint64_t m_fileTime;
+        // Whether to check the CRC-32 of files as they are read
+        bool m_verifyChecksums;
+        // Number of threads to deflate large files with, or 0 for
+        // one per processor
+        unsigned int m_numThreads;
     };
 
     // Helper function to be accessed from python. Checks if a zip
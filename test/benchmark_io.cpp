@@ -0,0 +1,635 @@
+// benchmark_io.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+// Measures the time to open archives, read their records in order
+// and at random, and write them immediately or in bulk, for each
+// backend over a matrix of record sizes, record counts, and
+// compression modes. Results are written as JSON.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "GTAR.hpp"
+#include "Trace.hpp"
+
+using namespace gtar;
+using namespace std;
+
+static const char *USAGE =
+    "usage: benchmark_io [--backends zip,tar,sqlite,dir] [--sizes 4K,64K,1M]\n"
+    "                    [--counts 64,512] [--modes none,fast] [--cache warm,cold]\n"
+    "                    [--repeats 3] [--max-bytes 64M] [--seed 1]\n"
+    "                    [--dir DIR] [--output FILE]\n"
+    "\n"
+    "Time opening, reading, and writing archives of every combination of\n"
+    "backend, record size (bytes), record count, and compression mode\n"
+    "(none, fast, medium, slow) and write the results as JSON to FILE\n"
+    "(standard output by default). Combinations storing more than\n"
+    "--max-bytes are skipped. Cold-cache reads evict the archive from\n"
+    "the page cache before each repetition where the system supports it.\n";
+
+struct Options
+{
+    Options():
+        backends(), sizes(), counts(), modes(), caches(), repeats(3),
+        maxBytes(64 << 20), seed(1), directory("."), output("-")
+    {}
+
+    vector<string> backends;
+    vector<size_t> sizes;
+    vector<size_t> counts;
+    vector<string> modes;
+    vector<string> caches;
+    size_t repeats;
+    size_t maxBytes;
+    uint64_t seed;
+    string directory;
+    string output;
+};
+
+// Summary of the repeated measurements of one operation
+struct Timing
+{
+    Timing():
+        min(0), median(0)
+    {}
+
+    double min;
+    double median;
+};
+
+// xorshift64*, so that the generated data and random read orders are
+// the same on every system
+class Random
+{
+public:
+    Random(uint64_t seed):
+        m_state(seed? seed: 1)
+    {}
+
+    uint64_t next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state*2685821657736338717ULL;
+    }
+
+    // Uniform in [0, 1)
+    double uniform()
+    {
+        return (next() >> 11)*(1.0/9007199254740992.0);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+static vector<string> split(const string &value)
+{
+    vector<string> result;
+    stringstream stream(value);
+    string item;
+    while(getline(stream, item, ','))
+        if(!item.empty())
+            result.push_back(item);
+    return result;
+}
+
+// Parse a number of bytes, optionally with a K, M, or G suffix
+static size_t parseSize(const string &value)
+{
+    char *end(NULL);
+    const double number(strtod(value.c_str(), &end));
+    size_t scale(1);
+
+    if(*end == 'k' || *end == 'K')
+        scale = 1 << 10;
+    else if(*end == 'm' || *end == 'M')
+        scale = 1 << 20;
+    else if(*end == 'g' || *end == 'G')
+        scale = 1 << 30;
+    else if(*end)
+        end = NULL;
+
+    if(end == NULL || end == value.c_str() || (*end && end[1]) || number < 0)
+    {
+        stringstream msg;
+        msg << "Invalid size: " << value;
+        throw runtime_error(msg.str());
+    }
+
+    return (size_t) (number*scale);
+}
+
+static vector<size_t> parseSizes(const string &value)
+{
+    const vector<string> items(split(value));
+    vector<size_t> result;
+    for(size_t i(0); i < items.size(); ++i)
+        result.push_back(parseSize(items[i]));
+    return result;
+}
+
+static CompressMode parseMode(const string &name)
+{
+    if(name == "none")
+        return NoCompress;
+    else if(name == "fast")
+        return FastCompress;
+    else if(name == "medium")
+        return MediumCompress;
+    else if(name == "slow")
+        return SlowCompress;
+
+    stringstream msg;
+    msg << "Unknown compression mode: " << name;
+    throw runtime_error(msg.str());
+}
+
+static string archiveName(const Options &options, const string &backend)
+{
+    const string base(options.directory + "/getar_benchmark");
+
+    if(backend == "zip")
+        return base + ".zip";
+    else if(backend == "tar")
+        return base + ".tar";
+    else if(backend == "sqlite")
+        return base + ".sqlite";
+    else if(backend == "dir")
+        return base + "_dir/";
+
+    stringstream msg;
+    msg << "Unknown backend: " << backend;
+    throw runtime_error(msg.str());
+}
+
+static string recordPath(size_t index)
+{
+    stringstream result;
+    result << "frames/" << index << "/position.f32.ind";
+    return result.str();
+}
+
+// Names of the files on disk which hold the records of an archive
+static vector<string> diskFiles(const string &filename, const vector<string> &paths)
+{
+    vector<string> result;
+
+    if(filename[filename.size() - 1] == '/')
+        for(size_t i(0); i < paths.size(); ++i)
+            result.push_back(filename + paths[i]);
+    else
+        result.push_back(filename);
+
+    return result;
+}
+
+static void removeArchive(const string &filename, const vector<string> &paths)
+{
+    const vector<string> files(diskFiles(filename, paths));
+    for(size_t i(0); i < files.size(); ++i)
+        remove(files[i].c_str());
+
+    if(filename[filename.size() - 1] != '/')
+        return;
+
+    // remove the directories of a directory archive, deepest first
+    set<string> directories;
+    for(size_t i(0); i < paths.size(); ++i)
+        for(size_t slash(paths[i].rfind('/')); slash != string::npos && slash > 0;
+            slash = paths[i].rfind('/', slash - 1))
+            directories.insert(paths[i].substr(0, slash));
+
+    directories.insert("");
+    vector<string> ordered(directories.begin(), directories.end());
+    for(size_t i(ordered.size()); i > 0; --i)
+    {
+        const string name(filename + ordered[i - 1]);
+#ifdef _WIN32
+        _rmdir(name.c_str());
+#else
+        rmdir(name.c_str());
+#endif
+    }
+}
+
+// Returns true if files can be evicted from the page cache
+static bool canEvict()
+{
+#if defined(POSIX_FADV_DONTNEED) && !defined(__APPLE__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Flush the given files to disk and drop them from the page cache so
+// that the next reads come from the disk
+static void evictFiles(const vector<string> &files)
+{
+#if defined(POSIX_FADV_DONTNEED) && !defined(__APPLE__)
+    for(size_t i(0); i < files.size(); ++i)
+    {
+        const int fd(open(files[i].c_str(), O_RDONLY));
+        if(fd < 0)
+            continue;
+
+        // dirty pages can't be dropped
+        fsync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void) files;
+#endif
+}
+
+// Fill a frame of particle positions which move slightly from the
+// previous frame, like the output of a simulation
+static void fillFrame(vector<float> &positions, Random &random)
+{
+    for(size_t i(0); i < positions.size(); ++i)
+        positions[i] += (float) (0.01*(random.uniform() - 0.5));
+}
+
+// Touch every page of a record read from the archive so that mapped
+// records are actually read
+static uint64_t touch(const SharedArray<char> &bytes)
+{
+    SharedArray<char> local(bytes);
+    uint64_t result(0);
+    for(size_t i(0); i < local.size(); i += 512)
+        result += (unsigned char) local.get()[i];
+    return result;
+}
+
+static Timing summarize(vector<double> values)
+{
+    Timing result;
+    if(values.empty())
+        return result;
+
+    sort(values.begin(), values.end());
+    result.min = values[0];
+    result.median = values.size() % 2? values[values.size()/2]:
+        0.5*(values[values.size()/2 - 1] + values[values.size()/2]);
+    return result;
+}
+
+static double percentile(vector<double> values, double fraction)
+{
+    if(values.empty())
+        return 0;
+
+    sort(values.begin(), values.end());
+    size_t index((size_t) ceil(fraction*values.size()));
+    index = index? index - 1: 0;
+    return values[min(index, values.size() - 1)];
+}
+
+static void writeTiming(ostream &output, const string &name, const Timing &timing,
+                        double bytes)
+{
+    output << "\"" << name << "\": {\"min\": " << timing.min
+           << ", \"median\": " << timing.median;
+    if(bytes > 0)
+        output << ", \"bytesPerSecond\": " << (timing.median > 0? bytes/timing.median: 0);
+    output << "}";
+}
+
+// Results of the benchmarks of a single combination of parameters
+class Benchmark
+{
+public:
+    Benchmark(const Options &options, const string &backend, size_t recordSize,
+              size_t recordCount, const string &mode):
+        m_options(options), m_backend(backend), m_filename(archiveName(options, backend)),
+        m_recordSize(recordSize), m_recordCount(recordCount), m_modeName(mode),
+        m_mode(parseMode(mode)), m_paths(), m_frames(), m_storedBytes(0)
+    {
+        Random random(options.seed);
+        vector<float> positions(max(recordSize/sizeof(float), (size_t) 1));
+        for(size_t i(0); i < positions.size(); ++i)
+            positions[i] = (float) (10*random.uniform());
+
+        for(size_t i(0); i < recordCount; ++i)
+        {
+            fillFrame(positions, random);
+            m_paths.push_back(recordPath(i));
+            m_frames.push_back(vector<char>(recordSize));
+            memcpy(&m_frames.back()[0], &positions[0],
+                   min(recordSize, positions.size()*sizeof(float)));
+        }
+    }
+
+    ~Benchmark()
+    {
+        removeArchive(m_filename, m_paths);
+    }
+
+    // Run every benchmark and write the results as a JSON object
+    void run(ostream &output)
+    {
+        vector<double> immediate, bulk;
+        for(size_t i(0); i < m_options.repeats; ++i)
+        {
+            immediate.push_back(write(false));
+            bulk.push_back(write(true));
+        }
+
+        {
+            GTAR archive(m_filename, Read);
+            for(size_t i(0); i < m_paths.size(); ++i)
+                m_storedBytes += archive.getFileInfo(m_paths[i]).storedLength;
+        }
+
+        const double bytes((double) m_recordSize*m_recordCount);
+
+        output << "{\"backend\": \"" << m_backend << "\", \"recordSize\": " << m_recordSize
+               << ", \"recordCount\": " << m_recordCount << ", \"compress\": \""
+               << m_modeName << "\", \"storedBytes\": " << m_storedBytes << ",\n  ";
+        writeTiming(output, "writeImmediate", summarize(immediate), bytes);
+        output << ",\n  ";
+        writeTiming(output, "writeBulk", summarize(bulk), bytes);
+        output << ",\n  \"reads\": {";
+
+        for(size_t cache(0); cache < m_options.caches.size(); ++cache)
+        {
+            const bool cold(m_options.caches[cache] == "cold");
+            vector<double> opens, sequential, random, latencies;
+
+            // warm the cache, or make sure the first repetition is as
+            // cold as the rest
+            readAll(false, latencies);
+            latencies.clear();
+
+            for(size_t i(0); i < m_options.repeats; ++i)
+            {
+                if(cold)
+                    evictFiles(diskFiles(m_filename, m_paths));
+                opens.push_back(open());
+
+                if(cold)
+                    evictFiles(diskFiles(m_filename, m_paths));
+                sequential.push_back(readAll(false, latencies));
+                latencies.clear();
+
+                if(cold)
+                    evictFiles(diskFiles(m_filename, m_paths));
+                random.push_back(readAll(true, latencies));
+            }
+
+            double meanLatency(0);
+            for(size_t i(0); i < latencies.size(); ++i)
+                meanLatency += latencies[i]/latencies.size();
+
+            output << (cache? ",\n    ": "\n    ") << "\"" << m_options.caches[cache]
+                   << "\": {\n      ";
+            writeTiming(output, "open", summarize(opens), 0);
+            output << ",\n      ";
+            writeTiming(output, "sequentialRead", summarize(sequential), bytes);
+            output << ",\n      ";
+            writeTiming(output, "randomRead", summarize(random), bytes);
+            output << ",\n      \"seekLatency\": {\"mean\": " << meanLatency
+                   << ", \"p50\": " << percentile(latencies, 0.5)
+                   << ", \"p99\": " << percentile(latencies, 0.99) << "}}";
+        }
+
+        output << "}}";
+    }
+
+private:
+    // Write every record and close the archive, returning the time taken
+    double write(bool bulk)
+    {
+        removeArchive(m_filename, m_paths);
+
+        const double start(monotonicSeconds());
+        {
+            GTAR archive(m_filename, Write);
+            if(bulk)
+            {
+                GTAR::BulkWriter writer(archive);
+                for(size_t i(0); i < m_paths.size(); ++i)
+                    writer.writePtr(m_paths[i], &m_frames[i][0], m_recordSize, m_mode);
+            }
+            else
+                for(size_t i(0); i < m_paths.size(); ++i)
+                    archive.writePtr(m_paths[i], &m_frames[i][0], m_recordSize, m_mode);
+        }
+        return monotonicSeconds() - start;
+    }
+
+    // Open and index the archive, returning the time taken
+    double open()
+    {
+        const double start(monotonicSeconds());
+        GTAR archive(m_filename, Read);
+        return monotonicSeconds() - start;
+    }
+
+    // Read every record in order or in a random order, appending the
+    // time to read each to latencies and returning the total time
+    double readAll(bool shuffle, vector<double> &latencies)
+    {
+        vector<size_t> order(m_paths.size());
+        for(size_t i(0); i < order.size(); ++i)
+            order[i] = i;
+
+        if(shuffle)
+        {
+            Random random(m_options.seed + latencies.size() + 1);
+            for(size_t i(order.size()); i > 1; --i)
+                swap(order[i - 1], order[random.next() % i]);
+        }
+
+        GTAR archive(m_filename, Read);
+        uint64_t checksum(0);
+
+        const double start(monotonicSeconds());
+        for(size_t i(0); i < order.size(); ++i)
+        {
+            const double readStart(monotonicSeconds());
+            SharedArray<char> bytes(archive.readBytes(m_paths[order[i]]));
+            checksum += touch(bytes);
+            latencies.push_back(monotonicSeconds() - readStart);
+
+            if(bytes.size() != m_recordSize)
+            {
+                stringstream msg;
+                msg << "Read " << bytes.size() << " bytes from " << m_paths[order[i]]
+                    << " instead of " << m_recordSize;
+                throw runtime_error(msg.str());
+            }
+        }
+        const double result(monotonicSeconds() - start);
+
+        // keep the compiler from skipping the reads
+        if(checksum == 1)
+            cerr << "";
+        return result;
+    }
+
+    const Options &m_options;
+    const string m_backend;
+    const string m_filename;
+    const size_t m_recordSize;
+    const size_t m_recordCount;
+    const string m_modeName;
+    const CompressMode m_mode;
+    vector<string> m_paths;
+    vector<vector<char> > m_frames;
+    uint64_t m_storedBytes;
+};
+
+static void parseOptions(int argc, char **argv, Options &options)
+{
+    options.backends = split("zip,tar,sqlite,dir");
+    options.sizes = parseSizes("4K,64K,1M");
+    options.counts = parseSizes("64,512");
+    options.modes = split("none,fast");
+    options.caches = split(canEvict()? "warm,cold": "warm");
+
+    for(int i(1); i < argc; ++i)
+    {
+        const string arg(argv[i]);
+        if(arg == "-h" || arg == "--help")
+        {
+            cout << USAGE;
+            exit(0);
+        }
+        else if(i + 1 >= argc || arg.substr(0, 2) != "--")
+        {
+            stringstream msg;
+            msg << "Unexpected argument: " << arg;
+            throw runtime_error(msg.str());
+        }
+
+        const string value(argv[++i]);
+        if(arg == "--backends")
+            options.backends = split(value);
+        else if(arg == "--sizes")
+            options.sizes = parseSizes(value);
+        else if(arg == "--counts")
+            options.counts = parseSizes(value);
+        else if(arg == "--modes")
+            options.modes = split(value);
+        else if(arg == "--cache")
+            options.caches = split(value);
+        else if(arg == "--repeats")
+            options.repeats = max(parseSize(value), (size_t) 1);
+        else if(arg == "--max-bytes")
+            options.maxBytes = parseSize(value);
+        else if(arg == "--seed")
+            options.seed = parseSize(value);
+        else if(arg == "--dir")
+            options.directory = value;
+        else if(arg == "--output")
+            options.output = value;
+        else
+        {
+            stringstream msg;
+            msg << "Unknown option: " << arg;
+            throw runtime_error(msg.str());
+        }
+    }
+
+    for(size_t i(0); i < options.modes.size(); ++i)
+        parseMode(options.modes[i]);
+    for(size_t i(0); i < options.backends.size(); ++i)
+        archiveName(options, options.backends[i]);
+    for(size_t i(0); i < options.caches.size(); ++i)
+    {
+        if(options.caches[i] != "warm" && options.caches[i] != "cold")
+        {
+            stringstream msg;
+            msg << "Unknown cache state: " << options.caches[i];
+            throw runtime_error(msg.str());
+        }
+        else if(options.caches[i] == "cold" && !canEvict())
+            cerr << "benchmark_io: can't evict files from the page cache on this system; "
+                 << "cold reads will be warm" << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        parseOptions(argc, argv, options);
+    }
+    catch(runtime_error &error)
+    {
+        cerr << "benchmark_io: " << error.what() << endl << USAGE;
+        return 2;
+    }
+
+    ofstream file;
+    if(options.output != "-")
+        file.open(options.output.c_str());
+    ostream &output(options.output != "-"? file: cout);
+
+    output << setprecision(6);
+    output << "{\"benchmark\": \"getar-io\", \"repeats\": " << options.repeats
+           << ", \"seed\": " << options.seed << ", \"results\": [";
+
+    try
+    {
+        size_t count(0);
+        for(size_t b(0); b < options.backends.size(); ++b)
+            for(size_t s(0); s < options.sizes.size(); ++s)
+                for(size_t c(0); c < options.counts.size(); ++c)
+                    for(size_t m(0); m < options.modes.size(); ++m)
+                    {
+                        if(options.sizes[s]*options.counts[c] > options.maxBytes ||
+                           !options.sizes[s] || !options.counts[c])
+                            continue;
+
+                        cerr << options.backends[b] << " size " << options.sizes[s]
+                             << " count " << options.counts[c] << " "
+                             << options.modes[m] << endl;
+
+                        output << (count++? ",\n": "\n");
+                        Benchmark benchmark(options, options.backends[b], options.sizes[s],
+                                            options.counts[c], options.modes[m]);
+                        benchmark.run(output);
+                    }
+    }
+    catch(runtime_error &error)
+    {
+        cerr << "benchmark_io: " << error.what() << endl;
+        return 1;
+    }
+
+    output << "\n]}\n";
+
+    if(!output)
+    {
+        cerr << "benchmark_io: error writing " << options.output << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,534 @@
+// benchmark_micro.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+// Measures the time and number of memory allocations of single
+// operations of the CPU-bound internals of libgetar: parsing and
+// formatting record paths, indexing archives, encoding tar headers,
+// and compressing particle data. Results are written as JSON.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Codec.hpp"
+#include "GTAR.hpp"
+#include "Record.hpp"
+#include "TarArchive.hpp"
+#include "Trace.hpp"
+#include "ZipArchive.hpp"
+
+using namespace gtar;
+using namespace std;
+
+static const char *USAGE =
+    "usage: benchmark_micro [--filter TEXT] [--min-time SECONDS] [--output FILE]\n"
+    "\n"
+    "Time the internal operations of libgetar whose names contain TEXT\n"
+    "(all of them by default), each for at least SECONDS (0.2 by default),\n"
+    "and write the time and number of allocations per operation as JSON\n"
+    "to FILE (standard output by default).\n";
+
+// Number of allocations made through operator new. The benchmarks
+// run on a single thread; allocations made by C code with malloc
+// (such as inside miniz or sqlite) aren't counted.
+static uint64_t s_allocations(0);
+
+static void *countedAllocation(size_t size)
+{
+    ++s_allocations;
+    void *result(malloc(size? size: 1));
+    if(!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+// Kept out of line: GCC otherwise inlines it into the callers of
+// operator delete and warns that memory from operator new is passed
+// to free()
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static void deallocate(void *ptr)
+{
+    free(ptr);
+}
+
+// Every replaceable allocation and deallocation function is replaced
+// together, so that each pair matches
+#if __cplusplus > 199711L
+void *operator new(size_t size)
+{
+    return countedAllocation(size);
+}
+
+void *operator new[](size_t size)
+{
+    return countedAllocation(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+#else
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+    return countedAllocation(size);
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc)
+{
+    return countedAllocation(size);
+}
+
+void operator delete(void *ptr) throw()
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) throw()
+{
+    deallocate(ptr);
+}
+#endif
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+#endif
+
+// An operation to time. run() performs it the given number of
+// times; each time may consist of opsPerRun operations, such as the
+// entries indexed by opening an archive once.
+class MicroBenchmark
+{
+public:
+    MicroBenchmark(const string &name, size_t bytesPerOp=0, size_t opsPerRun=1):
+        m_name(name), m_bytesPerOp(bytesPerOp), m_opsPerRun(opsPerRun)
+    {}
+
+    virtual ~MicroBenchmark()
+    {}
+
+    virtual void run(size_t count) = 0;
+
+    const string &name() const
+    {
+        return m_name;
+    }
+
+    size_t bytesPerOp() const
+    {
+        return m_bytesPerOp;
+    }
+
+    size_t opsPerRun() const
+    {
+        return m_opsPerRun;
+    }
+
+private:
+    const string m_name;
+    const size_t m_bytesPerOp;
+    const size_t m_opsPerRun;
+};
+
+// Fill positions of particles in a cubic lattice with small random
+// displacements, like a frame of a simulation
+static vector<float> particlePositions(size_t count)
+{
+    vector<float> result(3*count);
+    const size_t side((size_t) ceil(pow((double) count, 1.0/3)));
+    uint64_t state(1);
+
+    for(size_t i(0); i < count; ++i)
+    {
+        const size_t lattice[3] = {i % side, (i/side) % side, i/side/side};
+        for(size_t j(0); j < 3; ++j)
+        {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            const double noise((state >> 11)*(1.0/9007199254740992.0) - 0.5);
+            result[3*i + j] = (float) (1.5*(lattice[j] - 0.5*side) + 0.1*noise);
+        }
+    }
+
+    return result;
+}
+
+static vector<string> recordPaths(size_t count)
+{
+    vector<string> result;
+    for(size_t i(0); i < count; ++i)
+    {
+        stringstream path;
+        switch(i % 4)
+        {
+        case 0:
+            path << "frames/" << i << "/position.f32.ind";
+            break;
+        case 1:
+            path << "frames/" << i << "/box.f32.uni";
+            break;
+        case 2:
+            path << "rigid_body/frames/" << i << "/orientation.f32.ind";
+            break;
+        default:
+            path << "type_names.json";
+            break;
+        }
+        result.push_back(path.str());
+    }
+    return result;
+}
+
+// Number of record paths cycled through by the benchmarks of paths
+static const size_t NUM_PATHS = 1024;
+// Number of particles in the frames compressed by the codec benchmarks
+static const size_t NUM_PARTICLES = 4096;
+// Number of entries in the archives indexed by the open benchmarks
+static const size_t NUM_ENTRIES = 4096;
+
+class ParseRecord: public MicroBenchmark
+{
+public:
+    ParseRecord():
+        MicroBenchmark("Record(path)"), m_sink(0), m_paths(recordPaths(NUM_PATHS))
+    {}
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+        {
+            Record rec(m_paths[i % m_paths.size()]);
+            m_sink += rec.getName().size();
+        }
+    }
+
+private:
+    size_t m_sink;
+    vector<string> m_paths;
+};
+
+class GetPath: public MicroBenchmark
+{
+public:
+    GetPath():
+        MicroBenchmark("Record::getPath"), m_sink(0), m_records()
+    {
+        const vector<string> paths(recordPaths(NUM_PATHS));
+        for(size_t i(0); i < paths.size(); ++i)
+            m_records.push_back(Record(paths[i]));
+    }
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            m_sink += m_records[i % m_records.size()].getPath().size();
+    }
+
+private:
+    size_t m_sink;
+    vector<Record> m_records;
+};
+
+class SwapEndian: public MicroBenchmark
+{
+public:
+    SwapEndian():
+        MicroBenchmark("maybeSwapEndian<float>", 3*NUM_PARTICLES*sizeof(float)),
+        m_sink(0), m_positions(particlePositions(NUM_PARTICLES))
+    {}
+
+    virtual void run(size_t count)
+    {
+        // on little-endian systems only the length is checked, so
+        // use the result to keep the loop from being removed
+        for(size_t i(0); i < count; ++i)
+        {
+            maybeSwapEndian<float>(&m_positions[0], m_positions.size()*sizeof(float));
+            m_sink += m_positions[i % m_positions.size()];
+        }
+    }
+
+private:
+    float m_sink;
+    vector<float> m_positions;
+};
+
+// TarArchive::writePtr of an empty record, which is dominated by
+// encoding its header. Records are written to the null device.
+class EncodeTarHeader: public MicroBenchmark
+{
+public:
+    EncodeTarHeader():
+        MicroBenchmark("TarArchive::writePtr header"), m_paths(recordPaths(NUM_PATHS)),
+#ifdef _WIN32
+        m_archive("NUL", Write)
+#else
+        m_archive("/dev/null", Write)
+#endif
+    {}
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            m_archive.writePtr(m_paths[i % m_paths.size()], NULL, 0, NoCompress, false);
+    }
+
+private:
+    vector<string> m_paths;
+    TarArchive m_archive;
+};
+
+// Opening a zip archive (reading its central directory and filling
+// its map of paths), per entry
+class ZipIndex: public MicroBenchmark
+{
+public:
+    ZipIndex(const string &filename):
+        MicroBenchmark("ZipArchive::fillPathMap (open)", 0, NUM_ENTRIES), m_filename(filename)
+    {}
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            ZipArchive archive(m_filename, Read);
+    }
+
+private:
+    const string m_filename;
+};
+
+// Opening the same zip archive with GTAR, which also inserts each
+// entry into its index of records, per entry
+class InsertRecords: public MicroBenchmark
+{
+public:
+    InsertRecords(const string &filename):
+        MicroBenchmark("GTAR::insertRecord (open)", 0, NUM_ENTRIES), m_filename(filename)
+    {}
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            GTAR archive(m_filename, Read);
+    }
+
+private:
+    const string m_filename;
+};
+
+class CompressFrame: public MicroBenchmark
+{
+public:
+    CompressFrame(const string &name, const Codec &codec, CompressMode mode):
+        MicroBenchmark(name, 3*NUM_PARTICLES*sizeof(float)), m_codec(codec),
+        m_level(codec.defaultLevel(mode)), m_positions(particlePositions(NUM_PARTICLES)),
+        m_compressed(codec.compressedBound(bytesPerOp()))
+    {}
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            m_codec.compressBytes((const char*) &m_positions[0], bytesPerOp(),
+                                  &m_compressed[0], m_compressed.size(), m_level);
+    }
+
+protected:
+    const Codec &m_codec;
+    const int m_level;
+    vector<float> m_positions;
+    vector<char> m_compressed;
+};
+
+class DecompressFrame: public CompressFrame
+{
+public:
+    DecompressFrame(const string &name, const Codec &codec, CompressMode mode):
+        CompressFrame(name, codec, mode), m_compressedSize(0)
+    {
+        m_compressedSize = m_codec.compressBytes(
+            (const char*) &m_positions[0], bytesPerOp(), &m_compressed[0],
+            m_compressed.size(), m_level);
+    }
+
+    virtual void run(size_t count)
+    {
+        for(size_t i(0); i < count; ++i)
+            m_codec.decompressBytes(&m_compressed[0], m_compressedSize,
+                                    (char*) &m_positions[0], bytesPerOp());
+    }
+
+private:
+    size_t m_compressedSize;
+};
+
+// Run a benchmark in batches of increasing size until it has taken at
+// least minTime, then write its time and allocations per operation
+static void measure(MicroBenchmark &benchmark, double minTime, ostream &output, bool first)
+{
+    // warm up caches and any lazily-initialized state
+    benchmark.run(1);
+
+    size_t count(1);
+    double elapsed(0);
+    uint64_t allocations(0);
+
+    for(;;)
+    {
+        const uint64_t allocationsBefore(s_allocations);
+        const double start(monotonicSeconds());
+        benchmark.run(count);
+        elapsed = monotonicSeconds() - start;
+        allocations = s_allocations - allocationsBefore;
+
+        // operations which compile to nothing never take long enough
+        if(elapsed >= minTime || count > ((size_t) 1 << 40))
+            break;
+
+        // aim for a little more than the minimum time
+        const double scale(elapsed > 0? 1.2*minTime/elapsed: 100);
+        count = (size_t) (count*(scale > 100? 100: (scale < 2? 2: scale)));
+    }
+
+    const double ops((double) count*benchmark.opsPerRun());
+    const double nsPerOp(1e9*elapsed/ops);
+    const double allocationsPerOp(allocations/ops);
+
+    cerr << left << setw(36) << benchmark.name() << right << setw(14) << fixed
+         << setprecision(1) << nsPerOp << " ns/op" << setw(10) << setprecision(2)
+         << allocationsPerOp << " allocs/op";
+    if(benchmark.bytesPerOp())
+        cerr << " " << setw(12) << setprecision(1) << 1e3*benchmark.bytesPerOp()/nsPerOp << " MB/s";
+    cerr << endl;
+
+    output << (first? "\n": ",\n") << "{\"name\": \"" << benchmark.name()
+           << "\", \"iterations\": " << (uint64_t) ops << ", \"nsPerOp\": " << nsPerOp
+           << ", \"allocationsPerOp\": " << allocationsPerOp;
+    if(benchmark.bytesPerOp())
+        output << ", \"bytesPerOp\": " << benchmark.bytesPerOp();
+    output << "}";
+}
+
+// Write an archive of NUM_ENTRIES small records to index
+static void writeIndexArchive(const string &filename)
+{
+    const vector<string> paths(recordPaths(NUM_ENTRIES));
+    GTAR archive(filename, Write);
+    GTAR::BulkWriter writer(archive);
+    const float value(1);
+
+    for(size_t i(0); i < paths.size(); ++i)
+        writer.writePtr(paths[i], &value, sizeof(value), NoCompress);
+}
+
+int main(int argc, char **argv)
+{
+    string filter, outputName("-");
+    double minTime(0.2);
+
+    for(int i(1); i < argc; ++i)
+    {
+        const string arg(argv[i]);
+        if(arg == "-h" || arg == "--help")
+        {
+            cout << USAGE;
+            return 0;
+        }
+        else if(arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if(arg == "--min-time" && i + 1 < argc)
+            minTime = atof(argv[++i]);
+        else if(arg == "--output" && i + 1 < argc)
+            outputName = argv[++i];
+        else
+        {
+            cerr << "benchmark_micro: unexpected argument: " << arg << endl << USAGE;
+            return 2;
+        }
+    }
+
+    const string indexName("getar_benchmark_micro.zip");
+
+    ofstream file;
+    if(outputName != "-")
+        file.open(outputName.c_str());
+    ostream &output(outputName != "-"? file: cout);
+
+    output << setprecision(6) << "{\"benchmark\": \"getar-micro\", \"results\": [";
+
+    try
+    {
+        writeIndexArchive(indexName);
+
+        vector<MicroBenchmark*> benchmarks;
+        benchmarks.push_back(new ParseRecord());
+        benchmarks.push_back(new GetPath());
+        benchmarks.push_back(new SwapEndian());
+        benchmarks.push_back(new EncodeTarHeader());
+        benchmarks.push_back(new ZipIndex(indexName));
+        benchmarks.push_back(new InsertRecords(indexName));
+
+        const char *codecNames[] = {"lz4", "deflate"};
+        const CompressMode modes[] = {FastCompress, MediumCompress, SlowCompress};
+        const char *modeNames[] = {"fast", "medium", "slow"};
+        for(size_t c(0); c < 2; ++c)
+            for(size_t m(0); m < 3; ++m)
+            {
+                const Codec &codec(*findCodec(codecNames[c]));
+                const string suffix(string(codecNames[c]) + " " + modeNames[m]);
+                benchmarks.push_back(new CompressFrame("compress " + suffix, codec, modes[m]));
+                benchmarks.push_back(new DecompressFrame("decompress " + suffix, codec, modes[m]));
+            }
+
+        bool first(true);
+        for(size_t i(0); i < benchmarks.size(); ++i)
+        {
+            if(benchmarks[i]->name().find(filter) != string::npos)
+            {
+                measure(*benchmarks[i], minTime, output, first);
+                first = false;
+            }
+            delete benchmarks[i];
+        }
+    }
+    catch(runtime_error &error)
+    {
+        cerr << "benchmark_micro: " << error.what() << endl;
+        remove(indexName.c_str());
+        return 1;
+    }
+
+    remove(indexName.c_str());
+    output << "\n]}\n";
+
+    if(!output)
+    {
+        cerr << "benchmark_micro: error writing " << outputName << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,9 +1,16 @@
 
 #include "GTAR.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <string>
+#include <vector>
 
 using namespace gtar;
 using namespace std;
@@ -85,6 +92,573 @@ void runTests(int &result, string suffix)
         }
 
     }
+
+    const ShuffleMode shuffleModes[] = {ByteShuffle, BitShuffle};
+    for(size_t i(0); i < sizeof(shuffleModes)/sizeof(ShuffleMode); ++i)
+    {
+        // an odd length exercises the unvectorized tail
+        vector<double> values(1001);
+        for(size_t j(0); j < values.size(); ++j)
+            values[j] = rand()/(double) RAND_MAX;
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.setShuffle("", shuffleModes[i]);
+            arch.writeIndividual<vector<double>::iterator, double>(
+                "values.f64.ind", values.begin(), values.end(), FastCompress);
+        }
+
+        GTAR readArch("test" + suffix, Read);
+        SharedArray<double> readIndividual(readArch.readIndividual<double>("values.f64.ind"));
+
+        if(readIndividual.size() != values.size() ||
+           !equal(values.begin(), values.end(), readIndividual.begin()))
+        {
+            cerr << "readIndividual() returned a shuffled record which was not written"
+                 << endl;
+            ++result;
+        }
+    }
+
+    // dictionary compression uses LZ4HC for SlowCompress
+    const DeltaMode deltaModes[] = {XorDelta, DiffDelta, DictDelta, DictDelta};
+    const CompressMode deltaCompressModes[] = {FastCompress, FastCompress, FastCompress, SlowCompress};
+    for(size_t i(0); i < sizeof(deltaModes)/sizeof(DeltaMode); ++i)
+    {
+        const size_t numFrames(10), numParticles(64);
+        vector<vector<float> > frames(numFrames, vector<float>(3*numParticles));
+
+        for(size_t j(0); j < frames[0].size(); ++j)
+            frames[0][j] = rand()/(float) RAND_MAX;
+        for(size_t frame(1); frame < numFrames; ++frame)
+            for(size_t j(0); j < frames[frame].size(); ++j)
+                frames[frame][j] = frames[frame - 1][j] + 1e-3f*rand()/(float) RAND_MAX;
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.setDelta("position", deltaModes[i], 4);
+            arch.setShuffle("position", BitShuffle);
+
+            for(size_t frame(0); frame < numFrames; ++frame)
+            {
+                stringstream path;
+                path << "frames/" << frame << "/position.f32.ind";
+                arch.writeIndividual<vector<float>::iterator, float>(
+                    path.str(), frames[frame].begin(), frames[frame].end(),
+                    deltaCompressModes[i]);
+            }
+        }
+
+        GTAR readArch("test" + suffix, Read);
+
+        // read backwards so that each frame has to rebuild its chain
+        for(size_t frame(numFrames); frame > 0; --frame)
+        {
+            stringstream path;
+            path << "frames/" << (frame - 1) << "/position.f32.ind";
+            SharedArray<float> readIndividual(readArch.readIndividual<float>(path.str()));
+
+            if(readIndividual.size() != frames[frame - 1].size() ||
+               !equal(frames[frame - 1].begin(), frames[frame - 1].end(), readIndividual.begin()))
+            {
+                cerr << "readIndividual() returned a delta-encoded frame which was not written"
+                     << endl;
+                ++result;
+            }
+        }
+    }
+
+    const unsigned int codecs[] = {NoCodec, LZ4Codec, DeflateCodec, ZstdCodec, ZstdLongCodec};
+    for(size_t i(0); i < sizeof(codecs)/sizeof(unsigned int); ++i)
+    {
+        vector<double> values(1001);
+        for(size_t j(0); j < values.size(); ++j)
+            values[j] = j % 17;
+        const string text("codec test\n");
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.setCodec("", codecs[i]);
+            arch.setCodec("text", codecs[i], 1);
+            arch.writeIndividual<vector<double>::iterator, double>(
+                "values.f64.ind", values.begin(), values.end(), SlowCompress);
+            arch.writeString("text.json", text, FastCompress);
+        }
+
+        GTAR readArch("test" + suffix, Read);
+        SharedArray<double> readIndividual(readArch.readIndividual<double>("values.f64.ind"));
+        SharedArray<char> readText(readArch.readBytes("text.json"));
+
+        if(readIndividual.size() != values.size() ||
+           !equal(values.begin(), values.end(), readIndividual.begin()) ||
+           string(readText.begin(), readText.end()) != text)
+        {
+            cerr << "Records compressed with codec " << getCodec(codecs[i]).name()
+                 << " were not read back correctly" << endl;
+            ++result;
+        }
+    }
+
+    {
+        const float tolerance(1e-3f);
+        vector<float> values(999);
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = 200*rand()/(float) RAND_MAX - 100;
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.setQuantization("position", tolerance);
+            arch.writeIndividual<vector<float>::iterator, float>(
+                "position.f32.ind", values.begin(), values.end(), FastCompress);
+        }
+
+        GTAR readArch("test" + suffix, Read);
+        SharedArray<float> readIndividual(readArch.readIndividual<float>("position.f32.ind"));
+
+        bool withinTolerance(readIndividual.size() == values.size());
+        for(size_t i(0); withinTolerance && i < values.size(); ++i)
+            withinTolerance = fabs((double) readIndividual[i] - (double) values[i]) <= tolerance;
+
+        if(!withinTolerance)
+        {
+            cerr << "readIndividual() returned a quantized record outside of its tolerance"
+                 << endl;
+            ++result;
+        }
+    }
+
+    {
+        // large uncompressed records may be mapped into memory
+        vector<int> values(1 << 19);
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = rand();
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.writeIndividual<vector<int>::iterator, int>(
+                "large.i32.ind", values.begin(), values.end(), NoCompress);
+        }
+
+        SharedArray<int> readIndividual;
+        SharedArray<char> readBytes;
+        {
+            GTAR readArch("test" + suffix, Read);
+            readArch.setMapFiles(true);
+            readIndividual = readArch.readIndividual<int>("large.i32.ind");
+            readBytes = readArch.readBytes("large.i32.ind");
+        }
+
+        // both should remain valid after the archive is closed
+        if(readIndividual.size() != values.size() ||
+           !equal(values.begin(), values.end(), readIndividual.begin()) ||
+           readBytes.size() != values.size()*sizeof(int) ||
+           memcmp(readBytes.get(), &values[0], readBytes.size()))
+        {
+            cerr << "A large uncompressed record was not read back correctly" << endl;
+            ++result;
+        }
+    }
+
+    {
+        const size_t numFrames(4), frameSize(30);
+        vector<float> values(numFrames*frameSize);
+        vector<string> frames;
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = rand();
+
+        {
+            GTAR arch("test" + suffix, Write);
+            for(size_t frame(0); frame < numFrames; ++frame)
+            {
+                stringstream index;
+                index << frame;
+                frames.push_back(index.str());
+                arch.writeIndividual<vector<float>::iterator, float>(
+                    "frames/" + index.str() + "/charge.f32.ind",
+                    values.begin() + frame*frameSize, values.begin() + (frame + 1)*frameSize,
+                    FastCompress);
+            }
+        }
+
+        GTAR readArch("test" + suffix, Read);
+        vector<float> readFrames(values.size());
+        readArch.readFrames(Record("frames/0/charge.f32.ind"), frames, &readFrames[0],
+                            frameSize*sizeof(float));
+
+        bool threw(false);
+        try
+        {
+            readArch.readBytesInto("frames/0/charge.f32.ind", &readFrames[0], sizeof(float));
+        }
+        catch(runtime_error&)
+        {
+            threw = true;
+        }
+
+        if(readFrames != values || !threw)
+        {
+            cerr << "readFrames() did not read back the frames which were written" << endl;
+            ++result;
+        }
+    }
+
+    {
+        // records should read back the same after being copied as
+        // they are stored into any kind of archive
+        const size_t numFrames(4), frameSize(1000);
+        vector<float> values(numFrames*frameSize);
+        vector<string> paths;
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = rand() % 16;
+
+        {
+            GTAR arch("test" + suffix, Write);
+            arch.setDelta("charge", XorDelta, 2);
+            arch.setCodec("mass", ZstdCodec);
+            for(size_t frame(0); frame < numFrames; ++frame)
+            {
+                stringstream index;
+                index << frame;
+                paths.push_back("frames/" + index.str() + "/charge.f32.ind");
+                arch.writeIndividual<vector<float>::iterator, float>(
+                    paths.back(), values.begin() + frame*frameSize,
+                    values.begin() + (frame + 1)*frameSize, SlowCompress);
+            }
+            paths.push_back("mass.f32.ind");
+            arch.writeIndividual<vector<float>::iterator, float>(
+                paths.back(), values.begin(), values.end(), FastCompress);
+            paths.push_back("notes.txt");
+            arch.writeString(paths.back(), "copied", NoCompress);
+        }
+
+        const char *targets[] = {"copy.zip", "copy.tar", "copy.sqlite"};
+        for(size_t i(0); i < 3; ++i)
+        {
+            {
+                GTAR source("test" + suffix, Read);
+                GTAR target(targets[i], Write);
+                target.copyRecords(source, paths, FastCompress);
+            }
+
+            GTAR readArch(targets[i], Read);
+            vector<float> readFrames(values.size());
+            for(size_t frame(0); frame < numFrames; ++frame)
+                readArch.readBytesInto(paths[frame], &readFrames[frame*frameSize],
+                                       frameSize*sizeof(float));
+            SharedArray<float> mass(readArch.readIndividual<float>("mass.f32.ind"));
+            SharedArray<char> notes(readArch.readBytes("notes.txt"));
+
+            if(readFrames != values || mass.size() != values.size() ||
+               !equal(values.begin(), values.end(), mass.begin()) ||
+               string(notes.begin(), notes.end()) != "copied")
+            {
+                cerr << "copyRecords() from " << suffix << " to " << targets[i] <<
+                    " did not copy the records" << endl;
+                ++result;
+            }
+        }
+    }
+
+    {
+        // the last input with each record wins when merging, even
+        // for frames of a delta-encoded record split between inputs
+        const size_t numFrames(6), frameSize(1000);
+        vector<float> values(numFrames*frameSize);
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = rand() % 16;
+
+        vector<string> inputs;
+        for(size_t input(0); input < 2; ++input)
+        {
+            inputs.push_back((input? "merge_b": "merge_a") + suffix);
+            GTAR arch(inputs.back(), Write);
+            arch.setDelta("charge", XorDelta, 4);
+            // the second input has every other frame
+            for(size_t frame(input); frame < numFrames; frame += input + 1)
+            {
+                stringstream index;
+                index << frame;
+                vector<float> frameValues(values.begin() + frame*frameSize,
+                                          values.begin() + (frame + 1)*frameSize);
+                if(input)
+                    for(size_t i(0); i < frameSize; ++i)
+                        frameValues[i] += 1;
+                arch.writeIndividual<vector<float>::iterator, float>(
+                    "frames/" + index.str() + "/charge.f32.ind",
+                    frameValues.begin(), frameValues.end(), MediumCompress);
+            }
+            arch.writeString(input? "b.txt": "a.txt", inputs.back(), FastCompress);
+        }
+
+        const char *targets[] = {"merged.zip", "merged.tar", "merged.sqlite"};
+        for(size_t i(0); i < 6; ++i)
+        {
+            {
+                GTAR target(targets[i % 3], Write);
+                target.mergeArchives(inputs, FastCompress, i < 3? 1: 4);
+            }
+
+            GTAR readArch(targets[i % 3], Read);
+            vector<float> readFrames(values.size());
+            for(size_t frame(0); frame < numFrames; ++frame)
+            {
+                stringstream index;
+                index << frame;
+                readArch.readBytesInto("frames/" + index.str() + "/charge.f32.ind",
+                                       &readFrames[frame*frameSize], frameSize*sizeof(float));
+                for(size_t j(0); frame % 2 && j < frameSize; ++j)
+                    readFrames[frame*frameSize + j] -= 1;
+            }
+            SharedArray<char> a(readArch.readBytes("a.txt")), b(readArch.readBytes("b.txt"));
+
+            if(readFrames != values || string(a.begin(), a.end()) != inputs[0] ||
+               string(b.begin(), b.end()) != inputs[1])
+            {
+                cerr << "mergeArchives() from " << suffix << " to " << targets[i % 3] <<
+                    " did not keep the records of the last input" << endl;
+                ++result;
+            }
+        }
+    }
+
+    {
+        // file information should describe what was written, even
+        // for compressed files
+        {
+            GTAR arch("info" + suffix, Write);
+            arch.writeString("a.txt", string(10000, 'a'), FastCompress);
+            arch.writeString("b.txt", "b", NoCompress);
+            arch.writeString("a.txt", string(20000, 'a'), FastCompress);
+        }
+
+        GTAR readArch("info" + suffix, Read);
+        const vector<string> paths(readArch.getPaths());
+        const FileInfo info(readArch.getFileInfo("a.txt"));
+
+        if(paths.size() != 2 || find(paths.begin(), paths.end(), "a.txt") == paths.end() ||
+           find(paths.begin(), paths.end(), "b.txt") == paths.end())
+        {
+            cerr << "getPaths() did not list each file once for " << suffix << endl;
+            ++result;
+        }
+
+        if(info.byteLength != 20000 || !info.storedLength ||
+           (suffix != ".tar" && info.storedLength >= info.byteLength) ||
+           readArch.getFileInfo("b.txt").byteLength != 1)
+        {
+            cerr << "getFileInfo() reported the wrong sizes for " << suffix << endl;
+            ++result;
+        }
+    }
+
+    {
+        // counters should survive closing and count the bytes
+        // before any filters
+        vector<float> values(1000);
+        for(size_t i(0); i < values.size(); ++i)
+            values[i] = rand() % 16;
+
+        GTAR arch("stats" + suffix, Write);
+        arch.setShuffle("", ByteShuffle);
+        arch.writeIndividual<vector<float>::iterator, float>(
+            "frames/0/charge.f32.ind", values.begin(), values.end(), FastCompress);
+        arch.writeIndividual<vector<float>::iterator, float>(
+            "frames/1/charge.f32.ind", values.begin(), values.end(), FastCompress);
+        arch.close();
+
+        const ArchiveStats written(arch.stats());
+        map<string, ArchiveStats> records(arch.recordStats());
+
+        GTAR readArch("stats" + suffix, Read);
+        readArch.readBytes("frames/1/charge.f32.ind");
+        const ArchiveStats read(readArch.stats());
+
+        if(written.writes != 2 || written.uncompressedBytesWritten != 2*values.size()*sizeof(float) ||
+           !written.bytesWritten || records.size() != 1 ||
+           records["frames/*/charge.f32.ind"].writes != 2 || read.reads != 1 ||
+           read.uncompressedBytesRead != values.size()*sizeof(float))
+        {
+            cerr << "stats() counted the wrong number of reads or writes for " << suffix << endl;
+            ++result;
+        }
+    }
+
+    {
+        // cached records should be copies which survive being
+        // modified, and the least recently used should be evicted
+        {
+            GTAR arch("cache" + suffix, Write);
+            arch.writeString("a.txt", string(1000, 'a'), FastCompress);
+            arch.writeString("b.txt", string(1000, 'b'), FastCompress);
+        }
+
+        GTAR readArch("cache" + suffix, Read);
+        readArch.setCacheSize(1500);
+
+        SharedArray<char> first(readArch.readBytes("a.txt"));
+        first[0] = 'x';
+        SharedArray<char> second(readArch.readBytes("a.txt"));
+        readArch.readBytes("b.txt");
+        readArch.readBytes("a.txt");
+        const ArchiveStats stats(readArch.stats());
+
+        if(second.size() != 1000 || second[0] != 'a' || stats.cacheHits != 1 ||
+           stats.cacheMisses != 3 || stats.reads != 3)
+        {
+            cerr << "The record cache returned the wrong contents or counted the wrong "
+                 << "number of hits for " << suffix << endl;
+            ++result;
+        }
+    }
+
+    {
+        // an exported index should reproduce the records of the
+        // archive, and be ignored once the archive changes
+        vector<float> values(4, 1.0f);
+        {
+            GTAR arch("index" + suffix, Write);
+            arch.writeString("title.txt", "index", FastCompress);
+            arch.writeIndividual<vector<float>::iterator, float>(
+                "frames/0/position.f32.ind", values.begin(), values.end(), FastCompress);
+            arch.writeIndividual<vector<float>::iterator, float>(
+                "frames/1/position.f32.ind", values.begin(), values.end(), FastCompress);
+        }
+
+        GTAR scanned("index" + suffix, Read);
+        const string index(scanned.exportIndex());
+        GTAR indexed("index" + suffix, Read, index);
+        const ArchiveStats stats(indexed.stats());
+
+        const Record position("frames/0/position.f32.ind");
+        if(indexed.getPaths() != scanned.getPaths() ||
+           indexed.getRecordTypes() != scanned.getRecordTypes() ||
+           indexed.queryFrames(position) != scanned.queryFrames(position) ||
+           stats.seeks != 0 || indexed.readIndividual<float>("frames/1/position.f32.ind").size() != 4 ||
+           string(indexed.readBytes("title.txt").get(), 5) != "index")
+        {
+            cerr << "Opening with an exported index gave different records for " << suffix << endl;
+            ++result;
+        }
+
+        indexed.close();
+        scanned.close();
+
+        {
+            GTAR arch("index" + suffix, Append);
+            arch.writeIndividual<vector<float>::iterator, float>(
+                "frames/2/position.f32.ind", values.begin(), values.end(), FastCompress);
+        }
+
+        GTAR stale("index" + suffix, Read, index);
+        if(stale.queryFrames(position).size() != 3)
+        {
+            cerr << "An index of an archive which changed since was used for " << suffix << endl;
+            ++result;
+        }
+    }
+
+    {
+        // a reader should find records appended after it was opened;
+        // zip archives only once their writer has closed them
+        {
+            GTAR arch("refresh" + suffix, Write);
+            arch.writeString("frames/0/value.txt", "0", FastCompress);
+        }
+
+        GTAR reader("refresh" + suffix, Read);
+        unsigned int found(0);
+        {
+            GTAR writer("refresh" + suffix, Append);
+            writer.writeString("frames/1/value.txt", "1", FastCompress);
+            if(suffix != ".zip")
+                found += reader.refresh();
+            writer.writeString("frames/2/value.txt", "2", FastCompress);
+        }
+        found += reader.refresh();
+
+        SharedArray<char> last(reader.readBytes("frames/2/value.txt"));
+        if(found != 2 || reader.refresh() != 0 ||
+           reader.queryFrames(Record("frames/0/value.txt")).size() != 3 ||
+           last.size() != 1 || last[0] != '2')
+        {
+            cerr << "refresh() didn't find the records appended to " << suffix << endl;
+            ++result;
+        }
+
+        // rewritten records are read again rather than from the
+        // cache; sqlite archives don't list them twice
+        reader.setCacheSize(1024);
+        reader.readBytes("frames/1/value.txt");
+        {
+            GTAR writer("refresh" + suffix, Append);
+            writer.writeString("frames/1/value.txt", "one", FastCompress);
+        }
+        const unsigned int rewritten(reader.refresh());
+
+        SharedArray<char> contents(reader.readBytes("frames/1/value.txt"));
+        if((suffix == ".sqlite" && rewritten != 0) ||
+           reader.queryFrames(Record("frames/0/value.txt")).size() != 3 ||
+           string(contents.begin(), contents.end()) != "one")
+        {
+            cerr << "refresh() didn't find the rewritten record of " << suffix << endl;
+            ++result;
+        }
+    }
+
+    try
+    {
+        // records decoded by one reader should be found by another
+        // attached to the same shared cache
+        {
+            GTAR arch("shared" + suffix, Write);
+            arch.writeString("a.txt", string(1000, 'a'), FastCompress);
+        }
+
+        GTAR first("shared" + suffix, Read), second("shared" + suffix, Read);
+        first.setSharedCache(1 << 20);
+        second.setSharedCache(1 << 20);
+
+        first.readBytes("a.txt");
+        SharedArray<char> contents(second.readBytes("a.txt"));
+        const ArchiveStats stats(second.stats());
+
+        if(first.sharedCacheName() != second.sharedCacheName() ||
+           stats.sharedCacheHits != 1 || stats.reads != 0 ||
+           contents.size() != 1000 || contents[999] != 'a')
+        {
+            cerr << "The shared cache didn't return records added by another reader for "
+                 << suffix << endl;
+            ++result;
+        }
+
+        // a rewritten record is decoded again once it is found by
+        // refresh(), even while other readers still use the old one
+        // (sqlite archives always read the current one)
+        {
+            GTAR writer("shared" + suffix, Append);
+            writer.writeString("a.txt", string(1000, 'b'), FastCompress);
+        }
+        first.refresh();
+        SharedArray<char> rewritten(first.readBytes("a.txt"));
+        SharedArray<char> old(second.readBytes("a.txt"));
+
+        GTAR third("shared" + suffix, Read);
+        third.setSharedCache(1 << 20, first.sharedCacheName());
+        SharedArray<char> fresh(third.readBytes("a.txt"));
+        removeSharedCache(first.sharedCacheName());
+
+        if(rewritten.size() != 1000 || rewritten[999] != 'b' ||
+           old.size() != 1000 || old[999] != (suffix == ".sqlite"? 'b': 'a') ||
+           fresh.size() != 1000 || fresh[999] != 'b')
+        {
+            cerr << "The shared cache returned a rewritten record of " << suffix << endl;
+            ++result;
+        }
+    }
+    catch(runtime_error &error)
+    {
+        cerr << "Skipping shared cache tests: " << error.what() << endl;
+    }
 }
 
 int main()
@@ -0,0 +1,88 @@
+
+#include "GTAR.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+
+using namespace gtar;
+using namespace std;
+
+bool exists(const string &path)
+{
+    struct stat fileStat;
+    return !stat(path.c_str(), &fileStat);
+}
+
+// Run getar to extract every file of an archive into directory,
+// returning true if it succeeded
+bool extract(const string &getar, const string &filename, const string &directory)
+{
+    const string command("\"" + getar + "\" extract -C " + directory + " " + filename);
+    return system(command.c_str()) == 0;
+}
+
+void runTests(int &result, const string &getar, const string &suffix)
+{
+    const string filename("test_getar" + suffix);
+    const string directory("extracted_" + suffix.substr(1));
+
+    // leading slashes are dropped, so files land inside the
+    // directory (zip archives refuse to store such paths at all)
+    try
+    {
+        {
+            GTAR arch(filename, Write);
+            arch.writeString("/absolute.txt", "absolute", NoCompress);
+        }
+
+        if(!extract(getar, filename, directory) || !exists(directory + "/absolute.txt"))
+        {
+            cerr << "getar didn't extract an absolute path into the target directory for "
+                 << suffix << endl;
+            ++result;
+        }
+    }
+    catch(runtime_error &error)
+    {
+        cerr << "Skipping absolute path test for " << suffix << ": " << error.what() << endl;
+    }
+
+    // paths leading out of the directory are refused before anything
+    // is written
+    {
+        GTAR arch(filename, Write);
+        arch.writeString("inside.txt", "inside", NoCompress);
+        arch.writeString("nested/../../escaped_" + suffix.substr(1) + ".txt", "outside",
+                         NoCompress);
+    }
+
+    if(extract(getar, filename, directory + "/nested") ||
+       exists(directory + "/escaped_" + suffix.substr(1) + ".txt") ||
+       exists(directory + "/nested/inside.txt"))
+    {
+        cerr << "getar extracted a path outside of the target directory for "
+             << suffix << endl;
+        ++result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int result(0);
+
+    if(argc < 2)
+    {
+        cerr << "usage: test_getar GETAR_EXECUTABLE" << endl;
+        return 2;
+    }
+
+    runTests(result, argv[1], ".zip");
+    runTests(result, argv[1], ".tar");
+    runTests(result, argv[1], ".sqlite");
+
+    return result;
+}
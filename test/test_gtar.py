@@ -1,4 +1,7 @@
 import functools
+import json
+import pickle
+import shutil
 import unittest
 import sys
 import gtar
@@ -147,6 +150,12 @@ class TestGTAR(unittest.TestCase):
         with self.assertRaises(RuntimeError):
             arch.readPath('test.txt')
 
+        # settings of the underlying archive can't be changed either
+        with self.assertRaises(RuntimeError):
+            arch.setNumThreads(4)
+        with self.assertRaises(RuntimeError):
+            arch.setVerifyChecksums(False)
+
     def test_write_readonly(self, suffix):
         with gtar.GTAR('test' + suffix, 'w') as arch:
             arch.writeStr('test.txt', 'good')
@@ -155,6 +164,573 @@ class TestGTAR(unittest.TestCase):
             with self.assertRaises(RuntimeError):
                 arch.writeStr('test.txt', 'bad')
 
+    def test_delta(self, suffix):
+        frames = np.cumsum(np.random.uniform(
+            -1e-3, 1e-3, size=(10, 32, 3)), axis=0).astype(np.float32)
+
+        for (mode, codec) in [(gtar.DeltaMode.XorDelta, -1),
+                              (gtar.DeltaMode.DiffDelta, -1),
+                              (gtar.DeltaMode.DictDelta, -1),
+                              (gtar.DeltaMode.DictDelta, gtar.CodecId.ZstdCodec)]:
+            with gtar.GTAR('test' + suffix, 'w') as arch:
+                arch.setDelta('position', mode, 4)
+                if codec >= 0:
+                    arch.setCodec('position', codec)
+                for (i, frame) in enumerate(frames):
+                    arch.writePath('frames/{}/position.f32.ind'.format(i), frame)
+
+            with gtar.GTAR('test' + suffix, 'r') as arch:
+                for i in reversed(range(len(frames))):
+                    self.assertTrue(np.all(arch.readPath(
+                        'frames/{}/position.f32.ind'.format(i)) == frames[i]))
+
+    def test_shuffle(self, suffix):
+        records = {'frames/0/position.f32.ind': np.random.rand(101, 3).astype(np.float32),
+                   'frames/0/mass.f64.ind': np.random.rand(77),
+                   'frames/0/type.u32.ind': np.arange(33, dtype=np.uint32)}
+
+        for mode in [gtar.ShuffleMode.ByteShuffle, gtar.ShuffleMode.BitShuffle]:
+            with gtar.GTAR('test' + suffix, 'w') as arch:
+                arch.setShuffle('', mode)
+                for path in records:
+                    arch.writePath(path, records[path])
+
+            with gtar.GTAR('test' + suffix, 'r') as arch:
+                for path in records:
+                    self.assertTrue(np.all(arch.readPath(path) == records[path]))
+
+    def test_quantization(self, suffix):
+        tolerance = 1e-3
+        frames = [np.random.rand(64, 3).astype(np.float32)*10 for _ in range(5)]
+        frames[3][0, 0] = np.inf
+        mass = np.random.rand(77)*1e12
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.setQuantization('', tolerance)
+            arch.setDelta('position', gtar.DeltaMode.DiffDelta)
+            arch.setShuffle('position', gtar.ShuffleMode.BitShuffle)
+            for (i, frame) in enumerate(frames):
+                arch.writePath('frames/{}/position.f32.ind'.format(i), frame)
+            arch.writePath('frames/0/mass.f64.ind', mass)
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            for i in reversed(range(len(frames))):
+                result = arch.readPath('frames/{}/position.f32.ind'.format(i))
+                self.assertEqual(result.dtype, np.float32)
+                self.assertEqual(result.size, frames[i].size)
+                finite = np.isfinite(frames[i])
+                error = np.abs(result.reshape(frames[i].shape)[finite].astype(np.float64) -
+                               frames[i][finite])
+                self.assertTrue(np.all(error <= tolerance))
+
+            # frame 3 can't be quantized and is stored losslessly
+            result = arch.readPath('frames/3/position.f32.ind')
+            self.assertTrue(np.all(result.reshape(frames[3].shape) == frames[3]))
+
+            # too large to quantize with this tolerance
+            self.assertTrue(np.all(arch.readPath('frames/0/mass.f64.ind') == mass))
+
+    def test_codec(self, suffix):
+        records = {'frames/0/position.f32.ind': np.random.rand(101, 3).astype(np.float32),
+                   'frames/0/type.u32.ind': np.arange(333, dtype=np.uint32) % 3}
+
+        for codec in [gtar.CodecId.NoCodec, gtar.CodecId.LZ4Codec,
+                      gtar.CodecId.DeflateCodec, gtar.CodecId.ZstdCodec,
+                      gtar.CodecId.ZstdLongCodec]:
+            for level in [-1, 1]:
+                with gtar.GTAR('test' + suffix, 'w') as arch:
+                    arch.setCodec('', codec, level)
+                    arch.setShuffle('position', gtar.ShuffleMode.ByteShuffle)
+                    for path in records:
+                        arch.writePath(path, records[path])
+                    arch.writeStr('notes.txt', 'compressed text')
+
+                with gtar.GTAR('test' + suffix, 'r') as arch:
+                    for path in records:
+                        result = arch.readPath(path).reshape(records[path].shape)
+                        self.assertTrue(np.all(result == records[path]))
+                    self.assertEqual(arch.readStr('notes.txt'), 'compressed text')
+
+    def test_zstd_zip_method(self, suffix):
+        if suffix != '.zip':
+            return
+
+        import zipfile
+
+        values = np.arange(10000, dtype=np.uint32) % 7
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.setCodec('', gtar.CodecId.ZstdCodec, 10)
+            arch.writePath('values.u32.ind', values)
+
+        # standard tools should see the standard zstd method number
+        info = zipfile.ZipFile('test' + suffix).getinfo('values.u32.ind')
+        self.assertEqual(info.compress_type, 93)
+        self.assertEqual(info.file_size, values.nbytes)
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            self.assertTrue(np.all(arch.readPath('values.u32.ind') == values))
+
+    def test_fast_deflate_zip(self, suffix):
+        if suffix != '.zip':
+            return
+
+        import zipfile
+
+        records = {'position.f32.ind': (np.random.rand(5000, 3)*100).astype(np.float32),
+                   'type.u32.ind': np.arange(20000, dtype=np.uint32)//100,
+                   'noise.u32.ind': np.random.randint(0, 2**32, 3000, dtype=np.uint32),
+                   'empty.u32.ind': np.zeros(0, dtype=np.uint32)}
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            for path in records:
+                arch.writePath(path, records[path], gtar.CompressMode.FastCompress)
+
+        # standard tools should be able to inflate the records...
+        with zipfile.ZipFile('test' + suffix) as zf:
+            for path in records:
+                self.assertEqual(zf.read(path), records[path].tobytes())
+
+        # ...and we should be able to inflate theirs
+        with zipfile.ZipFile('test' + suffix, 'w', zipfile.ZIP_DEFLATED,
+                             allowZip64=True) as zf:
+            for path in records:
+                zf.writestr(path, records[path].tobytes())
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            for path in records:
+                self.assertTrue(np.all(arch.readPath(path) == records[path]))
+
+    def test_parallel_deflate(self, suffix):
+        # large enough to be split into several pieces, with some
+        # repetition across the pieces
+        positions = (np.random.rand(1000000, 3)*10).astype(np.float32)
+        positions[500000:] = positions[:500000]
+        positions = positions.reshape(-1)
+        modes = dict(fast=gtar.CompressMode.FastCompress,
+                     medium=gtar.CompressMode.MediumCompress)
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.setNumThreads(3)
+            for name in modes:
+                arch.writePath('{}.f32.ind'.format(name), positions, modes[name])
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            for name in modes:
+                self.assertTrue(np.all(arch.readPath('{}.f32.ind'.format(name)) == positions))
+
+        if suffix == '.zip':
+            import zipfile
+
+            with zipfile.ZipFile('test' + suffix) as zf:
+                self.assertEqual(zf.testzip(), None)
+                for name in modes:
+                    info = zf.getinfo('{}.f32.ind'.format(name))
+                    self.assertLess(info.compress_size, info.file_size)
+                    self.assertEqual(zf.read(info), positions.tobytes())
+
+    def test_zero_copy_reads(self, suffix):
+        # large enough that uncompressed records are mapped, not read
+        values = np.arange(1 << 19, dtype=np.float32)
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.writePath('stored.f32.ind', values, gtar.CompressMode.NoCompress)
+            arch.writePath('compressed.f32.ind', values, gtar.CompressMode.FastCompress)
+            arch.writeStr('text.txt', 'contents')
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            arch.setMapFiles(True)
+            stored = arch.readPath('stored.f32.ind')
+            compressed = arch.readPath('compressed.f32.ind')
+            self.assertEqual(arch.readStr('text.txt'), 'contents')
+            self.assertEqual(arch.readPath('text.txt'), 'contents')
+
+        # arrays remain valid after the archive is closed
+        for result in (stored, compressed):
+            self.assertFalse(result.flags.writeable)
+            self.assertTrue(np.all(result == values))
+
+            with self.assertRaises(ValueError):
+                result[0] = 1
+
+            # the array refers directly to the memory read from C++
+            self.assertFalse(result.flags.owndata)
+            self.assertEqual(len(memoryview(result.base)), values.nbytes)
+
+    def test_rewrite_after_read(self, suffix):
+        if suffix == '/':
+            shutil.rmtree('rewrite', ignore_errors=True)
+
+        # large enough to have been mapped if mapping were enabled
+        values = np.arange(1 << 20, dtype=np.float32)
+        path = 'frames/0/charge.f32.ind'
+
+        with gtar.GTAR('rewrite' + suffix, 'w') as arch:
+            arch.writePath(path, values, gtar.CompressMode.NoCompress)
+
+        with gtar.GTAR('rewrite' + suffix, 'r') as reader:
+            result = reader.readPath(path)
+
+            # arrays which were read must not change (or crash) when
+            # the file is rewritten or truncated
+            with gtar.GTAR('rewrite' + suffix, 'a') as writer:
+                writer.writePath(path, values[:10], gtar.CompressMode.NoCompress)
+            with gtar.GTAR('rewrite' + suffix, 'w') as writer:
+                writer.writePath(path, values[:10] + 1, gtar.CompressMode.NoCompress)
+
+            self.assertEqual(result[-1], values[-1])
+            self.assertTrue(np.all(result == values))
+
+    def test_threaded_reads(self, suffix):
+        from concurrent.futures import ThreadPoolExecutor
+
+        frames = [np.random.rand(20000).astype(np.float32) for _ in range(8)]
+        names = ['test' + suffix, 'test_threads' + suffix]
+
+        for name in names:
+            with gtar.GTAR(name, 'w') as arch, arch.getBulkWriter() as writer:
+                for (i, frame) in enumerate(frames):
+                    writer.writePath('frames/{}/charge.f32.ind'.format(i), frame)
+
+        # read from several archives, and share each one among
+        # threads, at once
+        archives = [gtar.GTAR(name, 'r') for name in names]
+        def read(task):
+            (arch, i) = task
+            return arch.readPath('frames/{}/charge.f32.ind'.format(i))
+
+        tasks = [(arch, i) for arch in archives for i in range(len(frames))]*4
+        with ThreadPoolExecutor(4) as pool:
+            results = list(pool.map(read, tasks))
+
+        for ((arch, i), result) in zip(tasks, results):
+            self.assertTrue(np.all(result == frames[i]))
+
+        for arch in archives:
+            arch.close()
+
+    def test_read_frames(self, suffix):
+        positions = np.random.rand(5, 10, 3).astype(np.float32)
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.setDelta('position', gtar.DeltaMode.XorDelta, 2)
+            for (i, frame) in enumerate(positions):
+                arch.writePath('frames/{}/position.f32.ind'.format(i), frame)
+            arch.writePath('frames/10/position.f32.ind', positions[0, :5])
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            record = gtar.Record('frames/0/position.f32.ind')
+            frames = [str(i) for i in range(len(positions))]
+
+            result = arch.readFrames(record, frames)
+            self.assertEqual(result.shape, positions.shape)
+            self.assertTrue(np.all(result == positions))
+
+            out = np.zeros_like(positions)
+            self.assertIs(arch.readFrames(record, reversed(frames), out=out), out)
+            self.assertTrue(np.all(out == positions[::-1]))
+
+            out = np.zeros_like(positions[0])
+            self.assertIs(arch.getRecord(record, frames[2], out=out), out)
+            self.assertTrue(np.all(out == positions[2]))
+
+            # frames of a different size, or arrays of the wrong type
+            with self.assertRaises(RuntimeError):
+                arch.readFrames(record, frames + ['10'])
+            with self.assertRaises(ValueError):
+                arch.getRecord(record, frames[2], out=out.astype(np.float64))
+
+    def test_trajectory_array(self, suffix):
+        positions = np.random.rand(20, 10, 3).astype(np.float32)
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            for (i, frame) in enumerate(positions):
+                arch.writePath('frames/{}/position.f32.ind'.format(i), frame,
+                               gtar.CompressMode.NoCompress if i % 2 else
+                               gtar.CompressMode.FastCompress)
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            array = gtar.TrajectoryArray(arch, gtar.Record('frames/0/position.f32.ind'),
+                                         [str(i) for i in range(len(positions))])
+
+            self.assertEqual(array.shape, positions.shape)
+            self.assertEqual(array.dtype, positions.dtype)
+            self.assertEqual(array.chunks, (1, 10, 3))
+            self.assertEqual(len(array), len(positions))
+
+            keys = [np.s_[:], np.s_[3], np.s_[-1, 2], np.s_[5:15:2, :, 0],
+                    np.s_[::-3, 4:], np.s_[..., 1], np.s_[[1, 7, 3]],
+                    np.s_[positions[:, 0, 0] > 0.5, 0], np.s_[2:2]]
+            for key in keys:
+                self.assertTrue(np.array_equal(array[key], positions[key]))
+
+            self.assertTrue(np.array_equal(np.asarray(array), positions))
+
+            with self.assertRaises(IndexError):
+                array[20]
+
+            # record groups in directory archives currently include
+            # the directory name, which hides the frames
+            if suffix != '/':
+                self.assertEqual(arch.array('position').shape, positions.shape)
+            with self.assertRaises(KeyError):
+                arch.array('velocity')
+
+    def test_strided_writes(self, suffix):
+        full = np.random.rand(20, 4).astype(np.float32)
+        arrays = dict(contiguous=full, columns=full[:, :3],
+                      reversed=full[::-2, 1], fortran=np.asfortranarray(full),
+                      broadcast=np.broadcast_to(full[0], (3, 4)),
+                      converted=full[:, :3].astype(np.float64),
+                      empty=full[:0, :3], scalar=full[2, 2])
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            for (name, arr) in arrays.items():
+                arch.writeArray('{}.f32.ind'.format(name), arr, dtype=np.float32)
+            arch.writeArray('buffer.u8.ind', bytearray(b'gtar'))
+            with arch.getBulkWriter() as writer:
+                writer.writeArray('bulk.f32.ind', full[1::3, ::2])
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            for (name, arr) in arrays.items():
+                result = arch.readPath('{}.f32.ind'.format(name))
+                self.assertTrue(np.all(result == np.ravel(arr).astype(np.float32)))
+            self.assertEqual(arch.readBytes('buffer.u8.ind'), b'gtar')
+            self.assertTrue(np.all(arch.readPath('bulk.f32.ind') == full[1::3, ::2].ravel()))
+
+    def test_copy_records(self, suffix):
+        from gtar import cat
+        values = np.random.randint(0, 16, (4, 1000)).astype(np.float32)
+
+        for (name, frames) in [('copy_a', values), ('copy_b', values[:2] + 1)]:
+            with gtar.GTAR(name + suffix, 'w') as arch:
+                arch.setDelta('charge', gtar.DeltaMode.XorDelta, 2)
+                for (i, frame) in enumerate(frames):
+                    arch.writePath('frames/{}/charge.f32.ind'.format(i), frame)
+                arch.writeStr('{}.txt'.format(name), name)
+
+        with gtar.GTAR('copy_a' + suffix, 'r') as source, \
+             gtar.GTAR('copy_out' + suffix, 'w') as target:
+            # records in directory archives are found with the
+            # directory name in their group
+            if suffix == '/':
+                target.copyRecords(source, ['frames/{}/charge.f32.ind'.format(i)
+                                            for i in range(len(values))] + ['copy_a.txt'])
+            else:
+                target.copyRecords(source)
+            with self.assertRaises(ValueError):
+                target.copyRecords(target)
+
+        with gtar.GTAR('copy_out' + suffix, 'r') as arch:
+            for (i, frame) in enumerate(values):
+                result = arch.readPath('frames/{}/charge.f32.ind'.format(i))
+                self.assertTrue(np.all(result == frame))
+            self.assertEqual(arch.readStr('copy_a.txt'), 'copy_a')
+
+        if suffix == '/':
+            return
+
+        # frames of the same record from several files can't be
+        # copied as they are stored, since they are delta-encoded
+        cat.main(['copy_a' + suffix, 'copy_b' + suffix], 'copy_cat' + suffix, threads=2)
+
+        with gtar.GTAR('copy_cat' + suffix, 'r') as arch:
+            for (i, frame) in enumerate(values):
+                result = arch.readPath('frames/{}/charge.f32.ind'.format(i))
+                self.assertTrue(np.all(result == (frame + 1 if i < 2 else frame)))
+            self.assertEqual(arch.readStr('copy_b.txt'), 'copy_b')
+
+    def test_verify_checksums(self, suffix):
+        values = np.arange(1000, dtype=np.uint32)
+
+        with gtar.GTAR('test' + suffix, 'w') as arch:
+            arch.writePath('values.u32.ind', values, gtar.CompressMode.NoCompress)
+
+        # corrupt the stored record in place
+        if suffix.endswith('/'):
+            filename = 'test' + suffix + 'values.u32.ind'
+        else:
+            filename = 'test' + suffix
+        with open(filename, 'rb') as f:
+            contents = bytearray(f.read())
+        offset = contents.find(values[500:510].tobytes())
+        contents[offset] ^= 0xFF
+        with open(filename, 'wb') as f:
+            f.write(contents)
+
+        expected = values.copy()
+        expected[500] ^= 0xFF
+
+        if suffix == '.zip':
+            with gtar.GTAR('test' + suffix, 'r') as arch:
+                with self.assertRaises(RuntimeError):
+                    arch.readPath('values.u32.ind')
+
+        with gtar.GTAR('test' + suffix, 'r') as arch:
+            arch.setVerifyChecksums(False)
+            self.assertTrue(np.all(arch.readPath('values.u32.ind') == expected))
+
+    def test_stats(self, suffix):
+        values = np.random.randint(0, 16, (3, 1000)).astype(np.float32)
+
+        with gtar.GTAR('stats' + suffix, 'w') as arch:
+            arch.setDelta('charge', gtar.DeltaMode.XorDelta, 2)
+            for (i, frame) in enumerate(values):
+                arch.writePath('frames/{}/charge.f32.ind'.format(i), frame)
+            arch.writeStr('notes.txt', 'notes')
+        stats = arch.stats()
+
+        self.assertEqual(stats['writes'], 4)
+        self.assertEqual(stats['uncompressedBytesWritten'], values.nbytes + 5)
+        self.assertGreater(stats['bytesWritten'], 0)
+
+        with gtar.GTAR('stats' + suffix, 'r') as arch:
+            for i in range(len(values)):
+                arch.readPath('frames/{}/charge.f32.ind'.format(i))
+            stats = arch.stats()
+            records = arch.recordStats()
+            arch.resetStats()
+            self.assertEqual(arch.stats()['reads'], 0)
+
+        self.assertGreaterEqual(stats['reads'], len(values))
+        self.assertEqual(stats['uncompressedBytesRead'], values.nbytes)
+        self.assertGreater(stats['bytesRead'], 0)
+        self.assertEqual(list(records), ['frames/*/charge.f32.ind'])
+        self.assertEqual(records['frames/*/charge.f32.ind']['reads'], stats['reads'])
+
+    def test_cache(self, suffix):
+        values = np.arange(1000, dtype=np.float32)
+        with gtar.GTAR('cache' + suffix, 'w') as arch:
+            arch.writePath('box.f32.uni', values[:6])
+            for i in range(3):
+                arch.writePath('frames/{}/charge.f32.ind'.format(i), values + i)
+
+        with gtar.GTAR('cache' + suffix, 'r') as arch:
+            arch.setCacheSize(values.nbytes + 24)
+            for i in range(3):
+                np.testing.assert_array_equal(arch.readPath('box.f32.uni'), values[:6])
+                np.testing.assert_array_equal(
+                    arch.readPath('frames/{}/charge.f32.ind'.format(i)), values + i)
+            # the last frame is still cached, the first was evicted
+            arch.readPath('frames/2/charge.f32.ind')
+            arch.readPath('frames/0/charge.f32.ind')
+            stats = arch.stats()
+
+        self.assertEqual(stats['cacheHits'], 3)
+        self.assertEqual(stats['cacheMisses'], 5)
+
+    def test_shared_cache(self, suffix):
+        values = np.arange(1000, dtype=np.float32)
+        with gtar.GTAR('shared' + suffix, 'w') as arch:
+            arch.writePath('values.f32.ind', values)
+
+        first = gtar.GTAR('shared' + suffix, 'r')
+        try:
+            first.setSharedCache(1 << 20)
+        except RuntimeError as e:
+            self.skipTest(str(e))
+
+        try:
+            first.readPath('values.f32.ind')
+            # a copy made by pickling shares the cache
+            second = pickle.loads(pickle.dumps(first))
+            self.assertEqual(second.sharedCacheName(), first.sharedCacheName())
+            np.testing.assert_array_equal(second.readPath('values.f32.ind'), values)
+            stats = second.stats()
+            self.assertEqual(stats['sharedCacheHits'], 1)
+            self.assertEqual(stats['reads'], 0)
+            second.close()
+        finally:
+            gtar.removeSharedCache(first.sharedCacheName())
+            first.close()
+
+    def test_index(self, suffix):
+        values = np.arange(99, dtype=np.float32).reshape((-1, 3))
+        with gtar.GTAR('index' + suffix, 'w') as arch:
+            arch.writePath('title.txt', 'index')
+            for frame in range(3):
+                arch.writePath('frames/{}/position.f32.ind'.format(frame), values + frame)
+
+        with gtar.GTAR('index' + suffix, 'r') as arch:
+            index = arch.exportIndex()
+            # copies made by pickling are opened with the index
+            copy = pickle.loads(pickle.dumps(arch))
+            self.assertEqual(copy.getRecordTypes(), arch.getRecordTypes())
+            for record in arch.getRecordTypes():
+                self.assertEqual(copy.queryFrames(record), arch.queryFrames(record))
+            copy.close()
+
+        with gtar.GTAR('index' + suffix, 'r', index=index) as arch:
+            self.assertEqual(arch.readPath('title.txt'), 'index')
+            (record,) = [rec for rec in arch.getRecordTypes() if rec.getName() == 'position']
+            self.assertEqual(arch.queryFrames(record), ['0', '1', '2'])
+            np.testing.assert_array_equal(arch.readPath('frames/2/position.f32.ind'), values + 2)
+
+    def test_refresh(self, suffix):
+        # directory archives keep the files of earlier runs
+        if suffix == '/':
+            shutil.rmtree('refresh', ignore_errors=True)
+
+        with gtar.GTAR('refresh' + suffix, 'w') as arch:
+            arch.writeStr('frames/0/value.txt', '0')
+
+        with gtar.GTAR('refresh' + suffix, 'r') as reader:
+            self.assertEqual(reader.refresh(), 0)
+            with gtar.GTAR('refresh' + suffix, 'a') as writer:
+                writer.writeStr('frames/1/value.txt', '1')
+            self.assertEqual(reader.refresh(), 1)
+            self.assertEqual(reader.readStr('frames/1/value.txt'), '1')
+            (record,) = [rec for rec in reader.getRecordTypes() if rec.getName() == 'value.txt']
+            self.assertEqual(reader.queryFrames(record), ['0', '1'])
+
+    def test_refresh_rewritten(self, suffix):
+        if suffix == '/':
+            shutil.rmtree('refresh_rewritten', ignore_errors=True)
+
+        path = 'frames/0/charge.f32.ind'
+        with gtar.GTAR('refresh_rewritten' + suffix, 'w') as arch:
+            arch.writePath(path, np.zeros(100, dtype=np.float32))
+
+        # neither cache returns the old contents of a rewritten
+        # record once refresh() has found it
+        with gtar.GTAR('refresh_rewritten' + suffix, 'r') as reader:
+            reader.setCacheSize(1 << 20)
+            try:
+                reader.setSharedCache(1 << 20)
+            except RuntimeError:
+                pass
+            try:
+                self.assertTrue(np.all(reader.readPath(path) == 0))
+                with gtar.GTAR('refresh_rewritten' + suffix, 'a') as writer:
+                    writer.writePath(path, np.ones(100, dtype=np.float32))
+                reader.refresh()
+                self.assertTrue(np.all(reader.readPath(path) == 1))
+            finally:
+                if reader.sharedCacheName():
+                    gtar.removeSharedCache(reader.sharedCacheName())
+
+    def test_tracing(self, suffix):
+        values = np.arange(1000, dtype=np.float32)
+        gtar.startTracing('trace.json')
+        try:
+            self.assertTrue(gtar.tracingEnabled())
+            with gtar.GTAR('trace' + suffix, 'w') as arch:
+                arch.writePath('values.f32.ind', values)
+            with gtar.GTAR('trace' + suffix, 'r') as arch:
+                arch.readPath('values.f32.ind')
+        finally:
+            gtar.stopTracing()
+        self.assertFalse(gtar.tracingEnabled())
+
+        with open('trace.json') as f:
+            events = json.load(f)['traceEvents']
+        names = set(event['name'] for event in events)
+        self.assertTrue({'open', 'index', 'write', 'read', 'close'}.issubset(names))
+        paths = set(event['args']['path'] for event in events if 'args' in event)
+        self.assertIn('values.f32.ind', paths)
+        for event in events:
+            self.assertEqual(event['ph'], 'X')
+            self.assertGreaterEqual(event['dur'], 0)
+
 TestGTAR = MultiSuffixMeta(
     TestGTAR.__name__, TestGTAR.__bases__, dict(TestGTAR.__dict__))
 
@@ -0,0 +1,508 @@
+// getar.cpp
+// by Matthew Spellings <mspells@umich.edu>
+
+// Command-line tool to list, extract, and summarize the records of
+// getar-formatted archives without starting python
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Records are extracted on several threads if C++11 threads are
+// available
+#if __cplusplus > 199711L
+#define GTAR_USE_THREADS
+#include <thread>
+#endif
+
+#include "GTAR.hpp"
+#include "Record.hpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::map;
+using std::ofstream;
+using std::runtime_error;
+using std::set;
+using std::setw;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+using namespace gtar;
+
+static const char *USAGE =
+    "usage: getar ls [-l] ARCHIVE [PATTERN...]\n"
+    "       getar extract [-C DIR] [-O] [-j THREADS] ARCHIVE [PATTERN...]\n"
+    "       getar stats ARCHIVE [PATTERN...]\n"
+    "\n"
+    "List, extract, or summarize the files in a getar-formatted archive\n"
+    "(.zip, .tar, .sqlite, or a directory ending in /). PATTERNs select\n"
+    "files by path with the wildcards *, ?, and [...], where * also\n"
+    "matches /; every file is selected if none are given.\n"
+    "\n"
+    "ls:      print the path of each file; -l also prints the number of\n"
+    "         bytes it takes up in the archive, its size, and the codec\n"
+    "         the archive compresses it with\n"
+    "extract: write each file under DIR (the current directory by\n"
+    "         default), or its contents to standard output with -O,\n"
+    "         using THREADS threads (0 for one per processor); leading\n"
+    "         slashes are removed and paths containing .. are refused\n"
+    "stats:   print the number of files, bytes stored, size,\n"
+    "         compression ratio, and codecs of each kind of record\n";
+
+// Returns true if the character c is in the bracket expression
+// starting just after the [ at pattern; end is set to the index
+// after the closing ]
+static bool matchBracket(const string &pattern, size_t start, char c, size_t &end)
+{
+    size_t i(start);
+    const bool negate(i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^'));
+    if(negate)
+        ++i;
+
+    bool found(false);
+    // a ] right after the [ is part of the set
+    for(bool first(true); i < pattern.size() && (first || pattern[i] != ']'); first = false)
+    {
+        if(i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']')
+        {
+            found |= pattern[i] <= c && c <= pattern[i + 2];
+            i += 3;
+        }
+        else
+            found |= pattern[i++] == c;
+    }
+
+    end = i + 1;
+    return found != negate;
+}
+
+// Match a path against a shell-style wildcard pattern
+static bool globMatch(const string &pattern, const string &path)
+{
+    size_t p(0), s(0);
+    // positions to return to when the most recent * should match
+    // one more character
+    size_t starP(string::npos), starS(0);
+
+    while(s < path.size())
+    {
+        if(p < pattern.size() && pattern[p] == '*')
+        {
+            starP = p++;
+            starS = s;
+            continue;
+        }
+
+        size_t next(p + 1);
+        bool matched(false);
+        if(p < pattern.size() && pattern[p] == '[' && pattern.find(']', p + 2) != string::npos)
+            matched = matchBracket(pattern, p + 1, path[s], next);
+        else if(p < pattern.size())
+            matched = pattern[p] == '?' || pattern[p] == path[s];
+
+        if(matched)
+        {
+            p = next;
+            ++s;
+        }
+        else if(starP != string::npos)
+        {
+            p = starP + 1;
+            s = ++starS;
+        }
+        else
+            return false;
+    }
+
+    while(p < pattern.size() && pattern[p] == '*')
+        ++p;
+
+    return p == pattern.size();
+}
+
+// Find the paths in the archive matching any of the given patterns
+static vector<string> selectPaths(GTAR &archive, const string &filename,
+                                  const vector<string> &patterns)
+{
+    vector<string> paths(archive.getPaths());
+
+    // directory archives name their files including the directory
+    // itself, but read them relative to it
+    if(filename.size() && filename[filename.size() - 1] == '/')
+        for(size_t i(0); i < paths.size(); ++i)
+            if(paths[i].compare(0, filename.size(), filename) == 0)
+                paths[i] = paths[i].substr(filename.size());
+
+    if(patterns.empty())
+        return paths;
+
+    vector<string> result;
+    for(size_t i(0); i < paths.size(); ++i)
+        for(size_t j(0); j < patterns.size(); ++j)
+            if(globMatch(patterns[j], paths[i]))
+            {
+                result.push_back(paths[i]);
+                break;
+            }
+
+    return result;
+}
+
+static string codecName(unsigned int codec)
+{
+    try
+    {
+        return getCodec(codec).name();
+    }
+    catch(runtime_error&)
+    {
+        stringstream result;
+        result << "codec" << codec;
+        return result.str();
+    }
+}
+
+static int listFiles(const string &filename, const vector<string> &patterns, bool details)
+{
+    GTAR archive(filename, Read);
+    const vector<string> paths(selectPaths(archive, filename, patterns));
+
+    for(size_t i(0); i < paths.size(); ++i)
+    {
+        if(details)
+        {
+            const FileInfo info(archive.getFileInfo(paths[i]));
+            cout << setw(12) << info.storedLength << ' ' << setw(12) << info.byteLength
+                 << ' ' << std::left << setw(9) << codecName(info.codec) << std::right << ' ';
+        }
+
+        cout << paths[i] << '\n';
+    }
+
+    return 0;
+}
+
+// Characters which separate the directories of paths being extracted
+#ifdef _WIN32
+static const char *PATH_SEPARATORS = "/\\";
+#else
+static const char *PATH_SEPARATORS = "/";
+#endif
+
+// Create the directories leading up to the file at path
+static void createParents(const string &path)
+{
+    for(size_t slash(path.find('/', 1)); slash != string::npos;
+        slash = path.find('/', slash + 1))
+    {
+        const string parent(path.substr(0, slash));
+#ifdef _WIN32
+        const int status(_mkdir(parent.c_str()));
+#else
+        const int status(mkdir(parent.c_str(), 0755));
+#endif
+        if(status && errno != EEXIST)
+        {
+            stringstream message;
+            message << "Error creating directory " << parent << ": " << strerror(errno);
+            throw runtime_error(message.str());
+        }
+    }
+}
+
+// Path relative to the extraction directory to write the file at
+// path to: leading slashes and . components are dropped, and paths
+// with .. components are refused so that nothing is written outside
+// of the directory
+static string extractedPath(const string &path)
+{
+    string result;
+    size_t start(0);
+    while(start <= path.size())
+    {
+        size_t end(path.find_first_of(PATH_SEPARATORS, start));
+        if(end == string::npos)
+            end = path.size();
+        const string component(path.substr(start, end - start));
+
+        if(component == "..")
+            throw runtime_error("Refusing to extract " + path +
+                                " outside of the target directory");
+        else if(!component.empty() && component != ".")
+            result += (result.empty()? "": "/") + component;
+
+        start = end + 1;
+    }
+
+    if(result.empty())
+        throw runtime_error("Refusing to extract " + path + " without a file name");
+
+    return result;
+}
+
+// Extracts every stride-th of a list of files, starting with the
+// first-th, using its own handle on the archive
+class Extractor
+{
+public:
+    Extractor(const string &filename, const vector<string> &paths,
+              const vector<string> &targets, size_t first, size_t stride):
+        m_filename(filename), m_paths(&paths), m_targets(&targets), m_first(first),
+        m_stride(stride), m_error()
+    {}
+
+    void run()
+    {
+        try
+        {
+            GTAR archive(m_filename, Read);
+
+            for(size_t i(m_first); i < m_paths->size(); i += m_stride)
+            {
+                const string &path((*m_paths)[i]);
+                SharedArray<char> contents(archive.readBytes(path));
+                const string &target((*m_targets)[i]);
+
+                createParents(target);
+                ofstream output(target.c_str(), std::ios_base::out | std::ios_base::binary);
+                output.write(contents.get(), contents.size());
+
+                if(!output.good())
+                    throw runtime_error("Error writing " + target);
+            }
+        }
+        catch(std::exception &error)
+        {
+            m_error = error.what();
+            if(m_error.empty())
+                m_error = "Error extracting files";
+        }
+    }
+
+    const string &error() const
+    {
+        return m_error;
+    }
+
+private:
+    string m_filename;
+    const vector<string> *m_paths;
+    const vector<string> *m_targets;
+    size_t m_first;
+    size_t m_stride;
+    string m_error;
+};
+
+static int extractFiles(const string &filename, const vector<string> &patterns,
+                        string directory, bool toStdout, unsigned int numThreads)
+{
+    vector<string> paths;
+    {
+        GTAR archive(filename, Read);
+        paths = selectPaths(archive, filename, patterns);
+
+        if(toStdout)
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            for(size_t i(0); i < paths.size(); ++i)
+            {
+                SharedArray<char> contents(archive.readBytes(paths[i]));
+                cout.write(contents.get(), contents.size());
+            }
+            cout.flush();
+            return cout.good()? 0: 1;
+        }
+    }
+
+    if(directory.size() && directory[directory.size() - 1] != '/')
+        directory += '/';
+
+    // check every path before writing anything
+    vector<string> targets;
+    for(size_t i(0); i < paths.size(); ++i)
+        targets.push_back(directory + extractedPath(paths[i]));
+
+#ifdef GTAR_USE_THREADS
+    if(!numThreads)
+        numThreads = std::thread::hardware_concurrency();
+#endif
+    if(!numThreads)
+        numThreads = 1;
+    if(numThreads > paths.size())
+        numThreads = paths.size()? paths.size(): 1;
+
+    vector<Extractor> workers;
+    for(size_t i(0); i < numThreads; ++i)
+        workers.push_back(Extractor(filename, paths, targets, i, numThreads));
+
+#ifdef GTAR_USE_THREADS
+    vector<std::thread> pool;
+    for(size_t i(1); i < workers.size(); ++i)
+        pool.push_back(std::thread(&Extractor::run, &workers[i]));
+    workers[0].run();
+    for(size_t i(0); i < pool.size(); ++i)
+        pool[i].join();
+#else
+    for(size_t i(0); i < workers.size(); ++i)
+        workers[i].run();
+#endif
+
+    for(size_t i(0); i < workers.size(); ++i)
+        if(!workers[i].error().empty())
+            throw runtime_error(workers[i].error());
+
+    return 0;
+}
+
+// Totals for one kind of record
+struct RecordStats
+{
+    RecordStats():
+        files(0), storedLength(0), byteLength(0), codecs()
+    {}
+
+    size_t files;
+    uint64_t storedLength;
+    uint64_t byteLength;
+    set<string> codecs;
+};
+
+static void printStats(const string &name, const RecordStats &stats)
+{
+    stringstream codecs;
+    for(set<string>::const_iterator iter(stats.codecs.begin());
+        iter != stats.codecs.end(); ++iter)
+        codecs << (iter == stats.codecs.begin()? "": ",") << *iter;
+
+    cout << std::left << setw(40) << name << std::right << setw(10) << stats.files
+         << setw(16) << stats.storedLength << setw(16) << stats.byteLength
+         << setw(8) << std::fixed << std::setprecision(2)
+         << (stats.storedLength? (double) stats.byteLength/stats.storedLength: 1.0)
+         << "  " << codecs.str() << '\n';
+}
+
+static int printArchiveStats(const string &filename, const vector<string> &patterns)
+{
+    GTAR archive(filename, Read);
+    const vector<string> paths(selectPaths(archive, filename, patterns));
+
+    // group the frames of each record together, named by their
+    // path with the index replaced by *
+    map<string, RecordStats> records;
+    RecordStats total;
+    for(size_t i(0); i < paths.size(); ++i)
+    {
+        Record rec(paths[i]);
+        if(rec.getBehavior() != Constant)
+            rec.setIndex("*");
+
+        const FileInfo info(archive.getFileInfo(paths[i]));
+        RecordStats *targets[2] = {&records[rec.getPath()], &total};
+        for(size_t j(0); j < 2; ++j)
+        {
+            ++targets[j]->files;
+            targets[j]->storedLength += info.storedLength;
+            targets[j]->byteLength += info.byteLength;
+            targets[j]->codecs.insert(codecName(info.codec));
+        }
+    }
+
+    cout << std::left << setw(40) << "record" << std::right << setw(10) << "files"
+         << setw(16) << "stored" << setw(16) << "size" << setw(8) << "ratio"
+         << "  codecs\n";
+    for(map<string, RecordStats>::const_iterator iter(records.begin());
+        iter != records.end(); ++iter)
+        printStats(iter->first, iter->second);
+    printStats("total", total);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> args(argv + 1, argv + argc);
+
+    if(args.empty() || args[0] == "-h" || args[0] == "--help")
+    {
+        (args.empty()? cerr: cout) << USAGE;
+        return args.empty()? 2: 0;
+    }
+
+    const string command(args[0]);
+    bool details(false), toStdout(false);
+    string directory;
+    unsigned int numThreads(1);
+    vector<string> positional;
+
+    try
+    {
+        for(size_t i(1); i < args.size(); ++i)
+        {
+            const bool hasValue(i + 1 < args.size());
+
+            if(!positional.empty() || args[i].empty() || args[i][0] != '-' || args[i] == "-")
+                positional.push_back(args[i]);
+            else if(command == "ls" && args[i] == "-l")
+                details = true;
+            else if(command == "extract" && args[i] == "-O")
+                toStdout = true;
+            else if(command == "extract" && args[i] == "-C" && hasValue)
+                directory = args[++i];
+            else if(command == "extract" && (args[i] == "-j" || args[i] == "--threads") &&
+                    hasValue)
+                numThreads = strtoul(args[++i].c_str(), NULL, 10);
+            else
+            {
+                cerr << "getar: unknown option " << args[i] << "\n\n" << USAGE;
+                return 2;
+            }
+        }
+
+        if(positional.empty())
+        {
+            cerr << "getar: no archive given\n\n" << USAGE;
+            return 2;
+        }
+
+        const string filename(positional[0]);
+        const vector<string> patterns(positional.begin() + 1, positional.end());
+
+        if(command == "ls")
+            return listFiles(filename, patterns, details);
+        else if(command == "extract")
+            return extractFiles(filename, patterns, directory, toStdout, numThreads);
+        else if(command == "stats")
+            return printArchiveStats(filename, patterns);
+
+        cerr << "getar: unknown command " << command << "\n\n" << USAGE;
+        return 2;
+    }
+    catch(std::exception &error)
+    {
+        cerr << "getar: " << error.what() << endl;
+        return 1;
+    }
+}
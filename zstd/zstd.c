@@ -0,0 +1,38 @@
+/*
+ * Single translation unit containing the parts of Zstandard 1.5.7
+ * (lib/common, lib/compress, and lib/decompress) which libgetar
+ * uses, so that only one file needs to be added to each build.
+ * Compiled single-threaded and without the x86-64 assembly
+ * decoder, which would need an assembler in every build.
+ */
+#define ZSTD_DISABLE_ASM 1
+#undef ZSTD_MULTITHREAD
+
+#include "common/debug.c"
+#include "common/entropy_common.c"
+#include "common/error_private.c"
+#include "common/fse_decompress.c"
+#include "common/pool.c"
+#include "common/threading.c"
+#include "common/xxhash.c"
+#include "common/zstd_common.c"
+
+#include "compress/fse_compress.c"
+#include "compress/hist.c"
+#include "compress/huf_compress.c"
+#include "compress/zstd_compress_literals.c"
+#include "compress/zstd_compress_sequences.c"
+#include "compress/zstd_compress_superblock.c"
+#include "compress/zstd_compress.c"
+#include "compress/zstd_double_fast.c"
+#include "compress/zstd_fast.c"
+#include "compress/zstd_lazy.c"
+#include "compress/zstd_ldm.c"
+#include "compress/zstd_opt.c"
+#include "compress/zstd_preSplit.c"
+#include "compress/zstdmt_compress.c"
+
+#include "decompress/huf_decompress.c"
+#include "decompress/zstd_ddict.c"
+#include "decompress/zstd_decompress.c"
+#include "decompress/zstd_decompress_block.c"